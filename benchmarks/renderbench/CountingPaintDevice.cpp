@@ -0,0 +1,154 @@
+#include "CountingPaintDevice.h"
+
+CountingPaintEngine::CountingPaintEngine()
+    : QPaintEngine(QPaintEngine::AllFeatures)
+{
+}
+
+void CountingPaintEngine::reset()
+{
+    m_textCalls = 0;
+    m_imageCalls = 0;
+    m_drawCalls = 0;
+}
+
+bool CountingPaintEngine::begin(QPaintDevice *)
+{
+    return true;
+}
+
+bool CountingPaintEngine::end()
+{
+    return true;
+}
+
+void CountingPaintEngine::updateState(const QPaintEngineState &)
+{
+}
+
+QPaintEngine::Type CountingPaintEngine::type() const
+{
+    return QPaintEngine::User;
+}
+
+void CountingPaintEngine::drawRects(const QRect *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawRects(const QRectF *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawLines(const QLine *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawLines(const QLineF *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawEllipse(const QRectF &)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawEllipse(const QRect &)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPath(const QPainterPath &)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPoints(const QPointF *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPoints(const QPoint *, int)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPolygon(const QPointF *, int, PolygonDrawMode)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPolygon(const QPoint *, int, PolygonDrawMode)
+{
+    m_drawCalls++;
+}
+
+void CountingPaintEngine::drawPixmap(const QRectF &, const QPixmap &, const QRectF &)
+{
+    m_drawCalls++;
+    m_imageCalls++;
+}
+
+void CountingPaintEngine::drawTextItem(const QPointF &, const QTextItem &)
+{
+    m_drawCalls++;
+    m_textCalls++;
+}
+
+void CountingPaintEngine::drawTiledPixmap(const QRectF &, const QPixmap &, const QPointF &)
+{
+    m_drawCalls++;
+    m_imageCalls++;
+}
+
+void CountingPaintEngine::drawImage(const QRectF &, const QImage &, const QRectF &,
+                                    Qt::ImageConversionFlags)
+{
+    m_drawCalls++;
+    m_imageCalls++;
+}
+
+CountingPaintDevice::CountingPaintDevice(const QSize &size, int dpiX, int dpiY)
+    : m_size(size)
+    , m_dpiX(dpiX)
+    , m_dpiY(dpiY)
+{
+}
+
+CountingPaintEngine *CountingPaintDevice::paintEngine() const
+{
+    return &m_engine;
+}
+
+int CountingPaintDevice::metric(PaintDeviceMetric metric) const
+{
+    switch (metric) {
+    case PdmWidth:
+        return m_size.width();
+    case PdmHeight:
+        return m_size.height();
+    case PdmWidthMM:
+        return qRound(m_size.width() * 25.4 / m_dpiX);
+    case PdmHeightMM:
+        return qRound(m_size.height() * 25.4 / m_dpiY);
+    case PdmNumColors:
+        return 0;
+    case PdmDepth:
+        return 32;
+    case PdmDpiX:
+    case PdmPhysicalDpiX:
+        return m_dpiX;
+    case PdmDpiY:
+    case PdmPhysicalDpiY:
+        return m_dpiY;
+    case PdmDevicePixelRatio:
+        return 1;
+    case PdmDevicePixelRatioScaled:
+        return static_cast<int>(devicePixelRatioFScale());
+    default:
+        return QPaintDevice::metric(metric);
+    }
+}
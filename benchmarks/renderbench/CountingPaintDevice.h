@@ -0,0 +1,75 @@
+#ifndef COUNTINGPAINTDEVICE_H
+#define COUNTINGPAINTDEVICE_H
+
+#include <QPaintDevice>
+#include <QPaintEngine>
+
+/**
+ * A paint engine which draws nothing but counts the calls made to it.
+ * Every call may draw several primitives, for example several rectangles,
+ * so the counts are those a backend would see.
+ */
+class CountingPaintEngine : public QPaintEngine
+{
+public:
+    CountingPaintEngine();
+
+    /** The number of calls which draw text. */
+    int textCalls() const { return m_textCalls; }
+    /** The number of calls which draw images or pixmaps. */
+    int imageCalls() const { return m_imageCalls; }
+    /** The number of all drawing calls, including text and images. */
+    int drawCalls() const { return m_drawCalls; }
+    void reset();
+
+    bool begin(QPaintDevice *device) override;
+    bool end() override;
+    void updateState(const QPaintEngineState &state) override;
+    Type type() const override;
+
+    void drawRects(const QRect *rects, int rectCount) override;
+    void drawRects(const QRectF *rects, int rectCount) override;
+    void drawLines(const QLine *lines, int lineCount) override;
+    void drawLines(const QLineF *lines, int lineCount) override;
+    void drawEllipse(const QRectF &rect) override;
+    void drawEllipse(const QRect &rect) override;
+    void drawPath(const QPainterPath &path) override;
+    void drawPoints(const QPointF *points, int pointCount) override;
+    void drawPoints(const QPoint *points, int pointCount) override;
+    void drawPolygon(const QPointF *points, int pointCount, PolygonDrawMode mode) override;
+    void drawPolygon(const QPoint *points, int pointCount, PolygonDrawMode mode) override;
+    void drawPixmap(const QRectF &rect, const QPixmap &pixmap, const QRectF &source) override;
+    void drawTextItem(const QPointF &point, const QTextItem &textItem) override;
+    void drawTiledPixmap(const QRectF &rect, const QPixmap &pixmap, const QPointF &offset) override;
+    void drawImage(const QRectF &rect, const QImage &image, const QRectF &source,
+                   Qt::ImageConversionFlags flags) override;
+
+private:
+    int m_textCalls = 0;
+    int m_imageCalls = 0;
+    int m_drawCalls = 0;
+};
+
+/**
+ * A paint device of a given size and resolution which paints with a
+ * CountingPaintEngine.  Rendering a widget into it counts the drawing calls
+ * made by its paintEvent().
+ */
+class CountingPaintDevice : public QPaintDevice
+{
+public:
+    CountingPaintDevice(const QSize &size, int dpiX, int dpiY);
+
+    CountingPaintEngine *paintEngine() const override;
+
+protected:
+    int metric(PaintDeviceMetric metric) const override;
+
+private:
+    mutable CountingPaintEngine m_engine;
+    QSize m_size;
+    int m_dpiX;
+    int m_dpiY;
+};
+
+#endif // COUNTINGPAINTDEVICE_H
@@ -0,0 +1,400 @@
+/*
+    Measures what a frame costs TerminalDisplay.
+
+    A display is shown under the offscreen platform and driven with
+    synthetic screen contents.  Every frame is split into the phases which
+    the display runs after new output:
+
+        update   updateLineProperties() and updateImage(), which copy the
+                 changed lines, scroll the image and compute the dirty region
+        filters  updateFilters(), which finds the hotspots
+        paint    paintEvent(), which draws the dirty region
+
+    The drawing calls of every frame are counted by rendering the same
+    region once more into a CountingPaintDevice.
+
+        renderbench
+        renderbench --scenario scroll --grid 80x24 --grid 300x100 --font-size 8
+*/
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QPaintEvent>
+#include <QTextStream>
+
+#include "CountingPaintDevice.h"
+#include "Filter.h"
+#include "History.h"
+#include "ScreenWindow.h"
+#include "TerminalDisplay.h"
+#include "Vt102Emulation.h"
+
+namespace {
+
+// times paintEvent() and remembers the region it painted
+class MeasuredDisplay : public TerminalDisplay
+{
+public:
+    qint64 paintTime = 0;
+    QRegion paintedRegion;
+    bool measuring = true;
+
+protected:
+    void paintEvent(QPaintEvent *event) override
+    {
+        if (!measuring) {
+            TerminalDisplay::paintEvent(event);
+            return;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        TerminalDisplay::paintEvent(event);
+        paintTime += timer.nsecsElapsed();
+        paintedRegion += event->region();
+    }
+};
+
+class Random
+{
+public:
+    quint32 next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int bounded(int limit) { return static_cast<int>(next() % static_cast<quint32>(limit)); }
+
+private:
+    quint32 m_state = 2463534242u;
+};
+
+QByteArray moveTo(int line, int column)
+{
+    return "\033[" + QByteArray::number(line) + ';' + QByteArray::number(column) + 'H';
+}
+
+// a line of text with a color change every few words
+QByteArray textLine(Random &random, int columns)
+{
+    static const char *const colors[] = { "0", "31", "32", "1;34", "33", "38;5;208", "7" };
+
+    QByteArray line;
+    int column = 0;
+    while (column < columns - 1) {
+        line += "\033[";
+        line += colors[random.bounded(7)];
+        line += 'm';
+        const int length = qMin(columns - 1 - column, 2 + random.bounded(10));
+        for (int i = 0; i < length; i++)
+            line += char('a' + random.bounded(26));
+        line += ' ';
+        column += length + 1;
+    }
+    return line + "\033[0m";
+}
+
+// a line with several URLs, which the UrlFilter turns into hotspots
+QByteArray urlLine(Random &random, int columns)
+{
+    QByteArray line;
+    while (line.size() < columns - 30) {
+        line += "https://example.com/" + QByteArray::number(random.bounded(100000)) + ' ';
+        line += "see ";
+    }
+    return line;
+}
+
+enum Scenario {
+    FullRedraw,     // every line changes
+    Scroll,         // one new line at the bottom
+    SingleLine,     // one line changes in place
+    Selection,      // the selection grows over unchanged text
+    Hotspots,       // scrolling text full of URLs, with a UrlFilter
+};
+
+const char *const scenarioNames[] = { "full", "scroll", "line", "selection", "hotspots" };
+
+struct Options
+{
+    int frames = 200;
+    bool countCalls = true;
+};
+
+struct Result
+{
+    int frames = 0;
+    qint64 update = 0;
+    qint64 filters = 0;
+    qint64 paint = 0;
+    quint64 drawCalls = 0;
+    quint64 textCalls = 0;
+    double dirtyArea = 0;   // sum of the painted fractions of the display
+};
+
+class Bench
+{
+public:
+    Bench(Scenario scenario, const QSize &grid, const QFont &font)
+        : m_scenario(scenario)
+    {
+        m_emulation.setCodec(QStringEncoder{QStringConverter::Encoding::Utf8});
+        m_emulation.setHistory(HistoryTypeBuffer(1000));
+        // send every frame as soon as the event loop runs
+        m_emulation.setFramePacing(Emulation::AdaptiveFramePacing);
+        m_emulation.setFrameInterval(0);
+
+        m_display.setVTFont(font);
+        m_window = m_emulation.createWindow();
+        m_display.setScreenWindow(m_window);
+
+        // the benchmark runs the phases itself
+        QObject::disconnect(m_window, &ScreenWindow::outputChanged, &m_display, nullptr);
+        QObject::disconnect(m_window, &ScreenWindow::scrolled, &m_display, nullptr);
+
+        if (scenario == Hotspots)
+            m_display.filterChain()->addFilter(&m_urlFilter);
+
+        m_display.setSize(grid.width(), grid.height());
+        m_display.resize(m_display.sizeHint());
+        m_display.show();
+        QApplication::processEvents();
+        m_emulation.setImageSize(m_display.lines(), m_display.columns());
+
+        // start from a full screen
+        QByteArray text = "\033[?25l\033[H\033[2J";
+        for (int line = 1; line <= m_display.lines(); line++) {
+            text += moveTo(line, 1);
+            text += scenario == Hotspots ? urlLine(m_random, m_display.columns())
+                                         : textLine(m_random, m_display.columns());
+        }
+        receive(text);
+        runFrame(nullptr, 0);
+    }
+
+    ~Bench()
+    {
+        m_display.filterChain()->removeFilter(&m_urlFilter);
+    }
+
+    Result run(const Options &options)
+    {
+        Result result;
+        for (int frame = 1; frame <= options.frames; frame++) {
+            step(frame);
+            runFrame(&result, options.countCalls);
+        }
+        return result;
+    }
+
+private:
+    void receive(const QByteArray &data)
+    {
+        const quint64 frames = m_emulation.frameStatistics().frames;
+        m_emulation.receiveData(data.constData(), static_cast<int>(data.size()));
+
+        // let the emulation send the update to the screen window
+        QElapsedTimer timeout;
+        timeout.start();
+        while (m_emulation.frameStatistics().frames == frames && timeout.elapsed() < 1000)
+            QApplication::processEvents(QEventLoop::AllEvents, 1);
+    }
+
+    // changes the screen for the next frame
+    void step(int frame)
+    {
+        const int lines = m_display.lines();
+        const int columns = m_display.columns();
+
+        switch (m_scenario) {
+        case FullRedraw: {
+            QByteArray text;
+            for (int line = 1; line <= lines; line++)
+                text += moveTo(line, 1) + textLine(m_random, columns) + "\033[K";
+            receive(text);
+            break;
+        }
+        case Scroll:
+            receive(moveTo(lines, 1) + "\r\n" + textLine(m_random, columns));
+            break;
+        case SingleLine:
+            receive(moveTo(1 + m_random.bounded(lines), 1) + textLine(m_random, columns) + "\033[K");
+            break;
+        case Selection:
+            if (frame == 1)
+                m_window->setSelectionStart(0, 0, false);
+            m_window->setSelectionEnd(frame * 7 % columns, frame % lines);
+            break;
+        case Hotspots:
+            receive(moveTo(lines, 1) + "\r\n" + urlLine(m_random, columns));
+            break;
+        }
+    }
+
+    void runFrame(Result *result, bool countCalls)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        m_display.updateLineProperties();
+        m_display.updateImage();
+        const qint64 update = timer.nsecsElapsed();
+
+        timer.start();
+        m_display.updateFilters();
+        const qint64 filters = timer.nsecsElapsed();
+
+        m_display.paintTime = 0;
+        m_display.paintedRegion = QRegion();
+        QApplication::processEvents();
+
+        if (!result)
+            return;
+
+        result->frames++;
+        result->update += update;
+        result->filters += filters;
+        result->paint += m_display.paintTime;
+
+        qint64 dirty = 0;
+        for (const QRect &rect : m_display.paintedRegion)
+            dirty += qint64(rect.width()) * rect.height();
+        result->dirtyArea += double(dirty) / qMax(1, m_display.width() * m_display.height());
+
+        if (countCalls && !m_display.paintedRegion.isEmpty()) {
+            CountingPaintDevice device(m_display.size(), m_display.logicalDpiX(), m_display.logicalDpiY());
+            m_display.measuring = false;
+            m_display.render(&device, QPoint(), m_display.paintedRegion, QWidget::RenderFlags());
+            m_display.measuring = true;
+            result->drawCalls += device.paintEngine()->drawCalls();
+            result->textCalls += device.paintEngine()->textCalls();
+        }
+    }
+
+    Scenario m_scenario;
+    Vt102Emulation m_emulation;
+    MeasuredDisplay m_display;
+    ScreenWindow *m_window = nullptr;
+    UrlFilter m_urlFilter;
+    Random m_random;
+};
+
+QString microseconds(qint64 nanoseconds, int frames)
+{
+    return QString::number(nanoseconds / 1000.0 / qMax(1, frames), 'f', 1);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+
+    QStringList allScenarios;
+    for (const char *name : scenarioNames)
+        allScenarios << QString::fromLatin1(name);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measures the cost of rendering terminal frames."));
+    parser.addHelpOption();
+    const QCommandLineOption scenarioOption(QStringLiteral("scenario"),
+        QStringLiteral("Runs the scenario <name>: %1. All by default.").arg(allScenarios.join(QLatin1String(", "))),
+        QStringLiteral("name"));
+    const QCommandLineOption gridOption(QStringLiteral("grid"),
+        QStringLiteral("Runs with a <columns>x<lines> terminal. 80x24, 200x60 and 300x100 by default."),
+        QStringLiteral("size"));
+    const QCommandLineOption fontOption(QStringLiteral("font"),
+        QStringLiteral("The font family. The system's fixed font by default."), QStringLiteral("family"));
+    const QCommandLineOption fontSizeOption(QStringLiteral("font-size"),
+        QStringLiteral("Runs with a font of <points>. 10 and 16 by default."), QStringLiteral("points"));
+    const QCommandLineOption framesOption(QStringLiteral("frames"),
+        QStringLiteral("The number of frames of each run."), QStringLiteral("count"), QStringLiteral("200"));
+    const QCommandLineOption noCountOption(QStringLiteral("no-count"),
+        QStringLiteral("Does not count the drawing calls, which renders every frame twice."));
+    parser.addOption(scenarioOption);
+    parser.addOption(gridOption);
+    parser.addOption(fontOption);
+    parser.addOption(fontSizeOption);
+    parser.addOption(framesOption);
+    parser.addOption(noCountOption);
+    parser.process(app);
+
+    Options options;
+    options.frames = qMax(1, parser.value(framesOption).toInt());
+    options.countCalls = !parser.isSet(noCountOption);
+
+    QList<Scenario> scenarios;
+    const QStringList scenarioValues = parser.isSet(scenarioOption) ? parser.values(scenarioOption) : allScenarios;
+    for (const QString &name : scenarioValues) {
+        const int index = allScenarios.indexOf(name);
+        if (index < 0) {
+            qWarning("Unknown scenario %s", qPrintable(name));
+            return 1;
+        }
+        scenarios << static_cast<Scenario>(index);
+    }
+
+    QList<QSize> grids;
+    const QStringList gridValues = parser.isSet(gridOption) ? parser.values(gridOption)
+                                                             : QStringList{ "80x24", "200x60", "300x100" };
+    for (const QString &value : gridValues) {
+        const QStringList parts = value.split(QLatin1Char('x'));
+        const QSize grid(parts.value(0).toInt(), parts.value(1).toInt());
+        if (parts.size() != 2 || grid.width() < 10 || grid.height() < 5) {
+            qWarning("Invalid grid %s", qPrintable(value));
+            return 1;
+        }
+        grids << grid;
+    }
+
+    QList<int> fontSizes;
+    const QStringList fontSizeValues = parser.isSet(fontSizeOption) ? parser.values(fontSizeOption)
+                                                                     : QStringList{ "10", "16" };
+    for (const QString &value : fontSizeValues)
+        fontSizes << qMax(4, value.toInt());
+
+    QFont baseFont = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    if (parser.isSet(fontOption))
+        baseFont.setFamily(parser.value(fontOption));
+
+    QTextStream out(stdout);
+    out << "per frame, times in microseconds" << Qt::endl;
+    out << QStringLiteral("scenario").leftJustified(11) << QStringLiteral("grid").leftJustified(9)
+        << QStringLiteral("font").rightJustified(5) << QStringLiteral("update").rightJustified(10)
+        << QStringLiteral("filters").rightJustified(10) << QStringLiteral("paint").rightJustified(10)
+        << QStringLiteral("dirty%").rightJustified(8) << QStringLiteral("calls").rightJustified(9)
+        << QStringLiteral("text").rightJustified(9) << Qt::endl;
+
+    for (Scenario scenario : std::as_const(scenarios)) {
+        for (const QSize &grid : std::as_const(grids)) {
+            for (int fontSize : std::as_const(fontSizes)) {
+                QFont font = baseFont;
+                font.setPointSize(fontSize);
+
+                Bench bench(scenario, grid, font);
+                const Result result = bench.run(options);
+                const int frames = qMax(1, result.frames);
+
+                out << QString::fromLatin1(scenarioNames[scenario]).leftJustified(11)
+                    << QStringLiteral("%1x%2").arg(grid.width()).arg(grid.height()).leftJustified(9)
+                    << QString::number(fontSize).rightJustified(5)
+                    << microseconds(result.update, frames).rightJustified(10)
+                    << microseconds(result.filters, frames).rightJustified(10)
+                    << microseconds(result.paint, frames).rightJustified(10)
+                    << QString::number(result.dirtyArea * 100 / frames, 'f', 1).rightJustified(8)
+                    << QString::number(double(result.drawCalls) / frames, 'f', 1).rightJustified(9)
+                    << QString::number(double(result.textCalls) / frames, 'f', 1).rightJustified(9)
+                    << Qt::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include "Corpus.h"
+
+#include <QFile>
+#include <QStringList>
+
+namespace {
+
+// xorshift, so that the corpora do not depend on the standard library
+class Random
+{
+public:
+    quint32 next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int bounded(int limit) { return static_cast<int>(next() % static_cast<quint32>(limit)); }
+
+    template <typename List>
+    const typename List::value_type &pick(const List &list)
+    {
+        return list.at(bounded(static_cast<int>(list.size())));
+    }
+
+private:
+    quint32 m_state = 2463534242u;
+};
+
+QByteArray number(int value, int width = 0, char fill = ' ')
+{
+    QByteArray text = QByteArray::number(value);
+    if (text.size() < width)
+        text.prepend(QByteArray(width - text.size(), fill));
+    return text;
+}
+
+QByteArray moveTo(int line, int column)
+{
+    return "\033[" + QByteArray::number(line) + ';' + QByteArray::number(column) + 'H';
+}
+
+QByteArray timestamp(Random &random, int line)
+{
+    return "2024-05-" + number(1 + line / 86400 % 28, 2, '0') + ' ' +
+           number(line / 3600 % 24, 2, '0') + ':' + number(line / 60 % 60, 2, '0') + ':' +
+           number(line % 60, 2, '0') + '.' + number(random.bounded(1000), 3, '0');
+}
+
+// `cat` of a service log
+void asciiLog(QByteArray &out, int size, int, int)
+{
+    static const QList<QByteArray> levels = { "INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR" };
+    static const QList<QByteArray> messages = {
+        "request completed status=200 path=/api/v1/sessions",
+        "cache miss for key user:profile, loading from database",
+        "connection pool exhausted, waiting for a free connection",
+        "scheduled job cleanup-temp-files finished",
+        "retrying upstream call after timeout attempt=2",
+        "accepted connection from 10.0.3.17:51234",
+    };
+
+    Random random;
+    for (int line = 0; out.size() < size; line++) {
+        out += timestamp(random, line) + ' ' + random.pick(levels) + " [worker-" +
+               QByteArray::number(random.bounded(16)) + "] " + random.pick(messages) +
+               " id=" + QByteArray::number(random.next(), 16) + " took=" +
+               QByteArray::number(random.bounded(5000)) + "ms\r\n";
+    }
+}
+
+// `cat` of a log with Chinese, Japanese and Korean messages
+void cjkLog(QByteArray &out, int size, int, int)
+{
+    static const QList<QByteArray> messages = {
+        QStringLiteral("连接已建立，开始同步数据").toUtf8(),
+        QStringLiteral("请求处理完成，耗时较长，请检查数据库索引").toUtf8(),
+        QStringLiteral("用户登录成功：张三（管理员）").toUtf8(),
+        QStringLiteral("ファイルを読み込みました：設定.yaml").toUtf8(),
+        QStringLiteral("キャッシュの有効期限が切れました").toUtf8(),
+        QStringLiteral("서버가 시작되었습니다 포트 8080").toUtf8(),
+        QStringLiteral("디스크 공간이 부족합니다").toUtf8(),
+    };
+
+    Random random;
+    for (int line = 0; out.size() < size; line++) {
+        out += timestamp(random, line) + QStringLiteral(" 信息 ").toUtf8() +
+               random.pick(messages) + " #" + QByteArray::number(random.bounded(100000)) + "\r\n";
+    }
+}
+
+// `ls --color` of large directories
+void lsColor(QByteArray &out, int size, int columns, int)
+{
+    struct Kind { QByteArray color; QByteArray suffix; };
+    static const QList<Kind> kinds = {
+        { "", ".txt" }, { "", ".cpp" }, { "", ".h" }, { "01;34", "" },
+        { "01;32", ".sh" }, { "01;36", ".so" }, { "01;31", ".tar.gz" }, { "01;35", ".png" },
+    };
+    static const QList<QByteArray> stems = {
+        "alpha", "build", "config", "data", "history_index", "main", "readme", "screen_window",
+        "terminal", "utf8proc_data", "vt102", "x",
+    };
+    const int width = 24;
+    const int perLine = qMax(1, columns / width);
+
+    Random random;
+    while (out.size() < size) {
+        for (int i = 0; i < perLine; i++) {
+            const Kind &kind = random.pick(kinds);
+            const QByteArray name = random.pick(stems) + '_' +
+                                    QByteArray::number(random.bounded(1000)) + kind.suffix;
+            if (kind.color.isEmpty())
+                out += name;
+            else
+                out += "\033[0m\033[" + kind.color + 'm' + name + "\033[0m";
+            if (i + 1 < perLine)
+                out += QByteArray(qMax(1, width - static_cast<int>(name.size())), ' ');
+        }
+        out += "\r\n";
+    }
+}
+
+// a full screen editor scrolling through a source file with syntax highlighting
+void vimRedraw(QByteArray &out, int size, int columns, int lines)
+{
+    static const QList<QByteArray> keywords = { "int", "return", "const", "void", "if", "for" };
+    static const QList<QByteArray> words = {
+        "count", "_screen", "line", "=", "+", "(", ")", "{", "}", ";", "image", "->", "size",
+    };
+
+    Random random;
+    out += "\033[?1049h\033[?1h\033=";
+    for (int top = 1; out.size() < size; top++) {
+        out += "\033[?25l\033[H";
+        for (int line = 1; line < lines - 1; line++) {
+            out += moveTo(line, 1) + "\033[33m" + number(top + line, 4) + " \033[m";
+            int column = 5 + random.bounded(4) * 4;
+            out += QByteArray(column - 5, ' ');
+            while (column < columns - 12) {
+                if (random.bounded(5) == 0) {
+                    const QByteArray &word = random.pick(keywords);
+                    out += "\033[38;5;130m" + word + "\033[m ";
+                    column += word.size() + 1;
+                } else if (random.bounded(8) == 0) {
+                    out += "\033[35m\"text\"\033[m ";
+                    column += 7;
+                } else {
+                    const QByteArray &word = random.pick(words);
+                    out += word + ' ';
+                    column += word.size() + 1;
+                }
+                if (random.bounded(6) == 0)
+                    break;
+            }
+            out += "\033[K";
+        }
+        out += moveTo(lines - 1, 1) + "\033[7mScreen.cpp [+]" +
+               QByteArray(qMax(1, columns - 30), ' ') + number(top, 5) + ",1    " +
+               number(top * 100 / 5000, 2) + "%\033[m";
+        out += moveTo(lines, 1) + "\033[K" + moveTo(lines / 2, 10) + "\033[?25h";
+    }
+    out += "\033[?1049l";
+}
+
+// a process monitor updating its meters and process list
+void htop(QByteArray &out, int size, int columns, int lines)
+{
+    static const QList<QByteArray> users = { "root", "www-data", "postgres", "me" };
+    static const QList<QByteArray> commands = {
+        "/usr/bin/python3 manage.py runserver", "postgres: writer process", "/usr/sbin/sshd -D",
+        "htop", "/usr/lib/firefox/firefox -contentproc", "kworker/3:1-events",
+    };
+    const int barWidth = qMax(10, columns / 2 - 12);
+
+    Random random;
+    out += "\033[?1049h\033[H\033[2J";
+    while (out.size() < size) {
+        // the meters
+        for (int cpu = 0; cpu < 4; cpu++) {
+            const int user = random.bounded(barWidth / 2);
+            const int system = random.bounded(barWidth / 4);
+            out += moveTo(cpu + 1, 1) + "\033[36m" + number(cpu + 1, 3) + "\033[1;30m[" +
+                   "\033[32m" + QByteArray(user, '|') + "\033[31m" + QByteArray(system, '|') +
+                   QByteArray(barWidth - user - system, ' ') + "\033[1;30m" +
+                   number((user + system) * 1000 / barWidth / 10, 3) + ".0%]\033[m";
+        }
+
+        // the process list, with the selected process highlighted
+        out += moveTo(6, 1) + "\033[30;42m    PID USER      PRI  NI  VIRT   RES S CPU% MEM%   TIME+  Command" +
+               QByteArray(qMax(0, columns - 66), ' ') + "\033[m";
+        const int selected = random.bounded(qMax(1, lines - 7));
+        for (int row = 0; row < lines - 7; row++) {
+            out += moveTo(row + 7, 1);
+            if (row == selected)
+                out += "\033[30;46m";
+            out += number(1000 + row * 37, 7) + ' ' + random.pick(users).leftJustified(9) +
+                   "  20   0 " + number(random.bounded(9999), 5) + "M " +
+                   number(random.bounded(999), 4) + "M \033[32mR\033[m" +
+                   (row == selected ? "\033[30;46m " : " ") +
+                   number(random.bounded(100), 4) + ' ' + number(random.bounded(100), 4) + "  0:" +
+                   number(random.bounded(60), 2, '0') + ".00  " + random.pick(commands) + "\033[K\033[m";
+        }
+    }
+    out += "\033[?1049l";
+}
+
+// 24-bit color gradients, one SGR sequence per character
+void trueColor(QByteArray &out, int size, int columns, int)
+{
+    for (int line = 0; out.size() < size; line++) {
+        for (int column = 0; column < columns; column++) {
+            const int red = (column * 255) / qMax(1, columns - 1);
+            const int green = (line * 7) % 256;
+            const int blue = 255 - red;
+            out += "\033[38;2;" + QByteArray::number(red) + ';' + QByteArray::number(green) + ';' +
+                   QByteArray::number(blue) + ";48;2;" + QByteArray::number(blue) + ';' +
+                   QByteArray::number(red) + ';' + QByteArray::number(green) + 'm' +
+                   char('a' + column % 26);
+        }
+        out += "\033[0m\r\n";
+    }
+}
+
+// chat style text with emoji, ZWJ sequences, flags and combining marks
+void emoji(QByteArray &out, int size, int, int)
+{
+    static const QList<QByteArray> pieces = {
+        "hello ", "ok ", "done ", "see you ",
+        QStringLiteral("😀 ").toUtf8(),
+        QStringLiteral("👍🏽 ").toUtf8(),
+        QStringLiteral("👨‍👩‍👧‍👦 ").toUtf8(),
+        QStringLiteral("🧑‍💻 ").toUtf8(),
+        QStringLiteral("🏳️‍🌈 ").toUtf8(),
+        QStringLiteral("🇩🇪🇯🇵 ").toUtf8(),
+        QStringLiteral("❤️ ").toUtf8(),
+        QStringLiteral("café naïve ").toUtf8(),
+        QStringLiteral("e\u0323\u0301 ").toUtf8(),
+    };
+
+    Random random;
+    while (out.size() < size) {
+        const int count = 4 + random.bounded(12);
+        for (int i = 0; i < count; i++)
+            out += random.pick(pieces);
+        out += "\r\n";
+    }
+}
+
+typedef void (*Generator)(QByteArray &out, int size, int columns, int lines);
+
+struct Entry
+{
+    const char *name;
+    Generator generator;
+};
+
+const Entry entries[] = {
+    { "ascii-log", asciiLog },
+    { "cjk-log", cjkLog },
+    { "ls-color", lsColor },
+    { "vim-redraw", vimRedraw },
+    { "htop", htop },
+    { "truecolor", trueColor },
+    { "emoji", emoji },
+};
+
+}
+
+QStringList Corpora::names()
+{
+    QStringList list;
+    for (const Entry &entry : entries)
+        list << QString::fromLatin1(entry.name);
+    return list;
+}
+
+Corpus Corpora::generate(const QString &name, int size, int columns, int lines)
+{
+    Corpus corpus;
+    for (const Entry &entry : entries) {
+        if (name == QLatin1String(entry.name)) {
+            corpus.name = name;
+            corpus.data.reserve(size + 64 * 1024);
+            entry.generator(corpus.data, size, columns, lines);
+        }
+    }
+    return corpus;
+}
+
+Corpus Corpora::load(const QString &fileName)
+{
+    Corpus corpus;
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+        corpus.name = fileName;
+        corpus.data = file.readAll();
+    }
+    return corpus;
+}
@@ -0,0 +1,43 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/**
+ * A byte stream, as a terminal program writes it to the pty, which the
+ * benchmark feeds to the emulation.
+ */
+struct Corpus
+{
+    QString name;
+    QByteArray data;
+};
+
+/**
+ * Generators for the built-in corpora.  They reproduce the kinds of output
+ * which dominate real sessions, such as logs, colored directory listings and
+ * full screen redraws.  The output is the same on every run, so that the
+ * results of two builds can be compared.
+ */
+namespace Corpora
+{
+    /** Returns the names of the built-in corpora. */
+    QStringList names();
+
+    /**
+     * Generates the built-in corpus @p name for a @p columns x @p lines
+     * terminal, with at least @p size bytes.  Returns an empty corpus if
+     * there is no corpus with this name.
+     */
+    Corpus generate(const QString &name, int size, int columns, int lines);
+
+    /**
+     * Loads a recorded corpus from @p fileName, for example the output of
+     * script(1).  Returns an empty corpus if the file cannot be read.
+     */
+    Corpus load(const QString &fileName);
+}
+
+#endif // CORPUS_H
@@ -0,0 +1,298 @@
+/*
+    Measures how fast the emulation processes terminal output.
+
+    Every corpus is fed to Emulation::receiveData() in chunks of the size a
+    pty read returns, once headless and, with --display, once more with a
+    TerminalDisplay which renders every frame into an offscreen QImage.  The
+    fastest of --repeat runs is reported, with the number of heap
+    allocations made during that run.
+
+    Run it from a release build, for example:
+
+        vtbench --display
+        vtbench --corpus vim-redraw --corpus emoji --size 32
+        vtbench --file session.typescript
+*/
+
+#include <cstdlib>
+
+#include <atomic>
+#include <new>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QImage>
+#include <QTextStream>
+
+#include "Corpus.h"
+#include "History.h"
+#include "ScreenWindow.h"
+#include "TerminalDisplay.h"
+#include "Vt102Emulation.h"
+
+namespace {
+
+std::atomic<quint64> allocations{0};
+
+}
+
+// count every heap allocation.  With glibc, malloc itself is replaced, which
+// also covers the containers of Qt; elsewhere only operator new is counted.
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+#else
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+#endif
+
+namespace {
+
+struct Options
+{
+    int columns = 120;
+    int lines = 40;
+    int chunkSize = 4096;           // the size of a pty read
+    int frameSize = 64 * 1024;      // the output received between two frames
+    int repeat = 3;
+    int fontSize = 10;
+};
+
+struct Result
+{
+    qint64 nanoseconds = 0;
+    quint64 allocations = 0;
+    quint64 frames = 0;
+};
+
+void setUp(Vt102Emulation &emulation, const Options &options)
+{
+    emulation.setCodec(QStringEncoder{QStringConverter::Encoding::Utf8});
+    emulation.setHistory(HistoryTypeBuffer(1000));
+    emulation.setImageSize(options.lines, options.columns);
+}
+
+Result runHeadless(const QByteArray &data, const Options &options)
+{
+    Vt102Emulation emulation;
+    setUp(emulation, options);
+
+    Result result;
+    const quint64 allocationsBefore = allocations.load();
+    QElapsedTimer timer;
+    timer.start();
+
+    for (qsizetype offset = 0; offset < data.size(); offset += options.chunkSize) {
+        const int length = static_cast<int>(qMin<qsizetype>(options.chunkSize, data.size() - offset));
+        emulation.receiveData(data.constData() + offset, length);
+    }
+
+    result.nanoseconds = timer.nsecsElapsed();
+    result.allocations = allocations.load() - allocationsBefore;
+    return result;
+}
+
+Result runWithDisplay(const QByteArray &data, const Options &options)
+{
+    Vt102Emulation emulation;
+    setUp(emulation, options);
+
+    // every frame is sent as soon as the event loop runs
+    emulation.setFramePacing(Emulation::AdaptiveFramePacing);
+    emulation.setFrameInterval(0);
+
+    QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    font.setPointSize(options.fontSize);
+
+    TerminalDisplay display;
+    display.setVTFont(font);
+    display.setScreenWindow(emulation.createWindow());
+    display.setSize(options.columns, options.lines);
+    display.resize(display.sizeHint());
+
+    // rendering the hidden display delivers its resize event
+    QImage image(display.size(), QImage::Format_ARGB32_Premultiplied);
+    display.render(&image);
+    emulation.setImageSize(display.lines(), display.columns());
+    QApplication::processEvents();
+    emulation.resetFrameStatistics();
+
+    Result result;
+    const quint64 allocationsBefore = allocations.load();
+    QElapsedTimer timer;
+    timer.start();
+
+    int sinceFrame = 0;
+    for (qsizetype offset = 0; offset < data.size(); offset += options.chunkSize) {
+        const int length = static_cast<int>(qMin<qsizetype>(options.chunkSize, data.size() - offset));
+        emulation.receiveData(data.constData() + offset, length);
+
+        sinceFrame += length;
+        if (sinceFrame >= options.frameSize || offset + length == data.size()) {
+            sinceFrame = 0;
+            QApplication::processEvents();
+            display.render(&image);
+        }
+    }
+
+    result.nanoseconds = timer.nsecsElapsed();
+    result.allocations = allocations.load() - allocationsBefore;
+    result.frames = emulation.frameStatistics().frames;
+    return result;
+}
+
+template <typename Run>
+Result fastest(Run run, const QByteArray &data, const Options &options)
+{
+    Result best;
+    for (int i = 0; i < options.repeat; i++) {
+        const Result result = run(data, options);
+        if (i == 0 || result.nanoseconds < best.nanoseconds)
+            best = result;
+    }
+    return best;
+}
+
+void report(QTextStream &out, const QString &corpus, const QString &mode,
+            const QByteArray &data, const Result &result)
+{
+    const double bytes = qMax<qsizetype>(1, data.size());
+    const double seconds = qMax<qint64>(1, result.nanoseconds) / 1e9;
+
+    out << corpus.leftJustified(24) << mode.leftJustified(9)
+        << QString::number(bytes / (1024 * 1024), 'f', 1).rightJustified(8)
+        << QString::number(bytes / seconds / 1e6, 'f', 1).rightJustified(10)
+        << QString::number(result.nanoseconds / bytes, 'f', 2).rightJustified(10)
+        << QString::number(result.allocations).rightJustified(12)
+        << QString::number(result.allocations * 1024 / bytes, 'f', 2).rightJustified(12)
+        << QString::number(result.frames).rightJustified(8) << Qt::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measures the throughput of the terminal emulation."));
+    parser.addHelpOption();
+    const QCommandLineOption corpusOption(QStringLiteral("corpus"),
+        QStringLiteral("Runs the built-in corpus <name>: %1. All by default.")
+            .arg(Corpora::names().join(QLatin1String(", "))), QStringLiteral("name"));
+    const QCommandLineOption fileOption(QStringLiteral("file"),
+        QStringLiteral("Runs a recorded corpus, such as the output of script(1)."), QStringLiteral("path"));
+    const QCommandLineOption sizeOption(QStringLiteral("size"),
+        QStringLiteral("The size of the built-in corpora in MiB."), QStringLiteral("MiB"), QStringLiteral("8"));
+    const QCommandLineOption columnsOption(QStringLiteral("columns"),
+        QStringLiteral("The width of the terminal."), QStringLiteral("columns"), QStringLiteral("120"));
+    const QCommandLineOption linesOption(QStringLiteral("lines"),
+        QStringLiteral("The height of the terminal."), QStringLiteral("lines"), QStringLiteral("40"));
+    const QCommandLineOption chunkOption(QStringLiteral("chunk"),
+        QStringLiteral("The number of bytes passed to each receiveData() call."), QStringLiteral("bytes"), QStringLiteral("4096"));
+    const QCommandLineOption frameOption(QStringLiteral("frame"),
+        QStringLiteral("The number of bytes received between two rendered frames."), QStringLiteral("bytes"), QStringLiteral("65536"));
+    const QCommandLineOption repeatOption(QStringLiteral("repeat"),
+        QStringLiteral("The number of runs, of which the fastest is reported."), QStringLiteral("count"), QStringLiteral("3"));
+    const QCommandLineOption displayOption(QStringLiteral("display"),
+        QStringLiteral("Also runs every corpus with a display rendering offscreen."));
+    parser.addOption(corpusOption);
+    parser.addOption(fileOption);
+    parser.addOption(sizeOption);
+    parser.addOption(columnsOption);
+    parser.addOption(linesOption);
+    parser.addOption(chunkOption);
+    parser.addOption(frameOption);
+    parser.addOption(repeatOption);
+    parser.addOption(displayOption);
+    parser.process(app);
+
+    Options options;
+    options.columns = qMax(10, parser.value(columnsOption).toInt());
+    options.lines = qMax(5, parser.value(linesOption).toInt());
+    options.chunkSize = qMax(1, parser.value(chunkOption).toInt());
+    options.frameSize = qMax(1, parser.value(frameOption).toInt());
+    options.repeat = qMax(1, parser.value(repeatOption).toInt());
+    const int size = qMax(1, parser.value(sizeOption).toInt()) * 1024 * 1024;
+
+    QList<Corpus> corpora;
+    QStringList names = parser.values(corpusOption);
+    if (names.isEmpty() && !parser.isSet(fileOption))
+        names = Corpora::names();
+    for (const QString &name : std::as_const(names)) {
+        const Corpus corpus = Corpora::generate(name, size, options.columns, options.lines);
+        if (corpus.data.isEmpty()) {
+            qWarning("Unknown corpus %s", qPrintable(name));
+            return 1;
+        }
+        corpora << corpus;
+    }
+    const QStringList files = parser.values(fileOption);
+    for (const QString &fileName : files) {
+        const Corpus corpus = Corpora::load(fileName);
+        if (corpus.data.isEmpty()) {
+            qWarning("Cannot read %s", qPrintable(fileName));
+            return 1;
+        }
+        corpora << corpus;
+    }
+
+    QTextStream out(stdout);
+    out << QStringLiteral("corpus").leftJustified(24) << QStringLiteral("mode").leftJustified(9)
+        << QStringLiteral("MiB").rightJustified(8) << QStringLiteral("MB/s").rightJustified(10)
+        << QStringLiteral("ns/byte").rightJustified(10) << QStringLiteral("allocs").rightJustified(12)
+        << QStringLiteral("allocs/KiB").rightJustified(12) << QStringLiteral("frames").rightJustified(8)
+        << Qt::endl;
+
+    for (const Corpus &corpus : std::as_const(corpora)) {
+        report(out, corpus.name, QStringLiteral("headless"), corpus.data,
+               fastest(runHeadless, corpus.data, options));
+        if (parser.isSet(displayOption)) {
+            report(out, corpus.name, QStringLiteral("display"), corpus.data,
+                   fastest(runWithDisplay, corpus.data, options));
+        }
+    }
+
+    return 0;
+}
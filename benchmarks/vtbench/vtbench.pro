@@ -0,0 +1,14 @@
+TARGET = vtbench
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+QT += core gui widgets network xml multimedia
+
+include(../../lib/qtermwidget.pri)
+
+SOURCES += \
+    $$PWD/Corpus.cpp \
+    $$PWD/main.cpp
+
+HEADERS += \
+    $$PWD/Corpus.h
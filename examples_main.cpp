@@ -82,14 +82,14 @@ int main(int argc, char *argv[])
     QObject::connect(localShell->notifier(), &QIODevice::readyRead, [=](){
         QByteArray data = localShell->readAll();
         if (!data.isEmpty()) {
-            console->recvData(data.data(), data.size());
+            console->recvData(data.constData(), data.size());
         }
     });
     QObject::connect(localShell->notifier(), &QIODevice::aboutToClose, [=](){
         if (localShell) {
             QByteArray restOfOutput = localShell->readAll();
             if (!restOfOutput.isEmpty()) {
-                console->recvData(restOfOutput.data(), restOfOutput.size());
+                console->recvData(restOfOutput.constData(), restOfOutput.size());
                 localShell->notifier()->disconnect();
             }
         }
@@ -97,6 +97,10 @@ int main(int argc, char *argv[])
     QObject::connect(console, &QTermWidget::sendData, [=](const char *data, int size){
         localShell->write(QByteArray(data, size));
     });
+    console->setInputBacklog([=]() { return localShell->bytesToWrite(); });
+    QObject::connect(console, &QTermWidget::receiveQueueFull, [=](bool full){
+        localShell->setReadingPaused(full);
+    });
 
     mainWindow->setCentralWidget(console);
     mainWindow->resize(600, 400);
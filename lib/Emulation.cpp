@@ -24,8 +24,6 @@
 #include <cstdlib>
 #include <string>
 
-#include <QApplication>
-#include <QClipboard>
 #include <QHash>
 #include <QKeyEvent>
 #include <QTextStream>
@@ -35,8 +33,10 @@
 #include "KeyboardTranslator.h"
 #include "Screen.h"
 #include "ScreenWindow.h"
+#include "SessionRecorder.h"
+#include "SpscRingBuffer.h"
 #include "TerminalCharacterDecoder.h"
-#include "TerminalDisplay.h"
+#include "TraceRecorder.h"
 
 Emulation::Emulation()
     : _currentScreen(nullptr)
@@ -52,6 +52,12 @@ Emulation::Emulation()
 
     connect(&_bulkTimer1, &QTimer::timeout, this, &Emulation::showBulk);
     connect(&_bulkTimer2, &QTimer::timeout, this, &Emulation::showBulk);
+    _sinceFrame.start();
+
+    // the echo of a key press is sent to the views without delay, see
+    // bufferedUpdate()
+    connect(this, &Emulation::outputFromKeypressEvent, this,
+            [this] { _keyPressedSinceFrame = true; });
 
     // listen for mouse status changes
     connect(this, &Emulation::programUsesMouseChanged, this,
@@ -86,9 +92,10 @@ void Emulation::bracketedPasteModeChanged(bool bracketedPasteMode) {
 
 ScreenWindow *Emulation::createWindow() {
     ScreenWindow *window = new ScreenWindow();
+    window->setStateLock(&_stateLock);
     window->setScreen(_currentScreen);
     _windows << window;
-    ExtendedCharTable::instance.windows << window;
+    ExtendedCharTable::instance.addWindow(window);
 
     connect(window, &ScreenWindow::selectionChanged, this, &Emulation::bufferedUpdate);
     connect(this, &Emulation::outputChanged, window, &ScreenWindow::notifyOutputChanged);
@@ -104,22 +111,26 @@ void Emulation::checkScreenInUse() {
 }
 
 Emulation::~Emulation() {
+    setThreadedEnabled(false);
+
     QListIterator<ScreenWindow *> windowIter(_windows);
 
     while (windowIter.hasNext()) {
         auto win = windowIter.next();
-        ExtendedCharTable::instance.windows.remove(win);
+        ExtendedCharTable::instance.removeWindow(win);
         delete win;
     }
 
     delete _screen[0];
     delete _screen[1];
+    TERMINAL_TRACE_REMOVE(this);
 }
 
 void Emulation::setScreen(int n) {
     Screen *old = _currentScreen;
     _currentScreen = _screen[n & 1];
     if (_currentScreen != old) {
+        _screenSwitches++;
         // tell all windows onto this emulation to switch to the newly active screen
         for (ScreenWindow *window : std::as_const(_windows))
             window->setScreen(_currentScreen);
@@ -128,10 +139,12 @@ void Emulation::setScreen(int n) {
 }
 
 void Emulation::clearHistory() {
+    QMutexLocker locker(&_stateLock);
     _screen[0]->setScroll(_screen[0]->getScroll(), false);
 }
 
 void Emulation::setHistory(const HistoryType &t) {
+    QMutexLocker locker(&_stateLock);
     _screen[0]->setScroll(t);
 
     showBulk();
@@ -142,6 +155,7 @@ const HistoryType &Emulation::history() const {
 }
 
 void Emulation::setCodec(QStringEncoder qtc) {
+    QMutexLocker locker(&_stateLock);
     if (qtc.isValid())
         _fromUtf16 = std::move(qtc);
     else
@@ -223,10 +237,37 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/,
    We are doing code conversion from locale to unicode first.
    TODO: Character composition from the old code.  See #96536
 */
+void Emulation::receiveChars(const wchar_t *chars, int count) {
+    for (int i = 0; i < count; i++)
+        receiveChar(chars[i]);
+}
+
 void Emulation::receiveData(const char *text, int length) {
+    // recorded as it arrives, before the parser thread gets to it
+    if (SessionRecorder *recorder = _recorder)
+        recorder->recordOutput(text, length);
+
+    if (_parserThread) {
+        queueData(text, length);
+        return;
+    }
+
     emit stateSet(NOTIFYACTIVITY);
 
+    {
+        // searches and exports read the screens on worker threads
+        QMutexLocker locker(&_stateLock);
+        processData(text, length);
+    }
+
     bufferedUpdate();
+}
+
+void Emulation::processData(const char *text, int length) {
+    TERMINAL_TRACE(trace, "processData", this);
+    TERMINAL_STATISTIC(trace.setArg("bytes", length));
+    TERMINAL_STATISTIC(_statistics.bytesReceived += length);
+    _bytesSinceFrame += length;
 
     /* XXX: the following code involves encoding & decoding of "UTF-16
     * surrogate pairs", which does not work with characters higher than
@@ -234,11 +275,18 @@ void Emulation::receiveData(const char *text, int length) {
     * https://unicodebook.readthedocs.io/unicode_encodings.html#surrogates
     */
     QString utf16Text = _toUtf16(QByteArray::fromRawData(text, length));
-    std::wstring unicodeText = utf16Text.toStdWString();
+
+    // toWCharArray() never produces more characters than there are UTF-16
+    // code units, so the buffer only has to grow for unusually large chunks
+    if (_receiveBuffer.size() < utf16Text.size())
+        _receiveBuffer.resize(utf16Text.size());
+    int count = utf16Text.toWCharArray(_receiveBuffer.data());
 
     // send characters to terminal emulator
-    for (wchar_t i : unicodeText)
-        receiveChar(i);
+    receiveChars(_receiveBuffer.constData(), count);
+
+    if (_outputTapEnabled)
+        flushOutputTap();
 
     // look for z-modem indicator
     //-- someone who understands more about z-modems that I do may be able to move
@@ -257,34 +305,211 @@ void Emulation::receiveData(const char *text, int length) {
     }
 }
 
-void Emulation::dupDisplayCharacter(wchar_t cc) {
-    if (cc == L'\n') {
-        dupCache.append(L'\n');
-        PlainTextDecoder decoder;
-        QString lineText;
-        QTextStream stream(&lineText);
-        decoder.begin(&stream);
-        Character *data = new Character[dupCache.size()];
-        for (int j = 0; j < dupCache.size(); j++) {
-            data[j] = Character(dupCache.at(j));
+void Emulation::setThreadedEnabled(bool enabled) {
+    if (enabled == (_parserThread != nullptr))
+        return;
+
+    if (enabled) {
+        _receiveQueue = new SpscRingBuffer(1024 * 1024);
+        _receiveChunk.resize(16 * 1024);
+        _stopParser = false;
+        _parserThread = QThread::create([this] { runParserThread(); });
+        _parserThread->setObjectName(QLatin1String("TerminalParser"));
+        _parserThread->start();
+    } else {
+        _stopParser = true;
+        _receiveSignal.release();
+        _parserThread->wait();
+        delete _parserThread;
+        _parserThread = nullptr;
+
+        // nothing is queued from now on
+        _receiveQueueFull = false;
+        reportReceiveQueue();
+
+        // the parser thread drains the queue before it stops, this only
+        // catches bytes which raced with the stop request
+        if (processQueuedData())
+            bufferedUpdate();
+
+        delete _receiveQueue;
+        _receiveQueue = nullptr;
+        _receiveSignal.acquire(_receiveSignal.available());
+    }
+}
+
+bool Emulation::inParserThread() const {
+    return _parserThread && QThread::currentThread() == _parserThread;
+}
+
+void Emulation::queueData(const char *text, int length) {
+    // past this the reader is asked to stop, see receiveQueueFull()
+    const int highMark = _receiveQueue->capacity() / 4 * 3;
+
+    while (length > 0) {
+        const int written = _receiveQueue->write(text, length);
+        text += written;
+        length -= written;
+
+        if (length > 0) {
+            // the parser thread has fallen behind a full queue; process the
+            // queued output here rather than waiting, which keeps the order
+            // of the output and cannot deadlock if the caller holds the lock
+            if (processQueuedData()) {
+                emit stateSet(NOTIFYACTIVITY);
+                bufferedUpdate();
+            }
+        }
+    }
+
+    // set before the parser thread is woken up, which clears it again once
+    // the queue has drained
+    if (!_receiveQueueFull && _receiveQueue->size() > highMark) {
+        _receiveQueueFull = true;
+        reportReceiveQueue();
+    }
+
+    _receiveSignal.release();
+}
+
+bool Emulation::processQueuedData() {
+    bool processed = false;
+    for (;;) {
+        QMutexLocker locker(&_stateLock);
+        const int count = _receiveQueue->read(_receiveChunk.data(), _receiveChunk.size());
+        if (count == 0)
+            return processed;
+
+        processData(_receiveChunk.constData(), count);
+        processed = true;
+    }
+}
+
+void Emulation::runParserThread() {
+    for (;;) {
+        _receiveSignal.acquire();
+        // one pass drains everything queued so far
+        _receiveSignal.tryAcquire(_receiveSignal.available());
+
+        if (processQueuedData()) {
+            emit stateSet(NOTIFYACTIVITY);
+            bufferedUpdate();
+        }
+
+        if (_receiveQueueFull && _receiveQueue->size() < _receiveQueue->capacity() / 4 &&
+            _receiveQueueFull.exchange(false))
+            runInOwnerThread([this] { reportReceiveQueue(); });
+
+        if (_stopParser)
+            return;
+    }
+}
+
+void Emulation::reportReceiveQueue() {
+    const bool full = _receiveQueueFull;
+    if (full != _receiveQueueFullReported) {
+        _receiveQueueFullReported = full;
+        emit receiveQueueFull(full);
+    }
+}
+
+void Emulation::setOutputTapEnabled(bool enabled) {
+    QMutexLocker locker(&_stateLock);
+    _outputTapEnabled = enabled;
+    if (!enabled) {
+        _outputTap.clear();
+        _outputTapLineEnd = 0;
+    }
+}
+
+void Emulation::appendToOutputTap(const wchar_t *chars, int count) {
+    int i = 0;
+    while (i < count) {
+        if (static_cast<uint>(chars[i]) < 0x80) {
+            _outputTap.append(static_cast<char>(chars[i]));
+            if (chars[i] == L'\n')
+                _outputTapLineEnd = _outputTap.size();
+            i++;
+        } else {
+            int start = i;
+            while (i < count && static_cast<uint>(chars[i]) >= 0x80)
+                i++;
+            _outputTap.append(QString::fromWCharArray(chars + start, i - start).toUtf8());
         }
-        decoder.decodeLine(data, dupCache.size(), 0);
-        decoder.end();
-        delete[] data;
-        emit dupDisplayOutput(lineText.toUtf8().constData(),
-                            lineText.toUtf8().length());
-        dupCache.clear();
+    }
+}
+
+void Emulation::flushOutputTap() {
+    // a line without end (e.g. a progress bar) is passed on once it gets long
+    const int maxPendingLength = 64 * 1024;
+
+    if (_outputTapLineEnd == 0) {
+        if (_outputTap.size() < maxPendingLength)
+            return;
+        _outputTapLineEnd = _outputTap.size();
+    }
+
+    if (inParserThread()) {
+        const QByteArray lines = _outputTap.left(_outputTapLineEnd);
+        runInOwnerThread([this, lines] {
+            emit dupDisplayOutput(lines.constData(), lines.size());
+        });
     } else {
-        dupCache.append(cc);
+        emit dupDisplayOutput(_outputTap.constData(), _outputTapLineEnd);
     }
+
+    _outputTap.remove(0, _outputTapLineEnd);
+    _outputTapLineEnd = 0;
 }
 
 void Emulation::writeToStream(TerminalCharacterDecoder *_decoder, int startLine,
                               int endLine) {
+    QMutexLocker locker(&_stateLock);
     _currentScreen->writeLinesToStream(_decoder, startLine, endLine);
 }
 
+void Emulation::writeWholeLinesToStream(TerminalCharacterDecoder *decoder, int startLine,
+                                        int endLine) {
+    QMutexLocker locker(&_stateLock);
+    _currentScreen->writeWholeLinesToStream(decoder, startLine, endLine);
+}
+
+QVector<HistoryIndex::LineRange> Emulation::searchCandidates(const QString &text, int startLine,
+                                                             int endLine) const {
+    QMutexLocker locker(&_stateLock);
+
+    const int histLines = _currentScreen->getHistLines();
+    endLine = qMin(endLine, histLines + _currentScreen->getLines() - 1);
+
+    QVector<HistoryIndex::LineRange> ranges =
+        _currentScreen->historyIndex().candidates(text, startLine, endLine);
+
+    // the screen is not indexed.  The end of the history is searched with
+    // it, since a match there may continue on the screen
+    int screenStart = qMax(startLine, histLines - qMax(HistoryIndex::BlockLines, int(text.size())));
+    if (screenStart <= endLine) {
+        while (!ranges.isEmpty() && screenStart <= ranges.last().second + 1) {
+            screenStart = qMin(screenStart, ranges.last().first);
+            ranges.removeLast();
+        }
+        ranges.append(HistoryIndex::LineRange(screenStart, endLine));
+    }
+
+    return ranges;
+}
+
+qint64 Emulation::droppedLineCount() const {
+    QMutexLocker locker(&_stateLock);
+    return _screen[0]->droppedHistoryLines();
+}
+
+quint64 Emulation::screenSwitchCount() const {
+    QMutexLocker locker(&_stateLock);
+    return _screenSwitches;
+}
+
 int Emulation::lineCount() const {
+    QMutexLocker locker(&_stateLock);
     // sum number of lines currently on _screen plus number of lines in history
     return _currentScreen->getLines() + _currentScreen->getHistLines();
 }
@@ -293,6 +518,13 @@ void Emulation::showBulk() {
     _bulkTimer1.stop();
     _bulkTimer2.stop();
 
+    _frameStatistics.frames++;
+    _updatePending = false;
+    _keyPressedSinceFrame = false;
+    _bytesSinceFrame = 0;
+    _sinceFrame.restart();
+
+    QMutexLocker locker(&_stateLock);
     emit outputChanged();
 
     _currentScreen->resetScrolledLines();
@@ -303,6 +535,47 @@ void Emulation::bufferedUpdate() {
     static const int BULK_TIMEOUT1 = 10;
     static const int BULK_TIMEOUT2 = 40;
 
+    // the timers belong to the owner thread; the parser thread posts at most
+    // one request at a time
+    if (inParserThread()) {
+        if (!_bufferedUpdatePosted.exchange(true)) {
+            QMetaObject::invokeMethod(this, [this] {
+                _bufferedUpdatePosted = false;
+                bufferedUpdate();
+            }, Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    _frameStatistics.updateRequests++;
+
+    if (_updatesSuspended) {
+        _frameStatistics.suspendedRequests++;
+        _updatePending = true;
+        return;
+    }
+
+    if (_framePacing == AdaptiveFramePacing) {
+        // writes up to this size are assumed to be interactive
+        static const int SMALL_WRITE_SIZE = 512;
+
+        const qint64 sinceFrame = _sinceFrame.elapsed();
+        if (sinceFrame >= _frameInterval &&
+            (_keyPressedSinceFrame || _bytesSinceFrame <= SMALL_WRITE_SIZE)) {
+            _frameStatistics.immediateFrames++;
+            showBulk();
+            return;
+        }
+
+        // otherwise the update is sent at the next frame boundary, together
+        // with everything else which arrives until then
+        if (!_bulkTimer1.isActive()) {
+            _bulkTimer1.setSingleShot(true);
+            _bulkTimer1.start(qMax<qint64>(0, _frameInterval - sinceFrame));
+        }
+        return;
+    }
+
     _bulkTimer1.setSingleShot(true);
     _bulkTimer1.start(BULK_TIMEOUT1);
     if (!_bulkTimer2.isActive()) {
@@ -311,6 +584,53 @@ void Emulation::bufferedUpdate() {
     }
 }
 
+void Emulation::setFramePacing(FramePacing pacing) {
+    if (_framePacing == pacing)
+        return;
+
+    _framePacing = pacing;
+
+    // the timers of the previous policy may not fit the new one
+    if (_bulkTimer1.isActive() || _bulkTimer2.isActive())
+        showBulk();
+}
+
+void Emulation::setFrameInterval(int msec) {
+    _frameInterval = qBound(1, msec, 1000);
+}
+
+void Emulation::setUpdatesSuspended(bool suspended) {
+    if (_updatesSuspended == suspended)
+        return;
+
+    _updatesSuspended = suspended;
+
+    if (suspended) {
+        if (_bulkTimer1.isActive() || _bulkTimer2.isActive())
+            _updatePending = true;
+        _bulkTimer1.stop();
+        _bulkTimer2.stop();
+    } else if (_updatePending) {
+        showBulk();
+    }
+}
+
+TerminalStatistics Emulation::statistics() const {
+    QMutexLocker locker(&_stateLock);
+    TerminalStatistics statistics = _statistics;
+    statistics.historyLines = _screen[0]->historyLinesAdded() + _screen[1]->historyLinesAdded();
+    statistics.extendedChars = ExtendedCharTable::instance.size();
+    statistics.extendedCharCollisions = ExtendedCharTable::instance.collisions();
+    return statistics;
+}
+
+void Emulation::resetStatistics() {
+    QMutexLocker locker(&_stateLock);
+    _statistics = TerminalStatistics();
+    _screen[0]->resetHistoryLinesAdded();
+    _screen[1]->resetHistoryLinesAdded();
+}
+
 char Emulation::eraseChar() const { 
     return '\b'; 
 }
@@ -319,6 +639,8 @@ void Emulation::setImageSize(int lines, int columns) {
     if ((lines < 1) || (columns < 1))
         return;
 
+    QMutexLocker locker(&_stateLock);
+
     QSize screenSize[2] = {
         QSize(_screen[0]->getColumns(), _screen[0]->getLines()),
         QSize(_screen[1]->getColumns(), _screen[1]->getLines())};
@@ -330,12 +652,29 @@ void Emulation::setImageSize(int lines, int columns) {
     _screen[0]->resizeImage(lines, columns);
     _screen[1]->resizeImage(lines, columns);
 
+    if (SessionRecorder *recorder = _recorder)
+        recorder->recordResize(columns, lines);
+
     emit imageSizeChanged(lines, columns);
 
     bufferedUpdate();
 }
 
+void Emulation::setRecorder(SessionRecorder *recorder) {
+    disconnect(_recorderConnection);
+    _recorder = recorder;
+    if (!recorder)
+        return;
+
+    const QSize size = imageSize();
+    recorder->start(size.width(), size.height());
+    _recorderConnection = connect(this, &Emulation::sendData, this,
+                                  [recorder](const char *data, int length) { recorder->recordInput(data, length); },
+                                  Qt::DirectConnection);
+}
+
 QSize Emulation::imageSize() const {
+    QMutexLocker locker(&_stateLock);
     return {_currentScreen->getColumns(), _currentScreen->getLines()};
 }
 
@@ -364,6 +703,8 @@ bool ExtendedCharTable::extendedCharMatch(uint hash , uint* unicodePoints , usho
 }
 
 uint ExtendedCharTable::createExtendedChar(uint* unicodePoints , ushort length) {    
+    QMutexLocker locker(&lock);
+
     // look for this sequence of points in the table
     uint hash = extendedCharHash(unicodePoints,length);
     const uint initialHash = hash;
@@ -379,6 +720,7 @@ uint ExtendedCharTable::createExtendedChar(uint* unicodePoints , ushort length)
             // if hash is already used by another, different sequence of
             // unicode character points, then try next hash
             hash++;
+            TERMINAL_STATISTIC(collisionCount++);
 
             if (hash == initialHash) {
                 if (!triedCleaningSolution) {
@@ -424,6 +766,7 @@ uint ExtendedCharTable::createExtendedChar(uint* unicodePoints , ushort length)
 uint* ExtendedCharTable::lookupExtendedChar(uint hash , ushort& length) const {
     // lookup index in table and if found, set the length
     // argument and return a pointer to the character sequence
+    QMutexLocker locker(&lock);
     uint* buffer = extendedCharTable[hash];
     if (buffer) {
         length = buffer[0];
@@ -434,6 +777,26 @@ uint* ExtendedCharTable::lookupExtendedChar(uint hash , ushort& length) const {
     }
 }
 
+int ExtendedCharTable::size() const {
+    QMutexLocker locker(&lock);
+    return extendedCharTable.size();
+}
+
+quint64 ExtendedCharTable::collisions() const {
+    QMutexLocker locker(&lock);
+    return collisionCount;
+}
+
+void ExtendedCharTable::addWindow(ScreenWindow *window) {
+    QMutexLocker locker(&lock);
+    windows << window;
+}
+
+void ExtendedCharTable::removeWindow(ScreenWindow *window) {
+    QMutexLocker locker(&lock);
+    windows.remove(window);
+}
+
 ExtendedCharTable::ExtendedCharTable() {
 }
 
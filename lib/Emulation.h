@@ -22,20 +22,31 @@
 #ifndef EMULATION_H
 #define EMULATION_H
 
+#include <atomic>
 #include <cstdio>
 
+#include <QElapsedTimer>
 #include <QKeyEvent>
+#include <QRecursiveMutex>
+#include <QSemaphore>
 #include <QStringDecoder>
 #include <QTextStream>
 #include <QTimer>
+#include <QVector>
 #include <QStringEncoder>
 
+#include "HistoryIndex.h"
 #include "KeyboardTranslator.h"
+#include "TerminalStatistics.h"
 
 class HistoryType;
+class QThread;
 class Screen;
 class ScreenWindow;
+class SessionRecorder;
+class SpscRingBuffer;
 class TerminalCharacterDecoder;
+class TerminalClipboard;
 
 /**
  * This enum describes the available states which
@@ -147,6 +158,13 @@ public:
      */
     ScreenWindow* createWindow();
 
+    /**
+     * Returns the primary screen, which keeps the history and stays below
+     * the alternate screen while that is in use.  Screen windows show the
+     * screen in use.  See stateLock()
+     */
+    Screen* primaryScreen() const { return _screen[0]; }
+
     /** Returns the size of the screen image which the emulation produces */
     QSize imageSize() const;
 
@@ -181,6 +199,38 @@ public:
      * @param endLine Index of last line to copy
      */
     virtual void writeToStream(TerminalCharacterDecoder* decoder,int startLine,int endLine);
+
+    /**
+     * Copies whole lines from @p startLine to @p endLine into a stream, each
+     * ending with a line break unless it wraps into the next one, so that a
+     * long output can be copied in consecutive ranges.  See
+     * Screen::writeWholeLinesToStream().
+     */
+    void writeWholeLinesToStream(TerminalCharacterDecoder* decoder,int startLine,int endLine);
+
+    /**
+     * Returns the ranges of lines, from @p startLine to @p endLine, which can
+     * contain @p text, in ascending order.  Lines of the history which
+     * certainly do not contain it are left out, see HistoryIndex, which is
+     * built by the first call.  Lines of the screen are always included.
+     *
+     * Line numbers are those used by writeToStream().
+     */
+    QVector<HistoryIndex::LineRange> searchCandidates(const QString& text,int startLine,int endLine) const;
+
+    /**
+     * Returns the number of lines which have been dropped from the front of
+     * the history of the primary screen, because it was full, made smaller
+     * or cleared.  The count only grows.  Line numbers decrease by one for
+     * every dropped line, as long as the same screen is in use; see
+     * screenSwitchCount().
+     */
+    qint64 droppedLineCount() const;
+    /**
+     * Returns the number of times the emulation has switched between the
+     * primary and the alternate screen, which renumbers all lines.
+     */
+    quint64 screenSwitchCount() const;
         
     /** Returns the codec used to decode incoming characters.  See setCodec() */
     const QStringEncoder &codec() const { return _fromUtf16; }
@@ -209,6 +259,26 @@ public:
      */
     QString keyBindings() const;
 
+    /**
+     * Sets the clipboard which terminal programs write to with the OSC 52
+     * escape sequence.  The emulation does not take ownership of
+     * @p clipboard.  Without a clipboard, which is the default, such
+     * requests are ignored.
+     */
+    void setClipboard(TerminalClipboard* clipboard) { _clipboard = clipboard; }
+    /** Returns the clipboard set with setClipboard() */
+    TerminalClipboard* clipboard() const { return _clipboard; }
+
+    /**
+     * Records the output the emulation receives, the input it sends and
+     * the changes of its size with @p recorder, which is started with the
+     * current size.  The emulation does not take ownership of @p recorder.
+     * Passing nullptr stops recording.
+     */
+    void setRecorder(SessionRecorder* recorder);
+    /** Returns the recorder set with setRecorder() */
+    SessionRecorder* recorder() const { return _recorder; }
+
     /**
      * Copies the current image into the history and clears the screen.
      */
@@ -230,6 +300,64 @@ public:
 
     void setEnableHandleCtrlC(bool enable) { _enableHandleCtrlC = enable; }
 
+    /**
+     * This enum describes when the outputChanged() signal is emitted after
+     * new output has been received.  See setFramePacing()
+     */
+    enum FramePacing {
+        /**
+         * Updates are sent 10 ms after the output stops, and at least every
+         * 40 ms while it continues.
+         */
+        FixedFramePacing,
+        /**
+         * An update is sent at once for small writes, such as the echo of a
+         * key press, when no update was sent during the last frame interval.
+         * Sustained output is coalesced into one update per frame interval.
+         * See setFrameInterval()
+         */
+        AdaptiveFramePacing
+    };
+
+    /** Sets the policy used to schedule updates.  Defaults to FixedFramePacing. */
+    void setFramePacing(FramePacing pacing);
+    /** Returns the policy used to schedule updates.  See setFramePacing() */
+    FramePacing framePacing() const { return _framePacing; }
+
+    /**
+     * Sets the shortest interval between two updates with AdaptiveFramePacing,
+     * normally the refresh interval of the display.  Defaults to 16 ms.
+     */
+    void setFrameInterval(int msec);
+    int frameInterval() const { return _frameInterval; }
+
+    /**
+     * Suspends or resumes updates, for example while all views are hidden.
+     * Output is still processed while updates are suspended; a single update
+     * is sent when they are resumed.
+     */
+    void setUpdatesSuspended(bool suspended);
+    bool updatesSuspended() const { return _updatesSuspended; }
+
+    /** Counters describing how updates were scheduled */
+    struct FrameStatistics {
+        quint64 updateRequests = 0;    // calls to bufferedUpdate()
+        quint64 frames = 0;            // outputChanged() emissions
+        quint64 immediateFrames = 0;   // frames sent without any delay
+        quint64 suspendedRequests = 0; // requests made while updates were suspended
+    };
+    /** Returns the update counters since the last resetFrameStatistics() */
+    FrameStatistics frameStatistics() const { return _frameStatistics; }
+    void resetFrameStatistics() { _frameStatistics = FrameStatistics(); }
+
+    /**
+     * Returns the counters of the output processed since the last
+     * resetStatistics().  They are only collected when the library is built
+     * with QTERMWIDGET_STATISTICS, see TerminalStatistics.
+     */
+    TerminalStatistics statistics() const;
+    void resetStatistics();
+
 public slots:
 
     /** Change the size of the emulation's image */
@@ -264,8 +392,8 @@ public slots:
 
     /**
      * Processes an incoming stream of characters.  receiveData() decodes the incoming
-     * character buffer using the current codec(), and then calls receiveChar() for
-     * each unicode character in the resulting buffer.
+     * character buffer using the current codec(), and then passes the resulting
+     * unicode characters to receiveChars().
      *
      * receiveData() also starts a timer which causes the outputChanged() signal
      * to be emitted when it expires.  The timer allows multiple updates in quick
@@ -276,7 +404,52 @@ public slots:
      */
     void receiveData(const char* buffer,int len);
 
-    void dupDisplayCharacter(wchar_t cc);
+    /**
+     * Enables or disables the parser thread.  While it is enabled, receiveData()
+     * only queues the incoming bytes in a lock-free ring buffer and returns; a
+     * separate thread decodes them and updates the screens, so that bursts of
+     * output do not block the thread which owns the emulation.  Disabled by
+     * default.
+     *
+     * The screens are always guarded by stateLock().  Screen windows take the lock
+     * themselves and copy the changed lines into their own image, which views
+     * render without holding it.  Signals emitted while processing output are
+     * delivered to the owner thread through queued connections.
+     *
+     * Subclasses must disable the parser thread in their destructor.
+     */
+    void setThreadedEnabled(bool enabled);
+    /** Returns true if output is processed on a parser thread.  See setThreadedEnabled() */
+    bool isThreadedEnabled() const { return _parserThread != nullptr; }
+
+    /**
+     * Returns the lock which guards the screens and the parser state.  Output
+     * is processed under it, with or without the parser thread, so code
+     * which accesses a screen directly, rather than through a ScreenWindow,
+     * must hold it if it may run on another thread than the output, such as
+     * history searches and exports.
+     */
+    QRecursiveMutex* stateLock() const { return &_stateLock; }
+
+    /**
+     * Enables or disables the output tap.  While it is enabled, the text
+     * displayed by the emulation is collected line by line and the completed
+     * lines are emitted in batches via dupDisplayOutput(), once for each
+     * chunk passed to receiveData().  While it is disabled, which is the
+     * default, displayed characters are not copied at all.
+     */
+    void setOutputTapEnabled(bool enabled);
+    /** Returns true if the output tap is enabled.  See setOutputTapEnabled() */
+    bool outputTapEnabled() const { return _outputTapEnabled; }
+
+    void dupDisplayCharacter(wchar_t cc) {
+        if (_outputTapEnabled)
+            appendToOutputTap(&cc, 1);
+    }
+    void dupDisplayCharacters(const wchar_t* chars, int count) {
+        if (_outputTapEnabled)
+            appendToOutputTap(chars, count);
+    }
 
 signals:
 
@@ -289,8 +462,23 @@ signals:
      */
     void sendData(const char* data,int len);
 
+    /**
+     * Emitted with one or more complete lines of displayed text, encoded
+     * as UTF-8, while the output tap is enabled.  See setOutputTapEnabled()
+     */
     void dupDisplayOutput(const char* data,int len);
 
+    /**
+     * Emitted with true when the output queued for the parser thread fills
+     * most of the queue, and with false once the parser thread has caught
+     * up.  The reader of the terminal process should stop reading while it
+     * is full, see IPtyProcess::setReadingPaused(), so that the process is
+     * held up instead of the thread calling receiveData().  Only emitted
+     * while the parser thread is enabled; without it receiveData() processes
+     * the output before it returns.
+     */
+    void receiveQueueFull(bool full);
+
     /**
      * Requests that sending of input to the emulation
      * from the terminal process be suspended or resumed.
@@ -459,6 +647,14 @@ protected:
      */
     virtual void receiveChar(wchar_t ch);
 
+    /**
+     * Processes a run of incoming characters.  See receiveData()
+     *
+     * The default implementation calls receiveChar() for each character.
+     * Emulations may reimplement this to handle runs of plain text in bulk.
+     */
+    virtual void receiveChars(const wchar_t* chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -474,6 +670,24 @@ protected:
     };
     void setCodec(EmulationCodec codec); // codec number, 0 = locale, 1=utf8
 
+    /** Returns true if called from the parser thread.  See setThreadedEnabled() */
+    bool inParserThread() const;
+
+    /**
+     * Runs @p task on the thread which owns the emulation: immediately, unless
+     * called from the parser thread, in which case it is queued.  Used for work
+     * which must not happen on the parser thread, such as starting timers,
+     * accessing the clipboard or emitting signals which carry pointers.
+     */
+    template <typename Task>
+    void runInOwnerThread(Task task)
+    {
+        if (inParserThread())
+            QMetaObject::invokeMethod(this, std::move(task), Qt::QueuedConnection);
+        else
+            task();
+    }
+
     QList<ScreenWindow*> _windows;
 
     Screen* _currentScreen;  // pointer to the screen which is currently active,
@@ -490,6 +704,14 @@ protected:
     QStringDecoder _toUtf16;
 
     const KeyboardTranslator* _keyTranslator; // the keyboard layout
+
+    TerminalClipboard* _clipboard = nullptr;  // see setClipboard()
+
+    std::atomic<SessionRecorder*> _recorder{nullptr};  // see setRecorder()
+    QMetaObject::Connection _recorderConnection;      // records sendData()
+
+    TerminalStatistics _statistics;           // guarded by stateLock(), see statistics()
+    quint64 _screenSwitches = 0;              // guarded by stateLock(), see screenSwitchCount()
     
     bool _enableHandleCtrlC;
 
@@ -519,8 +741,47 @@ private:
     bool _bracketedPasteMode;
     QTimer _bulkTimer1{this};
     QTimer _bulkTimer2{this};
+
+    // frame pacing, see setFramePacing()
+    FramePacing _framePacing = FixedFramePacing;
+    int _frameInterval = 16;
+    bool _updatesSuspended = false;
+    bool _updatePending = false;       // an update was requested while suspended
+    bool _keyPressedSinceFrame = false;
+    std::atomic<int> _bytesSinceFrame{0};
+    QElapsedTimer _sinceFrame;
+    FrameStatistics _frameStatistics;
     QStringEncoder _fromUtf8;
-    QByteArray dupCache;
+    void appendToOutputTap(const wchar_t* chars, int count);
+    void flushOutputTap();
+
+    bool _outputTapEnabled = false;
+    QByteArray _outputTap;     // UTF-8 text not yet emitted by the output tap
+    int _outputTapLineEnd = 0; // end of the last complete line in _outputTap
+    // reused by receiveData() to hold the decoded characters of each chunk
+    QVector<wchar_t> _receiveBuffer;
+
+    // decodes and processes a chunk of output, see receiveData()
+    void processData(const char* text, int length);
+    // parser thread ---------------
+    void queueData(const char* text, int length);
+    bool processQueuedData();
+    void runParserThread();
+    // emits receiveQueueFull() if _receiveQueueFull has changed since it
+    // was last emitted; called in the owner thread
+    void reportReceiveQueue();
+
+    mutable QRecursiveMutex _stateLock;     // see stateLock()
+    QThread* _parserThread = nullptr;
+    SpscRingBuffer* _receiveQueue = nullptr; // bytes queued by receiveData()
+    QByteArray _receiveChunk;                // read from _receiveQueue while holding _stateLock
+    QSemaphore _receiveSignal;               // released whenever bytes are queued
+    std::atomic<bool> _stopParser{false};
+    std::atomic<bool> _bufferedUpdatePosted{false};
+    // set by receiveData() above the high mark, cleared by the parser
+    // thread below the low mark; see receiveQueueFull()
+    std::atomic<bool> _receiveQueueFull{false};
+    bool _receiveQueueFullReported = false;
 };
 
 #endif // EMULATION_H
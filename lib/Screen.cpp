@@ -53,7 +53,8 @@ Character Screen::defaultChar = Character(
 
 Screen::Screen(int l, int c)
         : lines(l), columns(c), screenLines(new ImageLine[lines + 1]),
-            _scrolledLines(0), _droppedLines(0), history(new HistoryScrollNone()),
+            _scrolledLines(0), _droppedLines(0), _generation(0),
+            _imageGeneration(0), history(new HistoryScrollNone()),
             cuX(0), cuY(0), currentRendition(0), _topMargin(0), _bottomMargin(0),
             selBegin(0), selTopLeft(0), selBottomRight(0), blockSelectionMode(false),
             effectiveForeground(CharacterColor()),
@@ -62,6 +63,9 @@ Screen::Screen(int l, int c)
     lineProperties.resize(lines + 1);
     for (int i = 0; i < lines + 1; i++)
             lineProperties[i] = LINE_DEFAULT;
+    _lineGeneration.resize(lines + 1);
+    for (int i = 0; i < lines + 1; i++)
+            _lineGeneration[i] = 0;
 
     initTabStops();
     clearSelection();
@@ -193,6 +197,7 @@ void Screen::deleteChars(int n) {
     Q_ASSERT(cuX + n <= screenLines[cuY].count());
 
     screenLines[cuY].remove(cuX, n);
+    markLineDirty(cuY);
 }
 
 void Screen::insertChars(int n) {
@@ -206,6 +211,7 @@ void Screen::insertChars(int n) {
 
     if (screenLines[cuY].count() > columns)
         screenLines[cuY].resize(columns);
+    markLineDirty(cuY);
 }
 
 void Screen::repeatChars(int count) {
@@ -239,6 +245,8 @@ void Screen::insertLines(int n) {
 }
 
 void Screen::setMode(int m) {
+    if ((m == MODE_Screen || m == MODE_Cursor) && !currentModes[m])
+        ++_imageGeneration;
     currentModes[m] = true;
     switch (m) {
     case MODE_Origin:
@@ -249,6 +257,8 @@ void Screen::setMode(int m) {
 }
 
 void Screen::resetMode(int m) {
+    if ((m == MODE_Screen || m == MODE_Cursor) && currentModes[m])
+        ++_imageGeneration;
     currentModes[m] = false;
     switch (m) {
     case MODE_Origin:
@@ -260,7 +270,11 @@ void Screen::resetMode(int m) {
 
 void Screen::saveMode(int m) { savedModes[m] = currentModes[m]; }
 
-void Screen::restoreMode(int m) { currentModes[m] = savedModes[m]; }
+void Screen::restoreMode(int m) {
+    if ((m == MODE_Screen || m == MODE_Cursor) && currentModes[m] != savedModes[m])
+        ++_imageGeneration;
+    currentModes[m] = savedModes[m];
+}
 
 bool Screen::getMode(int m) const { return currentModes[m]; }
 
@@ -305,6 +319,10 @@ void Screen::resizeImage(int new_lines, int new_columns) {
     for (int i = lines; (i > 0) && (i < new_lines + 1); i++)
         lineProperties[i] = LINE_DEFAULT;
 
+    _lineGeneration.resize(new_lines + 1);
+    markLinesDirty(0, new_lines);
+    ++_imageGeneration;
+
     clearSelection();
 
     delete[] screenLines;
@@ -457,9 +475,11 @@ void Screen::getImage(Character *dest, int size, int startLine,
             reverseRendition(dest[i]); // for reverse display
     }
 
-    // mark the character at the current cursor position
-    int cursorIndex = loc(cuX, cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < columns * mergedLines)
+    // mark the character at the current cursor position.  The cursor line is
+    // computed relative to startLine so that a single line can be copied.
+    const int cursorIndex = loc(cuX, history->getLines() + cuY - startLine);
+    if (getMode(MODE_Cursor) && cursorIndex >= 0 &&
+        cursorIndex < columns * mergedLines)
         dest[cursorIndex].rendition |= RE_CURSOR;
 }
 
@@ -666,6 +686,7 @@ void Screen::displayCharacter(wchar_t c) {
         }
 
         Character& currentChar = screenLines[charToCombineWithY][charToCombineWithX];
+        markLineDirty(charToCombineWithY);
 
         if (w > 0 && !isRegionalIndicator(currentChar.character)) {
             goto notcombine; // a single regional indicator (useless)
@@ -692,6 +713,7 @@ void Screen::displayCharacter(wchar_t c) {
                 }
 
                 // NOTE: This is needed for correct selection.
+                markLineDirty(cuY);
                 Character& ch = screenLines[cuY][cuX];
                 ch.character = 0;
                 ch.foregroundColor = effectiveForeground;
@@ -748,6 +770,8 @@ notcombine:
     // check if selection is still valid.
     checkSelection(lastPos, lastPos);
 
+    markLineDirty(cuY);
+
     Character &currentChar = screenLines[cuY][cuX];
 
     currentChar.character = c;
@@ -776,6 +800,53 @@ notcombine:
     cuX = newCursorX;
 }
 
+void Screen::displayCharacters(const wchar_t *chars, int count) {
+    int i = 0;
+    while (i < count) {
+        // anything but printable ASCII may be wide or combining, and insert
+        // mode shifts the rest of the line for every character
+        if (chars[i] < 0x20 || chars[i] >= 0x7f || getMode(MODE_Insert)) {
+            displayCharacter(chars[i++]);
+            continue;
+        }
+
+        if (cuX + 1 > columns) {
+            if (getMode(MODE_Wrap)) {
+                lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | LINE_WRAPPED);
+                nextLine();
+            } else {
+                cuX = columns - 1;
+            }
+        }
+
+        // the segment extends to the end of the line at most
+        int run = 1;
+        while (i + run < count && run < columns - cuX &&
+               chars[i + run] >= 0x20 && chars[i + run] < 0x7f)
+            run++;
+
+        ImageLine &line = screenLines[cuY];
+        if (line.size() < cuX + run)
+            line.resize(cuX + run);
+
+        Character *dest = line.data() + cuX;
+        for (int k = 0; k < run; k++) {
+            dest[k].character = chars[i + k];
+            dest[k].foregroundColor = effectiveForeground;
+            dest[k].backgroundColor = effectiveBackground;
+            dest[k].rendition = effectiveRendition;
+        }
+
+        checkSelection(loc(cuX, cuY), loc(cuX + run - 1, cuY));
+        markLineDirty(cuY);
+        lastPos = loc(cuX + run - 1, cuY);
+        lastDrawnChar = chars[i + run - 1];
+
+        cuX += run;
+        i += run;
+    }
+}
+
 void Screen::compose(const QString & /*compose*/) {
     Q_ASSERT(0 /*Not implemented yet*/);
 
@@ -928,6 +999,8 @@ void Screen::clearImage(int loca, int loce, char c) {
     int topLine = loca / columns;
     int bottomLine = loce / columns;
 
+    markLinesDirty(topLine, bottomLine);
+
     Character clearCh(c, currentForeground, currentBackground, DEFAULT_RENDITION);
 
     // if the character being used to clear the area is the same as the
@@ -981,6 +1054,8 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd) {
         }
     }
 
+    markLinesDirty(dest / columns, dest / columns + lines);
+
     if (lastPos != -1) {
         int diff = dest - sourceBegin; // Scroll by this amount
         lastPos += diff;
@@ -990,6 +1065,7 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd) {
 
     // Adjust selection to follow scroll.
     if (selBegin != -1) {
+        ++_imageGeneration;
         bool beginIsTL = (selBegin == selTopLeft);
         int diff = dest - sourceBegin; // Scroll by this amount
         int scr_TL = loc(0, history->getLines());
@@ -1096,6 +1172,7 @@ void Screen::setBackColor(int space, int color) {
 }
 
 void Screen::clearSelection() {
+    ++_imageGeneration;
     selBottomRight = -1;
     selTopLeft = -1;
     selBegin = -1;
@@ -1132,6 +1209,7 @@ void Screen::setSelectionStart(const int x, const int y, const bool mode) {
     selBottomRight = selBegin;
     selTopLeft = selBegin;
     blockSelectionMode = mode;
+    ++_imageGeneration;
 }
 
 void Screen::setSelectionEnd(const int x, const int y) {
@@ -1140,6 +1218,8 @@ void Screen::setSelectionEnd(const int x, const int y) {
 
     int endPos = loc(x, y);
 
+    ++_imageGeneration;
+
     if (endPos < selBegin) {
         selTopLeft = endPos;
         selBottomRight = selBegin;
@@ -1238,13 +1318,10 @@ int Screen::copyLineToStream(int line, int start, int count,
                             bool appendNewLine,
                             bool preserveLineBreaks) const {
     // buffer to hold characters for decoding
-    // the buffer is static to avoid initialising every
-    // element on each call to copyLineToStream
-    //(which is unnecessary since all elements will be overwritten anyway)
-    static const int MAX_CHARS = 1024;
-    static Character characterBuffer[MAX_CHARS];
-
-    Q_ASSERT(count < MAX_CHARS);
+    // the buffer is kept to avoid allocating and initialising it on each
+    // call to copyLineToStream, and grows to the longest line copied.  It is
+    // per thread, as lines are also copied by searches on worker threads
+    static thread_local QVector<Character> characterBuffer;
 
     LineProperty currentLineProperties = 0;
 
@@ -1269,7 +1346,9 @@ int Screen::copyLineToStream(int line, int start, int count,
         Q_ASSERT(count >= 0);
         Q_ASSERT((start + count) <= history->getLineLen(line));
 
-        history->getCells(line, start, count, characterBuffer);
+        if (characterBuffer.size() <= count)
+            characterBuffer.resize(count + 1);
+        history->getCells(line, start, count, characterBuffer.data());
 
         if (history->isWrappedLine(line))
             currentLineProperties |= LINE_WRAPPED;
@@ -1285,7 +1364,11 @@ int Screen::copyLineToStream(int line, int start, int count,
         int length = screenLines[screenLine].count();
 
         // retrieve line from screen image
-        for (int i = start; i < qMin(start + count, length); i++) {
+        const int end = qMin(start + count, length);
+        // with room for the line break
+        if (characterBuffer.size() <= qMax(0, end - start))
+            characterBuffer.resize(qMax(0, end - start) + 1);
+        for (int i = start; i < end; i++) {
             characterBuffer[i - start] = data[i];
         }
 
@@ -1300,13 +1383,13 @@ int Screen::copyLineToStream(int line, int start, int count,
     const bool omitLineBreak =
             (currentLineProperties & LINE_WRAPPED) || !preserveLineBreaks;
 
-    if (!omitLineBreak && appendNewLine && (count + 1 < MAX_CHARS)) {
+    if (!omitLineBreak && appendNewLine) {
         characterBuffer[count] = '\n';
         count++;
     }
 
     // decode line and write to text stream
-    decoder->decodeLine((Character *)characterBuffer, count,
+    decoder->decodeLine(characterBuffer.constData(), count,
                                             currentLineProperties);
 
     return count;
@@ -1317,11 +1400,20 @@ void Screen::writeLinesToStream(TerminalCharacterDecoder *decoder, int fromLine,
     writeToStream(decoder, loc(0, fromLine), loc(columns - 1, toLine));
 }
 
+void Screen::writeWholeLinesToStream(TerminalCharacterDecoder *decoder, int fromLine,
+                                     int toLine) const {
+    for (int line = fromLine; line <= toLine; line++)
+        copyLineToStream(line, 0, -1, decoder, true, true);
+}
+
 void Screen::addHistLine() {
     // add line to history buffer
     // we have to take care about scrolling, too...
 
     if (hasScroll()) {
+        // the history (and the selection following it) changes under every view
+        ++_imageGeneration;
+
         int oldHistLines = history->getLines();
 
         history->addCellsVector(screenLines[0]);
@@ -1329,6 +1421,14 @@ void Screen::addHistLine() {
 
         int newHistLines = history->getLines();
 
+        _historyIndex.addLine(screenLines[0].constData(), screenLines[0].size(),
+                              lineProperties[0] & LINE_WRAPPED);
+        TERMINAL_STATISTIC(_historyLinesAdded++);
+        if (newHistLines <= oldHistLines) {
+            _historyIndex.dropLines(oldHistLines + 1 - newHistLines);
+            _droppedHistoryLines += oldHistLines + 1 - newHistLines;
+        }
+
         bool beginIsTL = (selBegin == selTopLeft);
 
         // If the history is full, increment the count
@@ -1371,8 +1471,18 @@ void Screen::addHistLine() {
 
 int Screen::getHistLines() const { return history->getLines(); }
 
+const HistoryIndex &Screen::historyIndex() {
+    if (!_historyIndex.isEnabled())
+        _historyIndex.enable(history);
+    return _historyIndex;
+}
+
 void Screen::setScroll(const HistoryType &t, bool copyPreviousScroll) {
     clearSelection();
+    ++_imageGeneration;
+
+    // a smaller history keeps the newest lines, a cleared one none
+    const int oldHistLines = history->getLines();
 
     if (copyPreviousScroll)
         history = t.scroll(history);
@@ -1381,6 +1491,9 @@ void Screen::setScroll(const HistoryType &t, bool copyPreviousScroll) {
         history = t.scroll(nullptr);
         delete oldScroll;
     }
+
+    _historyIndex.rebuild(history);
+    _droppedHistoryLines += qMax(0, oldHistLines - history->getLines());
 }
 
 bool Screen::hasScroll() const { return history->hasScroll(); }
@@ -1392,6 +1505,7 @@ void Screen::setLineProperty(LineProperty property, bool enable) {
         lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | property);
     else
         lineProperties[cuY] = (LineProperty)(lineProperties[cuY] & ~property);
+    markLineDirty(cuY);
 }
 
 void Screen::fillWithDefaultChar(Character *dest, int count) {
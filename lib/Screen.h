@@ -29,6 +29,8 @@
 
 #include "Character.h"
 #include "History.h"
+#include "HistoryIndex.h"
+#include "TerminalStatistics.h"
 
 #define MODE_Origin    0
 #define MODE_Wrap      1
@@ -354,6 +356,13 @@ public:
      * character already at the current cursor position.
      */
     void displayCharacter(wchar_t c);
+    /**
+     * Displays a run of characters at the cursor position, exactly as
+     * calling displayCharacter() for each of them would.  Runs of printable
+     * ASCII characters are written a line segment at a time, with wrapping
+     * and the current rendition applied once per segment.
+     */
+    void displayCharacters(const wchar_t* chars, int count);
 
     // Do composition with last shown character FIXME: Not implemented yet for KDE 4
     void compose(const QString& compose);
@@ -390,6 +399,24 @@ public:
      */
     QVector<LineProperty> getLineProperties( int startLine , int endLine ) const;
 
+    /**
+     * Returns the generation of the screen line @p line (0 being the first
+     * line of the screen, not of the history).  The generation changes
+     * whenever the characters or properties of the line are modified, so
+     * views can compare it against a previously recorded value to find out
+     * whether the line needs to be copied again.
+     */
+    quint32 lineGeneration(int line) const { return _lineGeneration[line]; }
+
+    /**
+     * Returns the generation of the whole image.  This changes whenever
+     * something which affects every line of the image returned by getImage()
+     * is modified, such as the selection, the history, the screen size or the
+     * MODE_Screen and MODE_Cursor modes.  When it changes, all previously
+     * recorded line generations must be treated as stale.
+     */
+    quint32 imageGeneration() const { return _imageGeneration; }
+
 
     /** Return the number of lines. */
     int getLines() const { return lines; }
@@ -403,6 +430,26 @@ public:
      * history buffer are copied into the new scroll.
      */
     void setScroll(const HistoryType& , bool copyPreviousScroll = true);
+    /**
+     * Returns the search index over the lines in the history.  The index is
+     * built on the first call; from then on lines are added to it as they
+     * enter the history.
+     */
+    const HistoryIndex &historyIndex();
+    /**
+     * Returns the number of lines removed from the front of the history
+     * since the screen was created, whether the history was full, made
+     * smaller or cleared.  Unlike the count of the history index this is
+     * not reset when the index is rebuilt.
+     */
+    qint64 droppedHistoryLines() const { return _droppedHistoryLines; }
+    /**
+     * Returns the number of lines added to the history since the last
+     * resetHistoryLinesAdded().  Only counted when the library is built with
+     * QTERMWIDGET_STATISTICS.
+     */
+    quint64 historyLinesAdded() const { return _historyLinesAdded; }
+    void resetHistoryLinesAdded() { _historyLinesAdded = 0; }
     /** Returns the type of storage used to keep lines in the history. */
     const HistoryType& getScroll() const;
     /**
@@ -466,6 +513,18 @@ public:
      */
     void writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const;
 
+    /**
+     * Copies whole lines of the output to a stream, each ending with a line
+     * break unless it wraps into the next line.  Unlike writeLinesToStream(),
+     * the last line is ended like the others, so that consecutive ranges of
+     * lines can be written one after another.
+     *
+     * @param decoder A decoder which converts terminal characters into text
+     * @param fromLine The first line in the history to retrieve
+     * @param toLine The last line in the history to retrieve
+     */
+    void writeWholeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const;
+
     /**
      * Copies the selected characters, set using @see setSelBeginXY and @see setSelExtentXY
      * into a stream.
@@ -609,6 +668,15 @@ private:
 
     void addHistLine();
 
+    // records that the screen lines from 'top' to 'bottom' have changed
+    void markLinesDirty(int top, int bottom)
+    {
+        const quint32 generation = ++_generation;
+        for (int line = top; line <= bottom; line++)
+            _lineGeneration[line] = generation;
+    }
+    void markLineDirty(int line) { _lineGeneration[line] = ++_generation; }
+
     void initTabStops();
 
     void updateEffectiveRendition();
@@ -641,8 +709,16 @@ private:
 
     QVarLengthArray<LineProperty,64> lineProperties;
 
+    // damage tracking, see lineGeneration() and imageGeneration()
+    QVarLengthArray<quint32,64> _lineGeneration;
+    quint32 _generation;
+    quint32 _imageGeneration;
+
     // history buffer ---------------
     HistoryScroll* history;
+    HistoryIndex _historyIndex;
+    qint64 _droppedHistoryLines = 0;  // see droppedHistoryLines()
+    quint64 _historyLinesAdded = 0;
 
     // cursor location
     int cuX;
@@ -21,9 +21,11 @@
 #include <QtDebug>
 
 ScreenWindow::ScreenWindow(QObject *parent)
-    : QObject(parent), _screen(nullptr), _windowBuffer(nullptr),
+    : QObject(parent), _screen(nullptr), _stateLock(nullptr), _windowBuffer(nullptr),
       _windowBufferSize(0), _bufferNeedsUpdate(true), _windowLines(1),
-      _currentLine(0), _trackOutput(true), _scrollCount(0) {
+      _currentLine(0), _trackOutput(true), _scrollCount(0),
+      _bufferIsValid(false), _bufferStartLine(0), _bufferLineCount(0),
+      _bufferCursorIndex(-1), _bufferImageGeneration(0) {
 }
 
 ScreenWindow::~ScreenWindow() { 
@@ -33,13 +35,20 @@ ScreenWindow::~ScreenWindow() {
 void ScreenWindow::setScreen(Screen *screen) {
   Q_ASSERT(screen);
   _screen = screen;
+  _bufferIsValid = false;
+  _bufferNeedsUpdate = true;
 }
 
 Screen *ScreenWindow::screen() const { 
     return _screen; 
 }
 
+void ScreenWindow::setStateLock(QRecursiveMutex *lock) {
+    _stateLock = lock;
+}
+
 Character *ScreenWindow::getImage() {
+    QMutexLocker locker(_stateLock);
     // reallocate internal buffer if the window size has changed
     int size = windowLines() * windowColumns();
     if (_windowBuffer == nullptr || _windowBufferSize != size) {
@@ -52,15 +61,81 @@ Character *ScreenWindow::getImage() {
     if (!_bufferNeedsUpdate)
         return _windowBuffer;
 
-    _screen->getImage(_windowBuffer, size, currentLine(), endWindowLine());
+    const int columns = windowColumns();
+    const int startLine = currentLine();
+    const int endLine = endWindowLine();
+    const int historyLines = _screen->getHistLines();
+
+    // offset of the character which Screen::getImage() marks as the cursor
+    const int cursorIndex =
+        (historyLines + _screen->getCursorY() - startLine) * columns +
+        _screen->getCursorX();
+
+    if (!_bufferIsValid || _lineGenerations.count() != windowLines() ||
+        startLine != _bufferStartLine || lineCount() != _bufferLineCount ||
+        _screen->imageGeneration() != _bufferImageGeneration) {
+        copyWindow(startLine, endLine);
+    } else {
+        // the window has not moved and nothing affecting the whole image
+        // has changed, so only lines modified on the screen and the lines
+        // which gained or lost the cursor have to be copied again
+        const bool cursorMoved = cursorIndex != _bufferCursorIndex;
+        const int oldCursorLine =
+            _bufferCursorIndex >= 0 ? _bufferCursorIndex / columns : -1;
+        const int newCursorLine = cursorIndex >= 0 ? cursorIndex / columns : -1;
+
+        for (int line = qMax(startLine, historyLines); line <= endLine; line++) {
+            const int windowLine = line - startLine;
+            const quint32 generation = _screen->lineGeneration(line - historyLines);
+
+            if (generation == _lineGenerations[windowLine] &&
+                !(cursorMoved && (windowLine == oldCursorLine ||
+                                  windowLine == newCursorLine)))
+                continue;
+
+            _screen->getImage(_windowBuffer + windowLine * columns, columns,
+                              line, line);
+            _lineGenerations[windowLine] = generation;
+            _changedLines[windowLine] = true;
+        }
+    }
+
+    _bufferIsValid = true;
+    _bufferStartLine = startLine;
+    _bufferLineCount = lineCount();
+    _bufferCursorIndex = cursorIndex;
+    _bufferImageGeneration = _screen->imageGeneration();
+
+    _bufferNeedsUpdate = false;
+    return _windowBuffer;
+}
+
+void ScreenWindow::copyWindow(int startLine, int endLine) {
+    _screen->getImage(_windowBuffer, _windowBufferSize, startLine, endLine);
 
     // this window may look beyond the end of the screen, in which
     // case there will be an unused area which needs to be filled
     // with blank characters
     fillUnusedArea();
 
-    _bufferNeedsUpdate = false;
-    return _windowBuffer;
+    const int historyLines = _screen->getHistLines();
+    _lineGenerations.resize(windowLines());
+    _changedLines.fill(true, windowLines());
+    for (int windowLine = 0; windowLine < windowLines(); windowLine++) {
+        const int screenLine = startLine + windowLine - historyLines;
+        _lineGenerations[windowLine] =
+            (screenLine >= 0 && startLine + windowLine <= endLine)
+                ? _screen->lineGeneration(screenLine)
+                : 0;
+    }
+}
+
+bool ScreenWindow::isLineChanged(int line) const {
+    return line < 0 || line >= _changedLines.count() || _changedLines[line];
+}
+
+void ScreenWindow::resetChangedLines() {
+    _changedLines.fill(false);
 }
 
 void ScreenWindow::fillUnusedArea() {
@@ -86,6 +161,7 @@ int ScreenWindow::endWindowLine() const {
 }
 
 QVector<LineProperty> ScreenWindow::getLineProperties() {
+    QMutexLocker locker(_stateLock);
     QVector<LineProperty> result = _screen->getLineProperties(currentLine(), endWindowLine());
 
     if (result.count() != windowLines())
@@ -95,20 +171,24 @@ QVector<LineProperty> ScreenWindow::getLineProperties() {
 }
 
 QString ScreenWindow::selectedText(bool preserveLineBreaks) const {
+    QMutexLocker locker(_stateLock);
     return _screen->selectedText(preserveLineBreaks);
 }
 
 void ScreenWindow::getSelectionStart(int &column, int &line) {
+    QMutexLocker locker(_stateLock);
     _screen->getSelectionStart(column, line);
     line -= currentLine();
 }
 
 void ScreenWindow::getSelectionEnd(int &column, int &line) {
+    QMutexLocker locker(_stateLock);
     _screen->getSelectionEnd(column, line);
     line -= currentLine();
 }
 
 void ScreenWindow::setSelectionStart(int column, int line, bool columnMode) {
+    QMutexLocker locker(_stateLock);
     _screen->setSelectionStart(column, qMin(line + currentLine(), endWindowLine()), columnMode);
 
     _bufferNeedsUpdate = true;
@@ -116,6 +196,7 @@ void ScreenWindow::setSelectionStart(int column, int line, bool columnMode) {
 }
 
 void ScreenWindow::setSelectionEnd(int column, int line) {
+    QMutexLocker locker(_stateLock);
     _screen->setSelectionEnd(column, qMin(line + currentLine(), endWindowLine()));
 
     _bufferNeedsUpdate = true;
@@ -123,16 +204,19 @@ void ScreenWindow::setSelectionEnd(int column, int line) {
 }
 
 bool ScreenWindow::isSelected(int column, int line) {
+    QMutexLocker locker(_stateLock);
     return _screen->isSelected(column, qMin(line + currentLine(), endWindowLine()));
 }
 
 void ScreenWindow::clearSelection() {
+    QMutexLocker locker(_stateLock);
     _screen->clearSelection();
 
     emit selectionChanged();
 }
 
 bool ScreenWindow::isClearSelection() { 
+    QMutexLocker locker(_stateLock);
     return _screen->isClearSelection(); 
 }
 
@@ -146,18 +230,22 @@ int ScreenWindow::windowLines() const {
 }
 
 int ScreenWindow::windowColumns() const { 
+    QMutexLocker locker(_stateLock);
     return _screen->getColumns(); 
 }
 
 int ScreenWindow::lineCount() const {
+    QMutexLocker locker(_stateLock);
     return _screen->getHistLines() + _screen->getLines();
 }
 
 int ScreenWindow::columnCount() const { 
+    QMutexLocker locker(_stateLock);
     return _screen->getColumns(); 
 }
 
 QPoint ScreenWindow::cursorPosition() const {
+    QMutexLocker locker(_stateLock);
     QPoint position;
 
     position.setX(_screen->getCursorX());
@@ -166,16 +254,33 @@ QPoint ScreenWindow::cursorPosition() const {
     return position;
 }
 
-int ScreenWindow::getCursorX() const { return _screen->getCursorX(); }
-int ScreenWindow::getCursorY() const { return _screen->getCursorY(); }
-void ScreenWindow::setCursorX(int x) { _screen->setCursorX(x); }
-void ScreenWindow::setCursorY(int y) { _screen->setCursorY(y); }
+int ScreenWindow::getCursorX() const {
+    QMutexLocker locker(_stateLock);
+    return _screen->getCursorX();
+}
+
+int ScreenWindow::getCursorY() const {
+    QMutexLocker locker(_stateLock);
+    return _screen->getCursorY();
+}
+
+void ScreenWindow::setCursorX(int x) {
+    QMutexLocker locker(_stateLock);
+    _screen->setCursorX(x);
+}
+
+void ScreenWindow::setCursorY(int y) {
+    QMutexLocker locker(_stateLock);
+    _screen->setCursorY(y);
+}
 
 QString ScreenWindow::getScreenText(int row1, int col1, int row2, int col2, int mode) {
+    QMutexLocker locker(_stateLock);
     return _screen->getScreenText(row1, col1, row2, col2, mode);
 }
 
 int ScreenWindow::currentLine() const {
+    QMutexLocker locker(_stateLock);
     if (lineCount() >= windowLines()) {
         return qBound(0, _currentLine, lineCount() - windowLines());
     }
@@ -183,6 +288,7 @@ int ScreenWindow::currentLine() const {
 }
 
 void ScreenWindow::scrollBy(RelativeScrollMode mode, int amount) {
+    QMutexLocker locker(_stateLock);
     if (mode == ScrollLines) {
         scrollTo(currentLine() + amount);
     } else if (mode == ScrollPages) {
@@ -191,10 +297,12 @@ void ScreenWindow::scrollBy(RelativeScrollMode mode, int amount) {
 }
 
 bool ScreenWindow::atEndOfOutput() const {
+    QMutexLocker locker(_stateLock);
     return currentLine() == (lineCount() - windowLines());
 }
 
 void ScreenWindow::scrollTo(int line) {
+    QMutexLocker locker(_stateLock);
     int maxCurrentLineNumber = lineCount() - windowLines();
     line = qBound(0, line, maxCurrentLineNumber);
 
@@ -219,6 +327,7 @@ int ScreenWindow::scrollCount() const { return _scrollCount; }
 void ScreenWindow::resetScrollCount() { _scrollCount = 0; }
 
 QRect ScreenWindow::scrollRegion() const {
+    QMutexLocker locker(_stateLock);
     bool equalToScreenSize = windowLines() == _screen->getLines();
 
     if (atEndOfOutput() && equalToScreenSize)
@@ -228,6 +337,7 @@ QRect ScreenWindow::scrollRegion() const {
 }
 
 void ScreenWindow::notifyOutputChanged() {
+    QMutexLocker locker(_stateLock);
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if (_trackOutput) {
@@ -22,7 +22,9 @@
 
 #include <QObject>
 #include <QPoint>
+#include <QRecursiveMutex>
 #include <QRect>
+#include <QVector>
 
 #include "Character.h"
 #include "KeyboardTranslator.h"
@@ -67,15 +69,35 @@ public:
     /** Returns the screen which this window looks onto */
     Screen* screen() const;
 
+    /**
+     * Sets the lock which guards the screen while its emulation processes output
+     * on another thread, see Emulation::setThreadedEnabled().  The window holds
+     * it while accessing the screen.
+     */
+    void setStateLock(QRecursiveMutex* lock);
+
     /**
      * Returns the image of characters which are currently visible through this window
      * onto the screen.
      *
      * The returned buffer is managed by the ScreenWindow instance and does not need to be
      * deleted by the caller.
+     *
+     * Only the lines whose contents changed since the previous call are copied from the
+     * screen, see isLineChanged().
      */
     Character* getImage();
 
+    /**
+     * Returns true if @p line of the window was copied again by getImage() since the last
+     * call to resetChangedLines().  The characters of lines which were not copied again are
+     * identical to those returned previously, so views can skip comparing them.
+     */
+    bool isLineChanged(int line) const;
+
+    /** Resets the flags returned by isLineChanged() */
+    void resetChangedLines();
+
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
@@ -250,8 +272,11 @@ signals:
 private:
     int endWindowLine() const;
     void fillUnusedArea();
+    // copies the whole window from the screen
+    void copyWindow(int startLine, int endLine);
 
     Screen* _screen; // see setScreen() , screen()
+    QRecursiveMutex* _stateLock; // see setStateLock()
     Character* _windowBuffer;
     int _windowBufferSize;
     bool _bufferNeedsUpdate;
@@ -261,6 +286,16 @@ private:
     bool _trackOutput; // see setTrackOutput() , trackOutput()
     int  _scrollCount; // count of lines which the window has been scrolled by since
                        // the last call to resetScrollCount()
+
+    // state of the screen when _windowBuffer was last filled, used by getImage()
+    // to copy only the lines which have changed since
+    bool _bufferIsValid;
+    int  _bufferStartLine;
+    int  _bufferLineCount;
+    int  _bufferCursorIndex;
+    quint32 _bufferImageGeneration;
+    QVector<quint32> _lineGenerations;
+    QVector<bool> _changedLines; // see isLineChanged()
 };
 
 #endif // SCREENWINDOW_H
@@ -26,6 +26,7 @@
 #include <QBoxLayout>
 #include <QClipboard>
 #include <QDrag>
+#include <QElapsedTimer>
 #include <QEvent>
 #include <QFile>
 #include <QGridLayout>
@@ -51,6 +52,7 @@
 #include "Filter.h"
 #include "ScreenWindow.h"
 #include "TerminalCharacterDecoder.h"
+#include "TraceRecorder.h"
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -135,6 +137,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow *window) {
     }
 
     _screenWindow = window;
+    _imageNeedsFullUpdate = true;
 
     if (window) {
         // TODO: Determine if this is an issue.
@@ -242,6 +245,9 @@ void TerminalDisplay::fontChange(const QFont &) {
 
     _fontAscent = fm.ascent();
 
+    if (_glyphCache)
+        _glyphCache->setFont(font(), _fontWidth, _fontHeight, _fontAscent + _lineSpacing);
+
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
 
@@ -302,6 +308,20 @@ void TerminalDisplay::setVTFont(const QFont &f) {
     fontChange(font);
 }
 
+void TerminalDisplay::setGlyphCacheEnabled(bool enabled) {
+    if (enabled == (_glyphCache != nullptr))
+        return;
+
+    if (enabled) {
+        _glyphCache = new GlyphCache();
+        _glyphCache->setFont(font(), _fontWidth, _fontHeight, _fontAscent + _lineSpacing);
+    } else {
+        delete _glyphCache;
+        _glyphCache = nullptr;
+    }
+    update();
+}
+
 void TerminalDisplay::setFont(const QFont &) {
     // ignore font change request if not coming from konsole itself
 }
@@ -420,6 +440,7 @@ TerminalDisplay::TerminalDisplay(QWidget *parent)
 }
 
 TerminalDisplay::~TerminalDisplay() {
+    TERMINAL_TRACE_REMOVE(this);
     if (_backgroundVideoPlayer->isPlaying()) {
         _backgroundVideoPlayer->stop();
     }
@@ -439,6 +460,7 @@ TerminalDisplay::~TerminalDisplay() {
     delete[] _image;
 
     delete _charWidth;
+    delete _glyphCache;
     delete _gridLayout;
     delete _outputSuspendedLabel;
     delete _filterChain;
@@ -917,6 +939,36 @@ void TerminalDisplay::drawCharacters(QPainter &painter, const QRect &rect,
             style->rendition & RE_STRIKEOUT || font().strikeOut();
     const bool useOverline = style->rendition & RE_OVERLINE || font().overline();
 
+    // setup pen
+    const CharacterColor &textColor =
+            (invertCharacterColor ? style->backgroundColor : style->foregroundColor);
+    const QColor color = textColor.color(_colorTable);
+
+    // FIXME: Here is a hack to solve the East Asian language symbol
+    // "“‘"　rendering issue.
+    //        But it is not a good solution. We should find a better way to solve
+    //        this issue.
+    int font_width = _charWidth->string_font_width(text);
+    int width = CharWidth::string_unicode_width(text);
+    const bool fixWidth = _fix_quardCRT_issue33 && font_width != width;
+
+    // compose the text from cached glyphs where possible
+    if (_glyphCache && _fixedFont && !tooWide && !fixWidth && !isLineCharString(text)) {
+        int styleFlags = 0;
+        if (useBold)
+            styleFlags |= GlyphCache::Bold;
+        if (useItalic)
+            styleFlags |= GlyphCache::Italic;
+        if (useUnderline)
+            styleFlags |= GlyphCache::Underline;
+        if (useStrikeOut)
+            styleFlags |= GlyphCache::StrikeOut;
+        if (useOverline)
+            styleFlags |= GlyphCache::Overline;
+        if (_glyphCache->drawText(painter, rect, text, styleFlags, color))
+            return;
+    }
+
     QFont font = painter.font();
     if (font.bold() != useBold || font.underline() != useUnderline ||
             font.italic() != useItalic || font.strikeOut() != useStrikeOut ||
@@ -931,23 +983,13 @@ void TerminalDisplay::drawCharacters(QPainter &painter, const QRect &rect,
         painter.setFont(font);
     }
 
-    // setup pen
-    const CharacterColor &textColor =
-            (invertCharacterColor ? style->backgroundColor : style->foregroundColor);
-    const QColor color = textColor.color(_colorTable);
     QPen pen = painter.pen();
     if (pen.color() != color) {
         pen.setColor(color);
         painter.setPen(color);
     }
 
-    // FIXME: Here is a hack to solve the East Asian language symbol
-    // "“‘"　rendering issue.
-    //        But it is not a good solution. We should find a better way to solve
-    //        this issue.
-    int font_width = _charWidth->string_font_width(text);
-    int width = CharWidth::string_unicode_width(text);
-    if (_fix_quardCRT_issue33 && font_width != width) {
+    if (fixWidth) {
         int single_rect_width = rect.width() / width;
         for (size_t i = 0; i < text.length(); i++) {
             wchar_t line_char = text[i];
@@ -1208,6 +1250,10 @@ void TerminalDisplay::scrollImage(int lines, const QRect &screenWindowRegion) {
 
     Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
+    // the lines of _image no longer match those which the screen window
+    // reported as changed
+    _imageNeedsFullUpdate = true;
+
     // scroll the display vertically to match internal _image
     scroll(0, _fontHeight * (-lines), scrollRect);
 }
@@ -1255,6 +1301,10 @@ void TerminalDisplay::processFilters() {
     if (!_screenWindow)
         return;
 
+    TERMINAL_TRACE(trace, "processFilters", this);
+    TERMINAL_STATISTIC(QElapsedTimer timer);
+    TERMINAL_STATISTIC(timer.start());
+
     QRegion preUpdateHotSpots = hotSpotRegion();
 
     // use _screenWindow->getImage() here rather than _image because
@@ -1267,6 +1317,9 @@ void TerminalDisplay::processFilters() {
             _screenWindow->windowColumns(), _screenWindow->getLineProperties());
     _filterChain->process();
 
+    TERMINAL_STATISTIC(_statistics.filterRuns++);
+    TERMINAL_STATISTIC(_statistics.filterTime += timer.nsecsElapsed());
+
     QRegion postUpdateHotSpots = hotSpotRegion();
 
     update(preUpdateHotSpots | postUpdateHotSpots);
@@ -1276,6 +1329,9 @@ void TerminalDisplay::updateImage() {
     if (!_screenWindow)
         return;
 
+    TERMINAL_TRACE(trace, "updateImage", this);
+    TERMINAL_STATISTIC(quint64 dirtyCells = 0);
+
     // optimization - scroll the existing image where possible and
     // avoid expensive text drawing for parts of the image that
     // can simply be moved up or down
@@ -1316,6 +1372,11 @@ void TerminalDisplay::updateImage() {
     char *dirtyMask = new char[columnsToUpdate + 2];
     QRegion dirtyRegion;
 
+    const bool fullUpdate =
+            _imageNeedsFullUpdate || _lineHasBlinker.count() != linesToUpdate;
+    if (fullUpdate)
+        _lineHasBlinker.fill(false, linesToUpdate);
+
     // debugging variable, this records the number of lines that are found to
     // be 'dirty' ( ie. have changed from the old _image to the new _image ) and
     // which therefore need to be repainted
@@ -1325,6 +1386,21 @@ void TerminalDisplay::updateImage() {
 
         bool updateLine = false;
 
+        // lines which the screen window did not copy again still hold the
+        // characters already in _image, so they need not be compared
+        if (!fullUpdate && !_screenWindow->isLineChanged(y)) {
+            if (!_resizing && _lineHasBlinker[y])
+                _hasBlinker = true;
+            if (_lineProperties.count() > y &&
+                (_lineProperties[y] & LINE_DOUBLEHEIGHT) != 0) {
+                dirtyRegion |=
+                        QRect(_leftMargin + tLx, _topMargin + tLy + _fontHeight * y,
+                                    _fontWidth * columnsToUpdate, _fontHeight);
+            }
+            continue;
+        }
+        _lineHasBlinker[y] = false;
+
         // The dirty mask indicates which characters need repainting. We also
         // mark surrounding neighbours dirty, in case the character exceeds
         // its cell boundaries
@@ -1333,14 +1409,15 @@ void TerminalDisplay::updateImage() {
         for (x = 0; x < columnsToUpdate; ++x) {
             if (newLine[x] != currentLine[x]) {
                 dirtyMask[x] = true;
+                TERMINAL_STATISTIC(dirtyCells++);
             }
         }
 
-        QFontMetrics fm(font());
         if (!_resizing) // not while _resizing, we're expecting a paintEvent
             for (x = 0; x < columnsToUpdate; ++x) {
                 if ((newLine[x].rendition & RE_BLINK) != 0) {
                     _hasBlinker = true;
+                    _lineHasBlinker[y] = true;
                 }
 
                 // Start drawing if this character or the next one differs.
@@ -1356,7 +1433,7 @@ void TerminalDisplay::updateImage() {
                     bool doubleWidth = (x + 1 == columnsToUpdate)
                                                                  ? false
                                                                  : (newLine[x + 1].character == 0);
-                    int charWidth = fm.horizontalAdvance(QString::fromWCharArray(&c, 1));
+                    int charWidth = _charWidth->font_advance(c);
                     bool bigWidth = _fixedFont && !doubleWidth && charWidth > _fontWidth;
                     bool smallWidth = _fixedFont && charWidth < _fontWidth;
                     cr = newLine[x].rendition;
@@ -1375,7 +1452,7 @@ void TerminalDisplay::updateImage() {
                                         ? false
                                         : (newLine[x + len + 1].character == 0);
 
-                        int nxtCharWidth = fm.horizontalAdvance(QString::fromWCharArray(&newLine[x+len].character, 1));
+                        int nxtCharWidth = _charWidth->font_advance(newLine[x+len].character);
                         bool nextIsbigWidth = _fixedFont && !nextIsDoubleWidth && nxtCharWidth > _fontWidth;
                         bool nextIsSmallWidth = _fixedFont && newLine[x+len].character && nxtCharWidth < _fontWidth;
 
@@ -1455,6 +1532,13 @@ void TerminalDisplay::updateImage() {
 
     dirtyRegion |= _inputMethodData.previousPreeditRect;
 
+    _screenWindow->resetChangedLines();
+    _imageNeedsFullUpdate = false;
+
+    TERMINAL_STATISTIC(_statistics.imageUpdates++);
+    TERMINAL_STATISTIC(_statistics.dirtyCells += dirtyCells);
+    TERMINAL_STATISTIC(trace.setArg("dirtyCells", static_cast<qint64>(dirtyCells)));
+
     // update the parts of the display which have changed
     update(dirtyRegion);
 
@@ -1583,6 +1667,10 @@ void TerminalDisplay::leaveEvent(QEvent* event)
 }
 
 void TerminalDisplay::paintEvent(QPaintEvent *pe) {
+    TERMINAL_TRACE(trace, "paint", this);
+    TERMINAL_STATISTIC(QElapsedTimer timer);
+    TERMINAL_STATISTIC(timer.start());
+
     QPainter paint(this);
     QRect cr = contentsRect();
 
@@ -1706,6 +1794,9 @@ void TerminalDisplay::paintEvent(QPaintEvent *pe) {
     }
 
     paintFilters(paint);
+
+    TERMINAL_STATISTIC(_statistics.paints++);
+    TERMINAL_STATISTIC(_statistics.paintTime += timer.nsecsElapsed());
 }
 
 QPoint TerminalDisplay::cursorPosition() const {
@@ -1875,7 +1966,6 @@ void TerminalDisplay::paintFilters(QPainter &painter) {
 
 // NOTE: This should be called only when "_fixedFont" is set to "false" (temporarily).
 int TerminalDisplay::textWidth(const int startColumn, const int length, const int line) const {
-    QFontMetrics fm(font());
     int result = 0;
     for (int column = 0; column < length; column++) {
         auto c = _image[loc(startColumn + column, line)];
@@ -1884,9 +1974,9 @@ int TerminalDisplay::textWidth(const int startColumn, const int length, const in
         // [1] http://www.unicode.org/Public/UCD/latest/ucd/EastAsianWidth.txt
         if (_fixedFont_original && !isLineChar(c)) { 
             // c == 0 may happen here after a double-column character
-            result += fm.horizontalAdvance(QLatin1Char(REPCHAR[0]));
+            result += _charWidth->font_advance(REPCHAR[0]);
         } else {
-            result += fm.horizontalAdvance(QChar(static_cast<uint>(c.character)));
+            result += _charWidth->font_advance(c.character);
         }
     }
     return result;
@@ -1914,7 +2004,6 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect) {
     int rlx = qMin(_usedColumns - 1, qMax(0, (rect.right() - tLx - _leftMargin) / _fontWidth));
     int rly = qMin(_usedLines - 1, qMax(0, (rect.bottom() - tLy - _topMargin) / _fontHeight));
 
-    QFontMetrics fm(font());
     const int numberOfColumns = _usedColumns;
     std::wstring unistr;
     unistr.reserve(numberOfColumns);
@@ -1958,7 +2047,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect) {
             bool lineDraw = isLineChar(_image[loc(x,y)]);
             bool doubleWidth =
                     (_image[qMin(loc(x, y) + 1, _imageSize)].character == 0);
-            int charWidth = fm.horizontalAdvance(QString::fromWCharArray((wchar_t *)&c, 1));
+            int charWidth = _charWidth->font_advance(c);
             bool bigWidth = _fixedFont && !doubleWidth && charWidth > _fontWidth;
             bool tooWide = bigWidth && charWidth >= 2 * _fontWidth;
             bool smallWidth = _fixedFont && c && charWidth < _fontWidth;
@@ -1975,7 +2064,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect) {
                         _image[loc(x + len, y)].rendition == currentRendition &&
                         (nxtDoubleWidth = (_image[qMin(loc(x+len,y)+1,_imageSize)].character == 0)) == doubleWidth &&
                         !smallWidth &&
-                        !(_fixedFont && (nxtC = _image[loc(x+len,y)].character) && (nxtCharWidth = fm.horizontalAdvance(QString::fromWCharArray((const wchar_t *)(&nxtC), 1))) < _fontWidth) &&
+                        !(_fixedFont && (nxtC = _image[loc(x+len,y)].character) && (nxtCharWidth = _charWidth->font_advance(nxtC)) < _fontWidth) &&
                         !bigWidth &&
                         !(_fixedFont && !nxtDoubleWidth && nxtC && nxtCharWidth > _fontWidth) &&
                         isLineChar(_image[loc(x+len,y)]) == lineDraw) // Assignment!
@@ -2147,16 +2236,16 @@ void TerminalDisplay::updateImageSize() {
 
 // showEvent and hideEvent are reimplemented here so that it appears to other
 // classes that the display has been resized when the display is hidden or
-// shown.
-//
-// TODO: Perhaps it would be better to have separate signals for show and hide
-// instead of using the same signal as the one for a content size change
+// shown.  visibilityChanged() is emitted as well for classes which only care
+// about the visibility.
 void TerminalDisplay::showEvent(QShowEvent *) {
     emit changedContentSizeSignal(_contentHeight, _contentWidth);
+    emit visibilityChanged(true);
 }
 
 void TerminalDisplay::hideEvent(QHideEvent *) {
     emit changedContentSizeSignal(_contentHeight, _contentWidth);
+    emit visibilityChanged(false);
 }
 
 void TerminalDisplay::scrollBarPositionChanged(int) {
@@ -3097,33 +3186,40 @@ void TerminalDisplay::emitSelection(bool useXselection, bool appendReturn) {
     QString text = QApplication::clipboard()->text(
             useXselection ? QClipboard::Selection : QClipboard::Clipboard);
     if (!text.isEmpty()) {
-        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
-        text.replace(QLatin1Char('\n'), QLatin1Char('\r'));
-
-        if (_trimPastedTrailingNewlines) {
-            static const QRegularExpression regexp{u"\\r+$"_s};
-            text.replace(regexp, QString());
-        }
-
-        if (_confirmMultilinePaste && text.contains(QLatin1Char('\r'))) {
+        if (_confirmMultilinePaste && PasteStream::isMultiline(text, _trimPastedTrailingNewlines)) {
+            // the confirmation shows the text as it will be sent
+            text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+            text.replace(QLatin1Char('\n'), QLatin1Char('\r'));
+            if (_trimPastedTrailingNewlines) {
+                static const QRegularExpression regexp{u"\\r+$"_s};
+                text.replace(regexp, QString());
+            }
             if (!multilineConfirmation(text)) {
                 return;
             }
         }
 
-        bracketText(text);
+        cancelPaste();
 
-        // appendReturn is intentionally handled _after_ enclosing texts with
-        // brackets as that feature is used to allow execution of commands
+        // appendReturn is handled _after_ enclosing texts with brackets, see
+        // PasteStream, as that feature is used to allow execution of commands
         // immediately after paste. Ref: https://bugs.kde.org/show_bug.cgi?id=16179
         // Ref:
         // https://github.com/KDE/konsole/commit/83d365f2ebfe2e659c1e857a2f5f247c556ab571
-        if (appendReturn) {
-            text.append(QLatin1Char('\r'));
-        }
-
-        QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, text);
-        emit keyPressedSignal(&e, true); // expose as a big fat keypress event
+        _pasteStream = new PasteStream(text, bracketedPasteMode() && !_disabledBracketedPasteMode,
+                                       _trimPastedTrailingNewlines, appendReturn, this);
+        _pasteStream->setBacklog(_inputBacklog);
+        connect(_pasteStream, &PasteStream::chunkReady, this, [this](const QString &chunk) {
+            QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, chunk);
+            emit keyPressedSignal(&e, true); // expose as a big fat keypress event
+        });
+        connect(_pasteStream, &PasteStream::progress, this, &TerminalDisplay::pasteProgress);
+        connect(_pasteStream, &PasteStream::finished, this, [this](bool cancelled) {
+            _pasteStream->deleteLater();
+            _pasteStream = nullptr;
+            emit pasteFinished(cancelled);
+        });
+        _pasteStream->start();
 
         _screenWindow->clearSelection();
 
@@ -3145,6 +3241,11 @@ void TerminalDisplay::emitSelection(bool useXselection, bool appendReturn) {
     }
 }
 
+void TerminalDisplay::cancelPaste() {
+    if (_pasteStream)
+        _pasteStream->cancel();
+}
+
 void TerminalDisplay::bracketText(QString &text) const {
     if (bracketedPasteMode() && !_disabledBracketedPasteMode) {
         text.prepend(QLatin1String("\033[200~"));
@@ -3448,6 +3549,7 @@ void TerminalDisplay::makeImage() {
     // certain boundary conditions: _image[_imageSize] is a valid but unused
     // position
     _image = new Character[_imageSize + 1];
+    _imageNeedsFullUpdate = true;
 
     clearImage();
 }
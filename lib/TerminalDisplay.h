@@ -41,6 +41,9 @@
 #include "Filter.h"
 #include "Character.h"
 #include "CharWidth.h"
+#include "GlyphCache.h"
+#include "PasteStream.h"
+#include "TerminalStatistics.h"
 #include "qtermwidget.h"
 //#include "qsourcehighliter.h"
 
@@ -163,6 +166,14 @@ public:
      */
     void processFilters();
 
+    /**
+     * Returns the paint and filter counters since the last resetStatistics().
+     * They are only collected when the library is built with
+     * QTERMWIDGET_STATISTICS, see TerminalStatistics.
+     */
+    const TerminalStatistics &statistics() const { return _statistics; }
+    void resetStatistics() { _statistics = TerminalStatistics(); }
+
     /**
      * Returns a list of menu actions created by the filters for the content
      * at the given @p position.
@@ -202,8 +213,23 @@ public:
     int margin() const;
     uint lineSpacing() const;
 
+    /**
+     * Pastes the clipboard or the X selection.  Large texts are sent in
+     * chunks from the event loop, see PasteStream; a paste which is still
+     * running is cancelled first.
+     */
     void emitSelection(bool useXselection,bool appendReturn);
 
+    /** Returns true while a paste is being sent. */
+    bool isPasting() const { return _pasteStream != nullptr; }
+
+    /**
+     * Sets a function returning the number of bytes sent with
+     * keyPressedSignal() which the pty has not taken yet.  Pastes wait while
+     * it is large, see PasteStream::setBacklog().
+     */
+    void setInputBacklog(const std::function<qint64()>& backlog) { _inputBacklog = backlog; }
+
     /** change and wrap text corresponding to paste mode **/
     void bracketText(QString& text) const;
 
@@ -406,6 +432,18 @@ public:
      */
     bool isBidiEnabled() { return _bidiEnabled; }
 
+    /**
+     * Enables or disables drawing text from a cache of pre-rendered glyphs.
+     * Runs of simple left-to-right characters are then composed from glyph
+     * images which are rasterized once, everything else is still drawn with
+     * QPainter::drawText().  Defaults to disabled.
+     */
+    void setGlyphCacheEnabled(bool enabled);
+    /**
+     * Returns true if text is drawn from the glyph cache.
+     */
+    bool isGlyphCacheEnabled() const { return _glyphCache != nullptr; }
+
     /**
      * Sets the terminal screen section which is displayed in this widget.
      * When updateImage() is called, the display fetches the latest character image from the
@@ -474,6 +512,8 @@ public slots:
      * display.
      */
     void pasteSelection();
+    /** Stops sending the paste in progress, if any. */
+    void cancelPaste();
 
     /**
      * Selects all of the text in the display.
@@ -600,6 +640,9 @@ signals:
     void changedContentSizeSignal(int height, int width);
     void changedContentCountSignal(int line, int column);
 
+    /** Emitted when the display is shown (@p visible is true) or hidden. */
+    void visibilityChanged(bool visible);
+
     /**
      * Emitted when the user right clicks on the display, or right-clicks with the Shift
      * key held down if usesMouse() is true.
@@ -632,6 +675,11 @@ signals:
 
     void handleCtrlC(void);
 
+    /** Emitted as a paste is sent, with the number of characters sent and to send. */
+    void pasteProgress(qint64 sent, qint64 total);
+    /** Emitted when a paste has been sent, or was cancelled. */
+    void pasteFinished(bool cancelled);
+
 protected:
     bool event( QEvent * ) override;
 
@@ -796,6 +844,7 @@ private:
     QGridLayout* _gridLayout;
 
     CharWidth *_charWidth;
+    GlyphCache *_glyphCache = nullptr;
     bool _fixedFont; // has fixed pitch
     bool _fixedFont_original; // used only in textWidth()
     int  _fontHeight;     // height
@@ -825,6 +874,8 @@ private:
                // only the area [usedLines][usedColumns] in the image contains valid data
 
     int _imageSize;
+    bool _imageNeedsFullUpdate = true; // _image was rebuilt or scrolled since the last updateImage()
+    QVector<bool> _lineHasBlinker;     // [lines], lines of _image containing blinking text
     QVector<LineProperty> _lineProperties;
 
     ColorEntry _colorTable[TABLE_COLORS];
@@ -906,6 +957,7 @@ private:
     // list of filters currently applied to the display.  used for links and
     // search highlight
     TerminalImageFilterChain* _filterChain;
+    TerminalStatistics _statistics;
     QRegion _mouseOverHotspotArea;
 
     QTermWidget::KeyboardCursorShape _cursorShape;
@@ -918,6 +970,8 @@ private:
     MotionAfterPasting mMotionAfterPasting;
     bool _confirmMultilinePaste = true;
     bool _trimPastedTrailingNewlines = true;
+    PasteStream* _pasteStream = nullptr;
+    std::function<qint64()> _inputBacklog;
 
     struct InputMethodData
     {
@@ -23,8 +23,6 @@
 #include <cstdio>
 #include <string>
 
-#include <QApplication>
-#include <QClipboard>
 #include <QDebug>
 #include <QDir>
 #include <QEvent>
@@ -33,9 +31,10 @@
 
 #include "KeyboardTranslator.h"
 #include "Screen.h"
+#include "TerminalClipboard.h"
 
 Vt102Emulation::Vt102Emulation()
-        : Emulation(), prevCC(0), _titleUpdateTimer(new QTimer(this)),
+        : Emulation(), _titleUpdateTimer(new QTimer(this)),
             _reportFocusEvents(false), _toUtf8(QStringEncoder::Utf8),
             _isTitleChanged(false) {
     _titleUpdateTimer->setSingleShot(true);
@@ -44,14 +43,19 @@ Vt102Emulation::Vt102Emulation()
     reset();
 }
 
-Vt102Emulation::~Vt102Emulation() {}
+Vt102Emulation::~Vt102Emulation() {
+    // the parser thread must not run into the destroyed parts of the object
+    setThreadedEnabled(false);
+}
 
 void Vt102Emulation::clearEntireScreen() {
+    QMutexLocker locker(stateLock());
     _currentScreen->clearEntireScreen();
     bufferedUpdate();
 }
 
 void Vt102Emulation::reset() {
+    QMutexLocker locker(stateLock());
     resetTokenizer();
     resetModes();
     resetCharset(0);
@@ -147,9 +151,19 @@ void Vt102Emulation::reset() {
 
 /* The tokenizer's state
 
-     The state is represented by the buffer (tokenBuffer, tokenBufferPos),
-     and accompanied by decoded arguments kept in (argv,argc).
-     Note that they are kept internal in the tokenizer.
+     The tokenizer is an explicit state machine after the DEC/ECMA-48 parser
+     described by Paul Williams (https://vt100.net/emu/dec_ansi_parser).
+     Every incoming character is mapped to a character class, and the pair
+     (state, class) selects an action and the next state from a table which
+     is set up once by initTokenizer().  The cost per character is therefore
+     constant, no matter how long the sequence scanned so far is.
+
+     The parameters of a sequence are decoded into (argv,argc) as they
+     arrive, together with its first intermediate and private marker
+     character.  The raw sequence is kept in (tokenBuffer, tokenBufferPos)
+     for error reports only.  The text of OSC strings is collected in
+     _oscBuffer, while DCS, SOS, PM and APC strings are skipped without
+     being stored.
 */
 
 void Vt102Emulation::resetTokenizer() {
@@ -157,7 +171,9 @@ void Vt102Emulation::resetTokenizer() {
     argc = 0;
     argv[0] = 0;
     argv[1] = 0;
-    prevCC = 0;
+    _intermediate = 0;
+    _privateMarker = 0;
+    _parserState = Ground;
 }
 
 void Vt102Emulation::addDigit(int digit) {
@@ -175,305 +191,408 @@ void Vt102Emulation::addToCurrentToken(wchar_t cc) {
     tokenBufferPos = qMin(tokenBufferPos + 1, MAX_TOKEN_LENGTH - 1);
 }
 
-// Character Class flags used while decoding
-#define CTL 1  // Control character
-#define CHR 2  // Printable character
-#define CPN 4  // TODO: Document me
-#define DIG 8  // Digit
-#define SCS 16 // TODO: Document me
-#define GRP 32 // TODO: Document me
-#define CPS 64 // Character which indicates end of window resize
-               // escape sequence '\e[8;<row>;<col>t'
+#define CNTL(c)      ((c) - '@')
+#define ESC 27
+#define DEL 127
+
+void Vt102Emulation::setTransition(int state, int cls, int action, int nextState) {
+    _transitions[state][cls].action = action;
+    _transitions[state][cls].nextState = nextState;
+}
 
 void Vt102Emulation::initTokenizer() {
     int i;
     quint8 *s;
-    for (i = 0; i < 256; ++i)
-        charClass[i] = 0;
+
+    // character classes of the C0 controls, ASCII and the C1 controls.
+    // everything above is ClassText
     for (i = 0; i < 32; ++i)
-        charClass[i] |= CTL;
-    for (i = 32; i < 256; ++i)
-        charClass[i] |= CHR;
-    for (s = (quint8 *)"@ABCDEFGHILMPSTXZbcdfry"; *s; ++s)
-        charClass[*s] |= CPN;
-    // resize = \e[8;<row>;<col>t
-    for (s = (quint8 *)"t"; *s; ++s)
-        charClass[*s] |= CPS;
-    for (s = (quint8 *)"0123456789"; *s; ++s)
-        charClass[*s] |= DIG;
-    for (s = (quint8 *)"()+*%"; *s; ++s)
-        charClass[*s] |= SCS;
-    for (s = (quint8 *)"()+*#[]%"; *s; ++s)
-        charClass[*s] |= GRP;
+        charClass[i] = ClassControl;
+    charClass[7] = ClassBell;
+    charClass[CNTL('X')] = ClassCancel;
+    charClass[CNTL('Z')] = ClassCancel;
+    charClass[ESC] = ClassEscape;
+    for (i = 0x20; i < 0x30; ++i)
+        charClass[i] = ClassIntermediate;
+    for (i = '0'; i <= '9'; ++i)
+        charClass[i] = ClassDigit;
+    charClass[':'] = ClassSeparator;
+    charClass[';'] = ClassSeparator;
+    for (i = 0x3c; i < 0x40; ++i)
+        charClass[i] = ClassMarker;
+    for (i = 0x40; i < DEL; ++i)
+        charClass[i] = ClassFinal;
+    charClass['['] = ClassCsiIntroducer;
+    charClass[']'] = ClassOscIntroducer;
+    for (s = (quint8 *)"PX^_"; *s; ++s)
+        charClass[*s] = ClassStringIntroducer;
+    charClass[DEL] = ClassDelete;
+    for (i = 0x80; i < 0xa0; ++i)
+        charClass[i] = ClassText;
+    charClass[0x9b] = ClassC1Csi;
+    charClass[0x9c] = ClassC1StringTerminator;
+
+    // transitions which apply in every state: control characters are
+    // executed even in the middle of a sequence (as on a VT100), ESC starts
+    // a new sequence, CAN and SUB abort the current one and DEL is ignored
+    for (int state = 0; state < ParserStateCount; ++state) {
+        for (i = 0; i < CharClassCount; ++i)
+            setTransition(state, i, ActionIgnore, state);
+        setTransition(state, ClassControl, ActionExecute, state);
+        setTransition(state, ClassBell, ActionExecute, state);
+        setTransition(state, ClassCancel, ActionCancel, Ground);
+        setTransition(state, ClassEscape, ActionEscape, Escape);
+        setTransition(state, ClassC1Csi, ActionCsiEntry, CsiEntry);
+        setTransition(state, ClassC1StringTerminator, ActionIgnore, Ground);
+    }
+
+    // the printable classes, except for the ones starting a sequence
+    const int printable[] = { ClassIntermediate, ClassDigit, ClassSeparator, ClassMarker,
+                              ClassFinal, ClassCsiIntroducer, ClassOscIntroducer,
+                              ClassStringIntroducer, ClassText };
+
+    for (int c : printable)
+        setTransition(Ground, c, ActionPrint, Ground);
+
+    setTransition(Escape, ClassIntermediate, ActionCollect, EscapeIntermediate);
+    setTransition(Escape, ClassDigit, ActionEscDispatch, Ground);
+    setTransition(Escape, ClassSeparator, ActionEscDispatch, Ground);
+    setTransition(Escape, ClassMarker, ActionEscDispatch, Ground);
+    setTransition(Escape, ClassFinal, ActionEscDispatch, Ground);
+    setTransition(Escape, ClassCsiIntroducer, ActionCsiEntry, CsiEntry);
+    setTransition(Escape, ClassOscIntroducer, ActionOscStart, OscString);
+    setTransition(Escape, ClassStringIntroducer, ActionIgnore, StringIgnore);
+    setTransition(Escape, ClassText, ActionIgnore, Ground);
+
+    for (int c : printable)
+        setTransition(EscapeIntermediate, c, ActionEscDispatch, Ground);
+    setTransition(EscapeIntermediate, ClassIntermediate, ActionCollect, EscapeIntermediate);
+    setTransition(EscapeIntermediate, ClassText, ActionIgnore, Ground);
+
+    for (int c : printable)
+        setTransition(CsiEntry, c, ActionCsiDispatch, Ground);
+    setTransition(CsiEntry, ClassIntermediate, ActionCollect, CsiIntermediate);
+    setTransition(CsiEntry, ClassDigit, ActionParam, CsiParam);
+    setTransition(CsiEntry, ClassSeparator, ActionSeparator, CsiParam);
+    setTransition(CsiEntry, ClassMarker, ActionMarker, CsiParam);
+    setTransition(CsiEntry, ClassText, ActionIgnore, Ground);
+
+    // per ECMA-48, bytes 0x3C-0x3F (< = > ?) are valid CSI parameter bytes.
+    // after the private-marker position they are skipped, which handles
+    // sequences like ESC[2:=z
+    for (int c : printable)
+        setTransition(CsiParam, c, ActionCsiDispatch, Ground);
+    setTransition(CsiParam, ClassIntermediate, ActionCollect, CsiIntermediate);
+    setTransition(CsiParam, ClassDigit, ActionParam, CsiParam);
+    setTransition(CsiParam, ClassSeparator, ActionSeparator, CsiParam);
+    setTransition(CsiParam, ClassMarker, ActionIgnore, CsiParam);
+    setTransition(CsiParam, ClassText, ActionIgnore, Ground);
+
+    for (int c : printable)
+        setTransition(CsiIntermediate, c, ActionCsiDispatch, Ground);
+    setTransition(CsiIntermediate, ClassIntermediate, ActionCollect, CsiIntermediate);
+    setTransition(CsiIntermediate, ClassDigit, ActionIgnore, CsiIgnore);
+    setTransition(CsiIntermediate, ClassSeparator, ActionIgnore, CsiIgnore);
+    setTransition(CsiIntermediate, ClassMarker, ActionIgnore, CsiIgnore);
+    setTransition(CsiIntermediate, ClassText, ActionIgnore, Ground);
+
+    setTransition(CsiIgnore, ClassFinal, ActionIgnore, Ground);
+    setTransition(CsiIgnore, ClassCsiIntroducer, ActionIgnore, Ground);
+    setTransition(CsiIgnore, ClassOscIntroducer, ActionIgnore, Ground);
+    setTransition(CsiIgnore, ClassStringIntroducer, ActionIgnore, Ground);
+
+    // OSC strings are terminated by BEL or ST (either ESC '\' or 0x9c).
+    // other control characters are ignored in the text part of an OSC
+    // string; this matches what XTERM docs say
+    for (int c : printable)
+        setTransition(OscString, c, ActionOscPut, OscString);
+    setTransition(OscString, ClassC1Csi, ActionOscPut, OscString);
+    setTransition(OscString, ClassControl, ActionIgnore, OscString);
+    setTransition(OscString, ClassBell, ActionOscEnd, Ground);
+    setTransition(OscString, ClassEscape, ActionOscEndEscape, Escape);
+    setTransition(OscString, ClassC1StringTerminator, ActionOscEnd, Ground);
+
+    // DCS, SOS, PM and APC strings are not supported and skipped up to ST
+    setTransition(StringIgnore, ClassControl, ActionIgnore, StringIgnore);
+    setTransition(StringIgnore, ClassBell, ActionIgnore, StringIgnore);
+    setTransition(StringIgnore, ClassC1Csi, ActionIgnore, StringIgnore);
+
+    // VT52 mode: <ESC><Chr> and <ESC>'Y'{Pc}{Pc}
+    for (int c : printable) {
+        setTransition(Vt52Escape, c, ActionVt52Dispatch, Ground);
+        setTransition(Vt52CursorRow, c, ActionVt52Row, Vt52CursorColumn);
+        setTransition(Vt52CursorColumn, c, ActionVt52Column, Ground);
+    }
 
     resetTokenizer();
 }
 
-/* Ok, here comes the nasty part of the decoder.
-
-     Instead of keeping an explicit state, we deduce it from the
-     token scanned so far. It is then immediately combined with
-     the current character to form a scanning decision.
-
-     This is done by the following defines.
+/*
+   Performs the action of a transition.  The parser is already in the
+   transition's target state, which some actions refine further.
+*/
+void Vt102Emulation::performAction(int action, wchar_t cc) {
+    switch (action) {
+    case ActionIgnore:
+        break;
+    case ActionPrint:
+        processToken(TY_CHR(), getMode(MODE_Ansi) ? applyCharset(cc) : cc, 0);
+        break;
+    case ActionExecute:
+        processToken(TY_CTL(cc + '@'), 0, 0);
+        break;
+    case ActionCancel:
+        // VT100: CAN or SUB
+        resetTokenizer();
+        processToken(TY_CTL(cc + '@'), 0, 0);
+        break;
+    case ActionEscape:
+        resetTokenizer();
+        addToCurrentToken(cc);
+        _parserState = getMode(MODE_Ansi) ? Escape : Vt52Escape;
+        break;
+    case ActionCollect:
+        addToCurrentToken(cc);
+        if (_intermediate == 0)
+            _intermediate = cc;
+        break;
+    case ActionMarker:
+        addToCurrentToken(cc);
+        _privateMarker = cc;
+        break;
+    case ActionParam:
+        addToCurrentToken(cc);
+        addDigit(cc - '0');
+        break;
+    case ActionSeparator:
+        addToCurrentToken(cc);
+        addArgument();
+        break;
+    case ActionEscDispatch:
+        addToCurrentToken(cc);
+        dispatchEscape(cc);
+        resetTokenizer();
+        break;
+    case ActionCsiEntry:
+        if (cc != '[') {
+            // 8-bit CSI
+            resetTokenizer();
+            addToCurrentToken(ESC);
+            cc = '[';
+        }
+        addToCurrentToken(cc);
+        _parserState = CsiEntry;
+        break;
+    case ActionCsiDispatch:
+        addToCurrentToken(cc);
+        dispatchCsi(cc);
+        resetTokenizer();
+        break;
+    case ActionOscStart:
+        addToCurrentToken(cc);
+        _oscBuffer.resize(0);
+        break;
+    case ActionOscPut:
+        if (_oscBuffer.size() < MAX_OSC_LENGTH)
+            _oscBuffer.append(cc);
+        break;
+    case ActionOscEnd:
+        processOSC();
+        resetTokenizer();
+        break;
+    case ActionOscEndEscape:
+        // xterm treats an ESC as the end of the string, '\' is then
+        // dropped as the second half of ST
+        processOSC();
+        performAction(ActionEscape, cc);
+        break;
+    case ActionVt52Dispatch:
+        addToCurrentToken(cc);
+        if (cc == 'Y') {
+            _parserState = Vt52CursorRow;
+        } else {
+            processToken(TY_VT52(cc), 0, 0);
+            resetTokenizer();
+        }
+        break;
+    case ActionVt52Row:
+        addToCurrentToken(cc);
+        _vt52Row = cc;
+        break;
+    case ActionVt52Column:
+        addToCurrentToken(cc);
+        processToken(TY_VT52('Y'), _vt52Row, cc);
+        resetTokenizer();
+        break;
+    }
+}
 
-     - P is the length of the token scanned so far.
-     - L (often P-1) is the position on which contents we base a decision.
-     - C is a character or a group of characters (taken from 'charClass').
+void Vt102Emulation::dispatchEscape(wchar_t cc) {
+    switch (_intermediate) {
+    case 0:
+        // ESC '\' is ST, ending a string which has already been handled
+        if (cc != '\\')
+            processToken(TY_ESC(cc), 0, 0);
+        break;
+    case '(':
+    case ')':
+    case '+':
+    case '*':
+    case '%':
+        processToken(TY_ESC_CS(_intermediate, cc), 0, 0);
+        break;
+    case '#':
+        processToken(TY_ESC_DE(cc), 0, 0);
+        break;
+    default:
+        reportDecodingError();
+        break;
+    }
+}
 
-     - 'cc' is the current character
-     - 's' is a pointer to the start of the token buffer
-     - 'p' is the current position within the token buffer
+void Vt102Emulation::dispatchCsi(wchar_t cc) {
+    if (_intermediate == '!') {
+        processToken(TY_CSI_PE(cc), 0, 0);
+        return;
+    }
+    if (_intermediate == ' ' && cc == 'q') {
+        processToken(TY_CSI_PS_SP(cc, argv[0]), argv[0], 0);
+        return;
+    }
+    if (_intermediate != 0 && _privateMarker != '<' && _privateMarker != '=') {
+        reportDecodingError();
+        return;
+    }
 
-     Note that they need to applied in proper order.
-*/
+    switch (_privateMarker) {
+    case '<':
+        // e.g. SGR mouse reporting: CSI < ... M/m
+        processToken(TY_CSI_PL(cc), 0, 0);
+        return;
+    case '=':
+        // e.g. Kitty keyboard protocol: CSI = ... u
+        processToken(TY_CSI_PQ(cc), 0, 0);
+        return;
+    case '?':
+        for (int i = 0; i <= argc; i++)
+            processToken(TY_CSI_PR(cc, argv[i]), 0, 0);
+        return;
+    case '>':
+        for (int i = 0; i <= argc; i++)
+            processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
+        return;
+    default:
+        break;
+    }
 
-#define lec(P, L, C) (p == (P) && s[(L)] == (C))
-#define lun()        (p == 1 && cc >= 32)
-#define les(P, L, C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)       (p >= 3 && cc == (C))
-#define ees(C)       (p >= 3 && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)       (p >= 3 && s[2] != '?' && s[2] != '!' && s[2] != '<' && s[2] != '=' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp()        (p >= 3 && s[2] == '?')
-#define epe()        (p >= 3 && s[2] == '!')
-#define elt( )       (p >= 3 && s[2] == '<')
-#define eeq( )       (p >= 3 && s[2] == '=')
-#define egt()        (p >= 3 && s[2] == '>')
-#define esp()        (p == 4 && s[3] == ' ')
-#define Xpe          (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte          (Xpe && (cc == 7 || (prevCC == 27 && cc == 92))) // 27, 92 => "\e\\" (ST, String Terminator)
-#define ces(C)       (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
+    switch (cc) {
+    // sequences taking (at most) two numeric arguments in a single token
+    case '@': case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
+    case 'G': case 'H': case 'I': case 'L': case 'M': case 'P': case 'S':
+    case 'T': case 'X': case 'Z': case 'b': case 'c': case 'd': case 'f':
+    case 'r': case 'y':
+        processToken(TY_CSI_PN(cc), argv[0], argv[1]);
+        return;
+    case 't':
+        // resize = \e[8;<row>;<col>t
+        processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+        return;
+    default:
+        break;
+    }
 
-#define CNTL(c)      ((c) - '@')
-#define ESC 27
-#define DEL 127
+    for (int i = 0; i <= argc; i++) {
+        if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) &&
+                argv[i + 1] == 2) {
+            // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ...
+            // 38;2;<red>;<green>;<blue> ... m
+            i += 2;
+            processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_RGB,
+                                     (argv[i] << 16) | (argv[i + 1] << 8) | argv[i + 2]);
+            i += 2;
+        } else if (cc == 'm' && argc - i >= 2 &&
+                             (argv[i] == 38 || argv[i] == 48) && argv[i + 1] == 5) {
+            // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
+            i += 2;
+            processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_256, argv[i]);
+        } else
+            processToken(TY_CSI_PS(cc, argv[i]), 0, 0);
+    }
+}
 
 // process an incoming unicode character
 void Vt102Emulation::receiveChar(wchar_t cc) {
     if ((cc == L'\r') || (cc == L'\n'))
         dupDisplayCharacter(cc);
-    if (cc == DEL)
-        return; // VT100: ignore.
-
-    if (ces(CTL)) {
-        // ignore control characters in the text part of Xpe (aka OSC) "ESC]"
-        // escape sequences; this matches what XTERM docs say
-        if (Xpe) {
-            prevCC = cc;
-            return;
-        }
 
-        // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in
-        // VT100 This means, they do neither a resetTokenizer() nor a pushToToken().
-        // Some of them, do of course. Guess this originates from a weakly layered
-        // handling of the X-on X-off protocol, which comes really below this level.
-        if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-            resetTokenizer(); // VT100: CAN or SUB
-        if (cc != ESC) {
-            processToken(TY_CTL(cc + '@'), 0, 0);
-            return;
-        }
-    }
-    // advance the state
-    addToCurrentToken(cc);
+    const quint32 c = static_cast<quint32>(cc);
+    const ParserTransition &transition =
+            _transitions[_parserState][c < 0xa0 ? charClass[c] : ClassText];
 
-    wchar_t *s = tokenBuffer;
-    int p = tokenBufferPos;
-
-    if (getMode(MODE_Ansi)) {
-        if (lec(1, 0, ESC)) {
-            return;
-        }
-        if (lec(1, 0, ESC + 128)) {
-            s[0] = ESC;
-            receiveChar('[');
-            return;
-        }
-        if (les(2, 1, GRP)) {
-            return;
-        }
-        if (Xte) {
-            processOSC();
-            resetTokenizer();
-            return;
-        }
-        if (Xpe) {
-            prevCC = cc;
-            return;
-        }
-        if (lec(3, 2, '?')) {
-            return;
-        }
-        if (lec(3, 2, '>')) {
-            return;
-        }
-        if (lec(3, 2, '!')) {
-            return;
-        }
-        if (lec(3, 2, '<')) { 
-            return; 
-        }
-        if (lec(3, 2, '=')) { 
-            return; 
-        }
-        if (lun()) {
-            processToken(TY_CHR(), applyCharset(cc), 0);
-            resetTokenizer();
-            return;
-        }
-        if (lec(2, 0, ESC)) {
-            processToken(TY_ESC(s[1]), 0, 0);
-            resetTokenizer();
-            return;
-        }
-        if (les(3, 1, SCS)) {
-            processToken(TY_ESC_CS(s[1], s[2]), 0, 0);
-            resetTokenizer();
-            return;
-        }
-        if (lec(3, 1, '#')) {
-            processToken(TY_ESC_DE(s[2]), 0, 0);
-            resetTokenizer();
-            return;
-        }
-        if (eps(CPN)) {
-            processToken(TY_CSI_PN(cc), argv[0], argv[1]);
-            resetTokenizer();
-            return;
-        }
-        if (esp()) {
-            return;
-        }
+    _parserState = static_cast<ParserState>(transition.nextState);
+    performAction(transition.action, cc);
+}
 
-        // CSI with '<' private marker (e.g. SGR mouse reporting: CSI < ... M/m).
-        // Once ESC[< is seen, consume bytes until a CSI final byte (0x40-0x7E).
-        if (elt()) {
-            if (cc >= 0x40 && cc <= 0x7E) {
-                processToken(TY_CSI_PL(cc), 0, 0);
-                resetTokenizer();
-                return;
-            }
-            if (ees(DIG)) { addDigit(cc-'0'); return; }
-            if (eec(';') || eec(':')) { addArgument(); return; }
-            return;
-        }
+/*
+   Fast path for plain text.
 
-        // CSI with '=' private marker (e.g. Kitty keyboard protocol: CSI = ... u).
-        // Once ESC[= is seen, consume bytes until a CSI final byte (0x40-0x7E).
-        if (eeq()) {
-            if (cc >= 0x40 && cc <= 0x7E) {
-                processToken(TY_CSI_PQ(cc), 0, 0);
-                resetTokenizer();
-                return;
+   Between escape sequences (that is, in the ground state) a printable
+   ASCII character always ends up as a single TY_CHR token.  Runs of such
+   characters are therefore passed to the screen in one go instead of being
+   tokenized one by one.  The VT52 mode and the graphic and pound charsets
+   are rare enough to be left to receiveChar().
+*/
+void Vt102Emulation::receiveChars(const wchar_t *chars, int count) {
+    int i = 0;
+    while (i < count) {
+        // looked up on every pass, since each screen has its own charset and
+        // the screen can be switched in the middle of the data
+        const CharCodes &charset = _charset[_currentScreen == _screen[1]];
+        if (_parserState == Ground && getMode(MODE_Ansi) && !charset.graphic &&
+            !charset.pound) {
+            int start = i;
+            while (i < count && chars[i] >= 0x20 && chars[i] < 0x7f)
+                i++;
+
+            if (i > start) {
+                TERMINAL_STATISTIC(_statistics.tokens[TerminalStatistics::CharacterToken] += i - start);
+                _currentScreen->displayCharacters(chars + start, i - start);
+                dupDisplayCharacters(chars + start, i - start);
+                continue;
             }
-            if (ees(DIG)) { addDigit(cc-'0'); return; }
-            if (eec(';') || eec(':')) { addArgument(); return; }
-            return;
-        }
-
-        if (lec(5, 4, 'q') && s[3] == ' ') {
-            processToken(TY_CSI_PS_SP(cc, argv[0]), argv[0], 0);
-            resetTokenizer();
-            return;
-        }
-
-        // resize = \e[8;<row>;<col>t
-        if (eps(CPS)) {
-            processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
-            resetTokenizer();
-            return;
         }
 
-        if (epe()) {
-            processToken(TY_CSI_PE(cc), 0, 0);
-            resetTokenizer();
-            return;
-        }
-        if (ees(DIG)) {
-            addDigit(cc - '0');
-            return;
-        }
-        if (eec(';') || eec(':')) {
-            addArgument();
-            return;
-        }
-
-        // Per ECMA-48, bytes 0x3C-0x3F (< = > ?) are valid CSI parameter bytes.
-        // When they appear after s[2] (the private-marker position), consume them
-        // so they don't fall through to the dispatch loop or get printed.
-        // This handles sequences like ESC[2:=z where '=' appears mid-parameter.
-        if (p >= 4 && cc >= 0x3C && cc <= 0x3F) { 
-            return; 
-        }
-
-        for (int i = 0; i <= argc; i++) {
-            if (epp())
-                processToken(TY_CSI_PR(cc, argv[i]), 0, 0);
-            else if (egt())
-                processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-            else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) &&
-                             argv[i + 1] == 2) {
-                // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ...
-                // 38;2;<red>;<green>;<blue> ... m
-                i += 2;
-                processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_RGB,
-                                         (argv[i] << 16) | (argv[i + 1] << 8) | argv[i + 2]);
-                i += 2;
-            } else if (cc == 'm' && argc - i >= 2 &&
-                                 (argv[i] == 38 || argv[i] == 48) && argv[i + 1] == 5) {
-                // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
-                i += 2;
-                processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_256, argv[i]);
-            } else
-                processToken(TY_CSI_PS(cc, argv[i]), 0, 0);
-        }
-        resetTokenizer();
-    } else {
-        // VT52 Mode
-        if (lec(1, 0, ESC))
-            return;
-        if (les(1, 0, CHR)) {
-            processToken(TY_CHR(), s[0], 0);
-            resetTokenizer();
-            return;
-        }
-        if (lec(2, 1, 'Y'))
-            return;
-        if (lec(3, 1, 'Y'))
-            return;
-        if (p < 4) {
-            processToken(TY_VT52(s[1]), 0, 0);
-            resetTokenizer();
-            return;
-        }
-        processToken(TY_VT52(s[1]), s[2], s[3]);
-        resetTokenizer();
-        return;
+        receiveChar(chars[i++]);
     }
 }
 
 void Vt102Emulation::processOSC() {
-    QString token = QString::fromWCharArray(tokenBuffer, tokenBufferPos);
-    int i = 2;
-    while (i < tokenBufferPos && tokenBuffer[i] != ';')
+    TERMINAL_STATISTIC(_statistics.tokens[TerminalStatistics::OscToken]++);
+
+    // the string has the form {Ps} ';' {Pt}
+    const wchar_t *text = _oscBuffer.constData();
+    const int length = _oscBuffer.size();
+    int i = 0;
+    while (i < length && text[i] != ';')
         i++;
-    if (i == tokenBufferPos) {
+    if (i == length) {
         reportDecodingError();
         return;
     }
 
     int command = -1;
-    switch (i - 1) {
-    case 2:
-        command = tokenBuffer[2] - L'0';
+    switch (i) {
+    case 1:
+        command = text[0] - L'0';
         break;
-    case 3:
-        command = 10 * (tokenBuffer[2] - L'0') + (tokenBuffer[3] - L'0');
+    case 2:
+        command = 10 * (text[0] - L'0') + (text[1] - L'0');
         break;
     default:
         reportDecodingError();
         return;
     }
+    QString value = QString::fromWCharArray(text + i + 1, length - i - 1);
 
     switch (command) {
     /*
@@ -487,9 +606,7 @@ void Vt102Emulation::processOSC() {
     case 1:
     case 2:
     case 7: {
-        QString newValue =
-                QString::fromWCharArray(tokenBuffer + 3 + 1, tokenBufferPos - 3 - 2);
-        processWindowAttributeChange(command, newValue);
+        processWindowAttributeChange(command, value);
         break;
     }
     //  Ps = 52 → Manipulate Selection Data. These controls may be disabled using
@@ -506,30 +623,33 @@ void Vt102Emulation::processOSC() {
          * ? , xterm replies to the host with the selection data encoded using the
          * same protocol.
          */
-        QString arg =
-                QString::fromWCharArray(tokenBuffer + 4 + 1, tokenBufferPos - 4 - 2);
-        QStringList args = arg.split(";", Qt::SkipEmptyParts);
-        auto processOSC52Text = [&](QString base64, QClipboard::Mode mode) {
-            QClipboard *clipboard = QApplication::clipboard();
-            if (base64 == "!") {
-                clipboard->clear(mode);
-            } else {
-                QByteArray data = QByteArray::fromBase64(base64.toUtf8());
-                clipboard->setText(QString::fromUtf8(data), mode);
-            }
-        };
-        if (args.size() == 1 && args.at(0) != "?") {
-            processOSC52Text(args.at(0), QClipboard::Clipboard);
-        } else if (args.size() == 2) {
-            if (args.at(0) == "c" && args.at(1) != "?") {
-                processOSC52Text(args.at(1), QClipboard::Clipboard);
-            }
-            if (QApplication::clipboard()->supportsSelection()) {
-                if (args.at(0) == "p" && args.at(1) != "?") {
-                    processOSC52Text(args.at(1), QClipboard::Selection);
+        // the clipboard may only be used from the GUI thread
+        runInOwnerThread([this, value] {
+            TerminalClipboard *clipboard = _clipboard;
+            if (!clipboard)
+                return;
+            QStringList args = value.split(";", Qt::SkipEmptyParts);
+            auto processOSC52Text = [&](QString base64, TerminalClipboard::Mode mode) {
+                if (base64 == "!") {
+                    clipboard->clear(mode);
+                } else {
+                    QByteArray data = QByteArray::fromBase64(base64.toUtf8());
+                    clipboard->setText(QString::fromUtf8(data), mode);
+                }
+            };
+            if (args.size() == 1 && args.at(0) != "?") {
+                processOSC52Text(args.at(0), TerminalClipboard::Clipboard);
+            } else if (args.size() == 2) {
+                if (args.at(0) == "c" && args.at(1) != "?") {
+                    processOSC52Text(args.at(1), TerminalClipboard::Clipboard);
+                }
+                if (clipboard->supportsSelection()) {
+                    if (args.at(0) == "p" && args.at(1) != "?") {
+                        processOSC52Text(args.at(1), TerminalClipboard::Selection);
+                    }
                 }
             }
-        }
+        });
         break;
     }
     default:
@@ -539,8 +659,10 @@ void Vt102Emulation::processOSC() {
 }
 
 void Vt102Emulation::processWindowAttributeChange(int attributeToChange, QString newValue) {
-    _pendingTitleUpdates[attributeToChange] = newValue;
-    _titleUpdateTimer->start(20);
+    runInOwnerThread([this, attributeToChange, newValue] {
+        _pendingTitleUpdates[attributeToChange] = newValue;
+        _titleUpdateTimer->start(20);
+    });
 }
 
 void Vt102Emulation::updateTitle() {
@@ -640,6 +762,9 @@ void Vt102Emulation::doTitleChanged(int what, const QString &caption) {
 */
 
 void Vt102Emulation::processToken(int token, wchar_t p, int q) {
+    // the type is the lowest byte of the token, see TY_CONSTRUCT
+    TERMINAL_STATISTIC(_statistics.tokens[token & 0xff]++);
+
     switch (token) {
     case TY_CHR():
         _currentScreen->displayCharacter(p);
@@ -1569,10 +1694,20 @@ void Vt102Emulation::clearScreenAndSetColumns(int columnCount) {
 }
 
 void Vt102Emulation::sendString(const char *s, int length) {
-    if (length >= 0)
-        emit sendData(s, length);
-    else
-        emit sendData(s, static_cast<int>(strlen(s)));
+    if (length < 0)
+        length = static_cast<int>(strlen(s));
+
+    // replies to queries made on the parser thread are sent from the owner
+    // thread, by which time 's' is gone
+    if (inParserThread()) {
+        const QByteArray data(s, length);
+        runInOwnerThread([this, data] {
+            emit sendData(data.constData(), data.size());
+        });
+        return;
+    }
+
+    emit sendData(s, length);
 }
 
 void Vt102Emulation::reportCursorPosition() {
@@ -1644,6 +1779,9 @@ void Vt102Emulation::sendMouseEvent(int cb, int cx, int cy, int eventType) {
     if (cx < 1 || cy < 1)
         return;
 
+    // the modes are read under the lock, the command is sent without it
+    QMutexLocker locker(stateLock());
+
     // With the exception of the 1006 mode, button release is encoded in cb.
     // Note that if multiple extensions are enabled, the 1006 is used, so it's
     // okay to check for only that.
@@ -1686,6 +1824,7 @@ void Vt102Emulation::sendMouseEvent(int cb, int cx, int cy, int eventType) {
                          cy + 0x20);
     }
 
+    locker.unlock();
     sendString(command);
 }
 
@@ -1697,7 +1836,12 @@ void Vt102Emulation::sendMouseEvent(int cb, int cx, int cy, int eventType) {
  * sequence into the FocusLost autocmd: https://github.com/sjl/vitality.vim
  */
 void Vt102Emulation::focusLost(void) {
-    if (_reportFocusEvents)
+    bool reportFocusEvents;
+    {
+        QMutexLocker locker(stateLock());
+        reportFocusEvents = _reportFocusEvents;
+    }
+    if (reportFocusEvents)
         sendString("\033[O");
 }
 
@@ -1709,7 +1853,12 @@ void Vt102Emulation::focusLost(void) {
  * sequence into the FocusGained autocmd: https://github.com/sjl/vitality.vim
  */
 void Vt102Emulation::focusGained(void) {
-    if (_reportFocusEvents)
+    bool reportFocusEvents;
+    {
+        QMutexLocker locker(stateLock());
+        reportFocusEvents = _reportFocusEvents;
+    }
+    if (reportFocusEvents)
         sendString("\033[I");
 }
 
@@ -1724,17 +1873,20 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent *event, bool fromPaste) {
     Qt::KeyboardModifiers modifiers = event->modifiers();
     KeyboardTranslator::States states = KeyboardTranslator::NoState;
 
-    // get current states
-    if (getMode(MODE_NewLine))
-        states |= KeyboardTranslator::NewLineState;
-    if (getMode(MODE_Ansi))
-        states |= KeyboardTranslator::AnsiState;
-    if (getMode(MODE_AppCuKeys))
-        states |= KeyboardTranslator::CursorKeysState;
-    if (getMode(MODE_AppScreen))
-        states |= KeyboardTranslator::AlternateScreenState;
-    if (getMode(MODE_AppKeyPad) && (modifiers & Qt::KeypadModifier))
-        states |= KeyboardTranslator::ApplicationKeypadState;
+    // get current states, which the parser thread may be changing
+    {
+        QMutexLocker locker(stateLock());
+        if (getMode(MODE_NewLine))
+            states |= KeyboardTranslator::NewLineState;
+        if (getMode(MODE_Ansi))
+            states |= KeyboardTranslator::AnsiState;
+        if (getMode(MODE_AppCuKeys))
+            states |= KeyboardTranslator::CursorKeysState;
+        if (getMode(MODE_AppScreen))
+            states |= KeyboardTranslator::AlternateScreenState;
+        if (getMode(MODE_AppKeyPad) && (modifiers & Qt::KeypadModifier))
+            states |= KeyboardTranslator::ApplicationKeypadState;
+    }
 
     // check flow control state
     if (modifiers & KeyboardTranslator::CTRL_MOD) {
@@ -1772,7 +1924,11 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent *event, bool fromPaste) {
 #if defined(Q_OS_WIN) || defined(Q_OS_LINUX)
         if (_enableHandleCtrlC && (modifiers & Qt::ControlModifier) &&
                 (event->key() == Qt::Key_C)) {
-            bool isSelection = !_currentScreen->isClearSelection();
+            bool isSelection;
+            {
+                QMutexLocker locker(stateLock());
+                isSelection = !_currentScreen->isClearSelection();
+            }
             if (isSelection) {
                 emit handleCtrlC();
                 return;
@@ -106,6 +106,7 @@ protected:
   void setMode(int mode) override;
   void resetMode(int mode) override;
   void receiveChar(wchar_t cc) override;
+  void receiveChars(const wchar_t* chars, int count) override;
 
 private slots:
   //causes changeTitle() to be emitted for each (int,QString) pair in pendingTitleUpdates
@@ -136,23 +137,98 @@ private:
   // (except MODE_Allow132Columns)
   void resetModes();
 
+  // states of the escape sequence parser
+  enum ParserState {
+    Ground,
+    Escape,
+    EscapeIntermediate,
+    CsiEntry,
+    CsiParam,
+    CsiIntermediate,
+    CsiIgnore,
+    OscString,
+    StringIgnore,       // DCS, SOS, PM and APC strings
+    Vt52Escape,
+    Vt52CursorRow,
+    Vt52CursorColumn,
+    ParserStateCount
+  };
+
+  // classes of incoming characters, as far as the parser is concerned
+  enum CharClass {
+    ClassControl,       // C0 controls not listed below
+    ClassBell,
+    ClassCancel,        // CAN and SUB
+    ClassEscape,
+    ClassIntermediate,  // 0x20 - 0x2f
+    ClassDigit,
+    ClassSeparator,     // ':' and ';'
+    ClassMarker,        // 0x3c - 0x3f
+    ClassFinal,         // 0x40 - 0x7e, except for the introducers below
+    ClassCsiIntroducer,    // '['
+    ClassOscIntroducer,    // ']'
+    ClassStringIntroducer, // 'P', 'X', '^' and '_'
+    ClassDelete,
+    ClassC1Csi,
+    ClassC1StringTerminator,
+    ClassText,          // everything else
+    CharClassCount
+  };
+
+  enum ParserAction {
+    ActionIgnore,
+    ActionPrint,
+    ActionExecute,
+    ActionCancel,
+    ActionEscape,
+    ActionCollect,
+    ActionMarker,
+    ActionParam,
+    ActionSeparator,
+    ActionEscDispatch,
+    ActionCsiEntry,
+    ActionCsiDispatch,
+    ActionOscStart,
+    ActionOscPut,
+    ActionOscEnd,
+    ActionOscEndEscape,
+    ActionVt52Dispatch,
+    ActionVt52Row,
+    ActionVt52Column
+  };
+
+  struct ParserTransition {
+    quint8 action;
+    quint8 nextState;
+  };
+
   void resetTokenizer();
-  #define MAX_TOKEN_LENGTH 100000 // Max length of tokens (e.g. window title)
+  #define MAX_TOKEN_LENGTH 256 // Max length of escape sequences kept for error reports
+  #define MAX_OSC_LENGTH 100000 // Max length of OSC strings (e.g. window title)
   void addToCurrentToken(wchar_t cc);
-  wchar_t tokenBuffer[MAX_TOKEN_LENGTH]; //FIXME: overflow?
+  wchar_t tokenBuffer[MAX_TOKEN_LENGTH];
   int tokenBufferPos;
 #define MAXARGS 15
   void addDigit(int dig);
   void addArgument();
   int argv[MAXARGS];
   int argc;
+  wchar_t _intermediate;  // first intermediate character of the sequence
+  wchar_t _privateMarker; // '<', '=', '>' or '?' directly after CSI
+  wchar_t _vt52Row;
+  QVector<wchar_t> _oscBuffer;
+  ParserState _parserState;
   void initTokenizer();
-  int prevCC;
-
-  // Set of flags for each of the ASCII characters which indicates
-  // what category they fall into (printable character, control, digit etc.)
-  // for the purposes of decoding terminal output
-  int charClass[256];
+  void setTransition(int state, int cls, int action, int nextState);
+  void performAction(int action, wchar_t cc);
+  void dispatchEscape(wchar_t cc);
+  void dispatchCsi(wchar_t cc);
+
+  // character class of each C0 control, ASCII and C1 control character.
+  // all other characters are ClassText
+  quint8 charClass[0xa0];
+  // the parser's action and next state for each state and character class
+  ParserTransition _transitions[ParserStateCount][CharClassCount];
 
   void reportDecodingError();
 
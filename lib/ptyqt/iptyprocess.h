@@ -52,6 +52,17 @@ public:
     virtual void moveToThread(QThread *targetThread) = 0;
     virtual bool hasChildProcess() = 0;
     virtual pidTree_t processInfoTree() = 0;
+    /**
+     * Stops or resumes reading the output of the process.  While reading
+     * is stopped the output waits in the pty, and the process blocks once
+     * the pty is full, so that a slow reader does not lose output.
+     */
+    virtual void setReadingPaused(bool paused) { Q_UNUSED(paused) }
+    /**
+     * Returns the number of bytes accepted by write() which have not been
+     * written to the pty yet, for writers which pace themselves.
+     */
+    virtual qint64 bytesToWrite() { return 0; }
     qint64 pid() { return m_pid; }
     QPair<qint16, qint16> size() { return m_size; }
     const QString lastError() { return m_lastError; }
@@ -2,12 +2,166 @@
 #include <QStandardPaths>
 
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QHash>
 #include <QCoreApplication>
+#include <QMutexLocker>
+
+#include <poll.h>
+#include <sys/uio.h>
+
+#ifdef Q_OS_LINUX
+// Helpers which read the process table from /proc, without running ps
+
+// returns the contents of a small file in /proc; their size is always 0, so
+// QFile::readAll() is used rather than anything relying on it
+static QByteArray readProcFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+// reads the parent of pid, and the command name kept by the kernel, from
+// /proc/<pid>/stat
+static bool readProcessStat(qint64 pid, qint64 *ppid, QByteArray *name)
+{
+    const QByteArray stat = readProcFile(QString("/proc/%1/stat").arg(pid));
+
+    // the command name in parentheses may itself contain spaces and parentheses
+    const int nameStart = stat.indexOf('(');
+    const int nameEnd = stat.lastIndexOf(')');
+    if (nameStart < 0 || nameEnd < nameStart)
+        return false;
+
+    // after the name come the state and then the parent
+    const QList<QByteArray> fields = stat.mid(nameEnd + 2).split(' ');
+    if (fields.size() < 2)
+        return false;
+
+    *ppid = fields.at(1).toLongLong();
+    if (name)
+        *name = stat.mid(nameStart + 1, nameEnd - nameStart - 1);
+    return true;
+}
+
+// fills in the parent and command of pid from /proc/<pid>/stat and cmdline
+static bool readProcessInfo(qint64 pid, IPtyProcess::psInfo_t &info)
+{
+    QByteArray name;
+    if (!readProcessStat(pid, &info.ppid, &name))
+        return false;
+    info.pid = pid;
+
+    const QList<QByteArray> arguments = readProcFile(QString("/proc/%1/cmdline").arg(pid)).split('\0');
+    info.args.clear();
+    if (arguments.isEmpty() || arguments.first().isEmpty())
+    {
+        // kernel threads and zombies have no command line
+        info.command = QString::fromLocal8Bit(name);
+    }
+    else
+    {
+        info.command = QString::fromLocal8Bit(arguments.first());
+        for (int i = 1; i < arguments.size(); i++)
+        {
+            if (i < arguments.size() - 1 || !arguments.at(i).isEmpty())
+                info.args.append(QString::fromLocal8Bit(arguments.at(i)));
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// looks up the children of processes in /proc/<pid>/task/*/children.  If
+// the kernel does not provide those files, /proc is listed once, reading
+// only the parent of every process, and the children are taken from that
+class ChildProcessTable
+{
+public:
+    QList<qint64> children(qint64 pid);
+
+private:
+    enum Source { Unknown, ChildrenFiles, Scan };
+
+    Source m_source = Unknown;
+    QHash<qint64, QList<qint64>> m_children;
+};
+
+QList<qint64> ChildProcessTable::children(qint64 pid)
+{
+    if (m_source == Unknown)
+    {
+        // the files are there for every process or for none; those of this
+        // process tell which
+        const qint64 self = QCoreApplication::applicationPid();
+        m_source = QFile::exists(QString("/proc/%1/task/%1/children").arg(self)) ? ChildrenFiles : Scan;
+
+        if (m_source == Scan)
+        {
+            const QStringList entries = QDir("/proc").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString &entry : entries)
+            {
+                bool ok = false;
+                const qint64 candidate = entry.toLongLong(&ok);
+                qint64 ppid = 0;
+                if (ok && readProcessStat(candidate, &ppid, nullptr))
+                    m_children[ppid].append(candidate);
+            }
+        }
+    }
+
+    if (m_source == Scan)
+        return m_children.value(pid);
+
+    QList<qint64> children;
+    const QString taskPath = QString("/proc/%1/task").arg(pid);
+    const QStringList tasks = QDir(taskPath).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &task : tasks)
+    {
+        const QList<QByteArray> pids = readProcFile(QString("%1/%2/children").arg(taskPath, task)).split(' ');
+        for (const QByteArray &child : pids)
+        {
+            bool ok = false;
+            const qint64 childPid = child.trimmed().toLongLong(&ok);
+            if (ok)
+                children.append(childPid);
+        }
+    }
+    return children;
+}
+
+}
+
+// only the processes in the tree have their command lines read
+static IPtyProcess::pidTree_t processTree(const IPtyProcess::psInfo_t &info, ChildProcessTable &table)
+{
+    IPtyProcess::pidTree_t tree = { info, QList<IPtyProcess::pidTree_t>() };
+
+    const QList<qint64> children = table.children(info.pid);
+    for (qint64 child : children)
+    {
+        IPtyProcess::psInfo_t childInfo;
+        if (readProcessInfo(child, childInfo))
+            tree.children.append(processTree(childInfo, table));
+    }
+    return tree;
+}
+#endif
 
 UnixPtyProcess::UnixPtyProcess()
     : IPtyProcess()
-    , m_readMasterNotify(0)
+    , m_readThread(nullptr)
+    , m_wakePipe{-1, -1}
+    , m_pendingBytes(0)
+    , m_readyReadPosted(false)
+    , m_readingPaused(false)
+    , m_stopReading(false)
+    , m_writeOffset(0)
+    , m_writeNotifier(nullptr)
 {
     m_shellProcess.setWorkingDirectory(QStandardPaths::writableLocation(QStandardPaths::HomeLocation));
 }
@@ -162,57 +316,6 @@ bool UnixPtyProcess::startProcess(const QString &executable,
         return false;
     }
 
-    m_readMasterNotify = new QSocketNotifier(m_shellProcess.m_handleMaster, QSocketNotifier::Read, &m_shellProcess);
-    m_readMasterNotify->setEnabled(true);
-    m_readMasterNotify->moveToThread(m_shellProcess.thread());
-    QObject::connect(m_readMasterNotify, &QSocketNotifier::activated, [this](int socket)
-    {
-        Q_UNUSED(socket)
-
-        QByteArray buffer;
-        const int readSize = 1024;
-        char nativeBuffer[readSize];
-
-        while (true)
-        {
-            int len = ::read(m_shellProcess.m_handleMaster, nativeBuffer, readSize);
-
-            if (len > 0)
-            {
-                buffer.append(nativeBuffer, len);
-
-                if (len < readSize)
-                    break;
-            }
-            else if (len == 0)
-            {
-                // EOF from master side
-                break;
-            }
-            else
-            {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
-                {
-                    // no more data currently available
-                    break;
-                }
-                if (errno == EINTR)
-                {
-                    // interrupted by signal, retry read
-                    continue;
-                }
-                // other errors, stop reading this time
-                break;
-            }
-        }
-
-        if (!buffer.isEmpty())
-        {
-            m_shellReadBuffer.append(buffer);
-            m_shellProcess.emitReadyRead();
-        }
-    });
-
     QStringList defaultVars;
 
     defaultVars.append("TERM=xterm-256color");
@@ -256,6 +359,8 @@ bool UnixPtyProcess::startProcess(const QString &executable,
 
     m_pid = m_shellProcess.processId();
 
+    startReading();
+
     resize(cols, rows);
 
     return true;
@@ -281,6 +386,13 @@ bool UnixPtyProcess::resize(qint16 cols, qint16 rows)
 
 bool UnixPtyProcess::kill()
 {
+    stopReading();
+
+    delete m_writeNotifier;
+    m_writeNotifier = nullptr;
+    m_writeQueue.clear();
+    m_writeOffset = 0;
+
     m_shellProcess.m_handleSlaveName = QString();
     if (m_shellProcess.m_handleSlave >= 0)
     {
@@ -295,9 +407,6 @@ bool UnixPtyProcess::kill()
 
     if (m_shellProcess.state() == QProcess::Running)
     {
-        m_readMasterNotify->disconnect();
-        m_readMasterNotify->deleteLater();
-
         m_shellProcess.terminate();
         m_shellProcess.waitForFinished(1000);
 
@@ -337,32 +446,354 @@ QIODevice *UnixPtyProcess::notifier()
 
 QByteArray UnixPtyProcess::readAll()
 {
-    QByteArray tmpBuffer =  m_shellReadBuffer;
-    m_shellReadBuffer.clear();
-    return tmpBuffer;
+    QMutexLocker locker(&m_readLock);
+
+    // a single buffer, the usual case, is handed out without copying it.
+    // Short reads are packed into the buffers, so more than one is only
+    // queued while the output is not taken as fast as it comes
+    QByteArray data;
+    if (m_readChunks.size() == 1)
+    {
+        data = m_readChunks.first();
+    }
+    else if (m_readChunks.size() > 1)
+    {
+        data.reserve(m_pendingBytes);
+        for (const QByteArray &chunk : std::as_const(m_readChunks))
+            data.append(chunk);
+    }
+
+    // the reader takes the buffers back once the caller lets go of them
+    for (const QByteArray &chunk : std::as_const(m_readChunks))
+    {
+        if (m_readBuffers.size() < MaxReusedBuffers)
+            m_readBuffers.append(chunk);
+    }
+
+    const bool wasFull = readQueueFull();
+    m_readChunks.clear();
+    m_pendingBytes = 0;
+    m_readyReadPosted = false;
+    locker.unlock();
+
+    if (wasFull)
+        wakeReader();
+
+    return data;
+}
+
+bool UnixPtyProcess::readQueueFull() const
+{
+    // the memory of the buffers counts, not only the output in them
+    return qint64(m_readChunks.size()) * ReadChunkSize >= MaxPendingBytes;
+}
+
+void UnixPtyProcess::setReadingPaused(bool paused)
+{
+    m_readingPaused = paused;
+    wakeReader();
+}
+
+void UnixPtyProcess::startReading()
+{
+    if (::pipe(m_wakePipe) != 0)
+    {
+        m_lastError = QString("UnixPty Error: unable to create pipe -> %1").arg(strerror(errno));
+        m_wakePipe[0] = m_wakePipe[1] = -1;
+        return;
+    }
+    for (int fd : m_wakePipe)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    m_stopReading = false;
+    m_readThread = QThread::create([this]() { runReader(); });
+    m_readThread->start();
+}
+
+void UnixPtyProcess::stopReading()
+{
+    if (m_readThread)
+    {
+        m_stopReading = true;
+        wakeReader();
+        m_readThread->wait();
+        delete m_readThread;
+        m_readThread = nullptr;
+    }
+
+    for (int &fd : m_wakePipe)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+    m_readBuffers.clear();
+}
+
+void UnixPtyProcess::wakeReader()
+{
+    if (m_wakePipe[1] >= 0)
+    {
+        const char c = 0;
+        ssize_t rc = ::write(m_wakePipe[1], &c, 1);
+        Q_UNUSED(rc)
+    }
+}
+
+QByteArray UnixPtyProcess::takeReadBuffer()
+{
+    // reuse a buffer which callers of readAll() no longer refer to
+    for (int i = 0; i < m_readBuffers.size(); i++)
+    {
+        if (m_readBuffers.at(i).isDetached())
+        {
+            QByteArray buffer = m_readBuffers.takeAt(i);
+            buffer.resize(ReadChunkSize);
+            return buffer;
+        }
+    }
+
+    return QByteArray(ReadChunkSize, Qt::Uninitialized);
+}
+
+void UnixPtyProcess::runReader()
+{
+    const int masterFd = m_shellProcess.m_handleMaster;
+    QByteArray buffers[2];
+    {
+        QMutexLocker locker(&m_readLock);
+        buffers[0] = takeReadBuffer();
+        buffers[1] = takeReadBuffer();
+    }
+
+    while (!m_stopReading)
+    {
+        bool full;
+        {
+            QMutexLocker locker(&m_readLock);
+            full = readQueueFull();
+        }
+
+        // while reading is paused or the output is not taken, the master
+        // is left alone and the process blocks once the pty is full
+        struct pollfd fds[2];
+        fds[0].fd = (full || m_readingPaused) ? -1 : masterFd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = m_wakePipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[64];
+            while (::read(m_wakePipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+
+        // a burst larger than one buffer goes on into the second one
+        struct iovec iov[2];
+        for (int i = 0; i < 2; i++)
+        {
+            iov[i].iov_base = buffers[i].data();
+            iov[i].iov_len = ReadChunkSize;
+        }
+
+        const ssize_t len = ::readv(masterFd, iov, 2);
+        if (len < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            // EIO once the process and its children have closed the pty
+            break;
+        }
+        if (len == 0)
+        {
+            // EOF from master side
+            break;
+        }
+
+        bool postReadyRead;
+        {
+            QMutexLocker locker(&m_readLock);
+
+            // a short read goes into the free end of the last queued buffer,
+            // which nothing but the queue refers to, so that a flood of
+            // short reads does not queue a mostly empty buffer for each
+            QByteArray *last = m_readChunks.isEmpty() ? nullptr : &m_readChunks.last();
+            if (last && len <= last->capacity() - last->size())
+            {
+                last->append(buffers[0].constData(), len);
+            }
+            else
+            {
+                const int used = len > ReadChunkSize ? 2 : 1;
+                buffers[0].resize(qMin<qint64>(len, ReadChunkSize));
+                if (used == 2)
+                    buffers[1].resize(len - ReadChunkSize);
+
+                // the queued buffers are handed out by readAll() and come
+                // back through m_readBuffers; go on reading into others
+                for (int i = 0; i < used; i++)
+                {
+                    m_readChunks.append(std::move(buffers[i]));
+                    buffers[i] = takeReadBuffer();
+                }
+            }
+
+            m_pendingBytes += len;
+            postReadyRead = !m_readyReadPosted;
+            m_readyReadPosted = true;
+        }
+
+        if (postReadyRead)
+        {
+            QMetaObject::invokeMethod(&m_shellProcess, [this]()
+            {
+                m_shellProcess.emitReadyRead();
+            }, Qt::QueuedConnection);
+        }
+    }
 }
 
 qint64 UnixPtyProcess::write(const QByteArray &byteArray)
 {
-    int result = ::write(m_shellProcess.m_handleMaster, byteArray.constData(), byteArray.size());
-    Q_UNUSED(result)
+    if (m_shellProcess.m_handleMaster < 0)
+        return -1;
+
+    // the master is non-blocking, so whatever the pty does not take now is
+    // queued rather than dropped, and written once there is room
+    qint64 written = 0;
+    if (m_writeQueue.size() == m_writeOffset)
+    {
+        const ssize_t rc = ::write(m_shellProcess.m_handleMaster, byteArray.constData(), byteArray.size());
+        if (rc > 0)
+            written = rc;
+        else if (rc < 0 && errno != EAGAIN && errno != EINTR)
+            return -1;
+    }
+
+    if (written < byteArray.size())
+    {
+        m_writeQueue.append(byteArray.constData() + written, byteArray.size() - written);
+        if (!m_writeNotifier)
+        {
+            m_writeNotifier = new QSocketNotifier(m_shellProcess.m_handleMaster, QSocketNotifier::Write, &m_shellProcess);
+            QObject::connect(m_writeNotifier, &QSocketNotifier::activated, &m_shellProcess, [this]() { flushWrites(); });
+        }
+        m_writeNotifier->setEnabled(true);
+    }
 
     return byteArray.size();
 }
 
+qint64 UnixPtyProcess::bytesToWrite()
+{
+    return m_writeQueue.size() - m_writeOffset;
+}
+
+void UnixPtyProcess::flushWrites()
+{
+    while (m_writeOffset < m_writeQueue.size())
+    {
+        const ssize_t rc = ::write(m_shellProcess.m_handleMaster, m_writeQueue.constData() + m_writeOffset,
+                                   m_writeQueue.size() - m_writeOffset);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && errno != EAGAIN)
+        {
+            // the pty is gone; the queued input can not be written any more,
+            // and further writes fail as well
+            m_lastError = QString("UnixPty Error: unable to write to master -> %1").arg(strerror(errno));
+            break;
+        }
+        if (rc <= 0)
+        {
+            // the pty is full again.  A long paste keeps the queue from
+            // draining, so the part already written is released once it
+            // is large, and at least half of the queue
+            if (m_writeOffset >= WriteQueueCompactSize && m_writeOffset >= m_writeQueue.size() / 2)
+            {
+                m_writeQueue = m_writeQueue.mid(m_writeOffset);
+                m_writeOffset = 0;
+            }
+            return;
+        }
+        m_writeOffset += rc;
+    }
+
+    m_writeQueue.clear();
+    m_writeOffset = 0;
+    m_writeNotifier->setEnabled(false);
+}
+
 QString UnixPtyProcess::currentDir()
 {
+#ifdef Q_OS_LINUX
+    // the working directory of the job in the foreground, else of the shell
+    QList<qint64> pids;
+    if (m_shellProcess.m_handleMaster >= 0)
+    {
+        const pid_t foreground = tcgetpgrp(m_shellProcess.m_handleMaster);
+        if (foreground > 0)
+            pids.append(foreground);
+    }
+    pids.append(m_pid);
+
+    for (qint64 pid : std::as_const(pids))
+    {
+        const QString cwd = QFile::symLinkTarget(QString("/proc/%1/cwd").arg(pid));
+        if (!cwd.isEmpty())
+            return cwd;
+    }
+#endif
     return QDir::currentPath();
 }
 
 bool UnixPtyProcess::hasChildProcess()
 {
+#ifdef Q_OS_LINUX
+    if (m_pid <= 0)
+        return false;
+    // only the direct children are needed, which is cheaper than the tree
+    if (!m_processTreeAge.isValid() || m_processTreeAge.hasExpired(ProcessTreeCacheTime))
+        return !ChildProcessTable().children(m_pid).isEmpty();
+#endif
     pidTree_t pidTree = processInfoTree();
     return (pidTree.children.size() > 0);
 }
 
 UnixPtyProcess::pidTree_t UnixPtyProcess::processInfoTree()
 {
+#ifdef Q_OS_LINUX
+    if (m_processTreeAge.isValid() && !m_processTreeAge.hasExpired(ProcessTreeCacheTime)
+        && m_processTree.pidInfo.pid == m_pid)
+        return m_processTree;
+
+    psInfo_t info = { m_pid, 0, m_shellPath, QStringList() };
+    if (m_pid <= 0)
+        return { info, QList<pidTree_t>() };
+
+    readProcessInfo(m_pid, info);
+    ChildProcessTable table;
+    m_processTree = processTree(info, table);
+    m_processTreeAge.start();
+    return m_processTree;
+#else
     QList<psInfo_t> psInfoList;
     QString cmd("ps");
     QStringList args = { "-o", "pid,ppid,command", "-ax" };
@@ -416,6 +847,7 @@ UnixPtyProcess::pidTree_t UnixPtyProcess::processInfoTree()
         };
     pidTree_t tree = { { m_pid, 0, m_shellPath, QStringList() }, findChild(m_pid) };
     return tree;
+#endif
 }
 
 bool UnixPtyProcess::isAvailable()
@@ -2,9 +2,13 @@
 #define UNIXPTYPROCESS_H
 
 #include "iptyprocess.h"
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QProcess>
 #include <QSocketNotifier>
 
+#include <atomic>
+
 #include <termios.h>
 #include <errno.h>
 #if !defined(Q_OS_ANDROID) && !defined(Q_OS_FREEBSD)
@@ -115,11 +119,59 @@ public:
     virtual pidTree_t processInfoTree();
     static bool isAvailable();
     void moveToThread(QThread *targetThread);
+    virtual void setReadingPaused(bool paused);
+    virtual qint64 bytesToWrite();
+
+    // size of the buffers the master is read into
+    static constexpr int ReadChunkSize = 64 * 1024;
+    // reading stops while the buffers of output not taken by readAll()
+    // hold this much memory
+    static constexpr qint64 MaxPendingBytes = 8 * 1024 * 1024;
+    // the most buffers kept for reuse after readAll() has handed them out
+    static constexpr int MaxReusedBuffers = 16;
+    // the written part of the write queue is released once it is this large
+    static constexpr qint64 WriteQueueCompactSize = 64 * 1024;
+    // how long processInfoTree() returns the same tree, in milliseconds
+    static constexpr int ProcessTreeCacheTime = 500;
 
 private:
+    void startReading();
+    void stopReading();
+    void runReader();
+    void wakeReader();
+    // both need m_readLock to be held
+    QByteArray takeReadBuffer();
+    bool readQueueFull() const;
+    void flushWrites();
+
     ShellProcess m_shellProcess;
-    QSocketNotifier *m_readMasterNotify;
-    QByteArray m_shellReadBuffer;
+
+    // The master is read on m_readThread, which polls it together with the
+    // read end of m_wakePipe.  Output waits in m_readChunks, guarded by
+    // m_readLock, until readAll() takes it.  Short reads are packed into
+    // the last chunk while it has room.
+    QThread *m_readThread;
+    int m_wakePipe[2];
+    QMutex m_readLock;
+    QList<QByteArray> m_readChunks;
+    qint64 m_pendingBytes;
+    bool m_readyReadPosted;
+    std::atomic<bool> m_readingPaused;
+    std::atomic<bool> m_stopReading;
+    // buffers handed out by readAll() are reused once their callers let
+    // go of them; guarded by m_readLock
+    QList<QByteArray> m_readBuffers;
+
+    // Input the pty did not take at once waits in m_writeQueue, from
+    // m_writeOffset on, until m_writeNotifier reports the master writable.
+    // If writing it fails, it is dropped and the error kept in m_lastError.
+    QByteArray m_writeQueue;
+    qint64 m_writeOffset;
+    QSocketNotifier *m_writeNotifier;
+
+    // the result of the last processInfoTree(), see ProcessTreeCacheTime
+    pidTree_t m_processTree;
+    QElapsedTimer m_processTreeAge;
 };
 
 #endif // UNIXPTYPROCESS_H
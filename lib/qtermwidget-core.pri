@@ -0,0 +1,63 @@
+# The terminal emulation without its widgets: the parser, the screens, the
+# history and the pty.  It needs QtCore, QtGui (for QColor and QKeyEvent)
+# and QtNetwork (for the pty), but not QtWidgets, so it can be used in
+# programs without a GUI.  Key bindings are read from the kb-layouts of
+# res.qrc, which the application has to add to its RESOURCES if it sends
+# key events.
+
+include(./ptyqt/ptyqt.pri)
+
+# CONFIG += qtermwidget_statistics collects the counters of
+# QTermWidget::statistics() and the events of its traces
+qtermwidget_statistics {
+    DEFINES += QTERMWIDGET_STATISTICS
+}
+
+INCLUDEPATH += \
+        -I $$PWD/utf8proc \
+        -I $$PWD/util/ \
+        -I $$PWD 
+
+SOURCES += \
+    $$PWD/utf8proc/utf8proc.c \
+    $$PWD/utf8proc/utf8proc_data.c \
+    $$PWD/util/CharWidth.cpp \
+    $$PWD/util/History.cpp \
+    $$PWD/util/HistoryExport.cpp \
+    $$PWD/util/HistoryIndex.cpp \
+    $$PWD/util/HistorySearch.cpp \
+    $$PWD/util/KeyboardTranslator.cpp \
+    $$PWD/util/PasteStream.cpp \
+    $$PWD/util/SessionPlayer.cpp \
+    $$PWD/util/SessionRecorder.cpp \
+    $$PWD/util/SpscRingBuffer.cpp \
+    $$PWD/util/TerminalCharacterDecoder.cpp \
+    $$PWD/util/TerminalStatistics.cpp \
+    $$PWD/util/TraceRecorder.cpp \
+    $$PWD/Emulation.cpp \
+    $$PWD/Vt102Emulation.cpp \
+    $$PWD/Screen.cpp \
+    $$PWD/ScreenWindow.cpp
+
+HEADERS += \
+    $$PWD/utf8proc/utf8proc.h \
+    $$PWD/util/CharWidth.h \
+    $$PWD/util/CharacterColor.h \
+    $$PWD/util/Character.h \
+    $$PWD/util/History.h \
+    $$PWD/util/HistoryExport.h \
+    $$PWD/util/HistoryIndex.h \
+    $$PWD/util/HistorySearch.h \
+    $$PWD/util/KeyboardTranslator.h \
+    $$PWD/util/PasteStream.h \
+    $$PWD/util/SessionPlayer.h \
+    $$PWD/util/SessionRecorder.h \
+    $$PWD/util/SpscRingBuffer.h \
+    $$PWD/util/TerminalCharacterDecoder.h \
+    $$PWD/util/TerminalClipboard.h \
+    $$PWD/util/TerminalStatistics.h \
+    $$PWD/util/TraceRecorder.h \
+    $$PWD/Emulation.h \
+    $$PWD/Vt102Emulation.h \
+    $$PWD/Screen.h \
+    $$PWD/ScreenWindow.h
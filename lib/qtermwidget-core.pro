@@ -0,0 +1,7 @@
+TEMPLATE = lib
+TARGET = qtermwidget-core
+CONFIG += c++17 staticlib
+DEFINES += QT_DEPRECATED_WARNINGS
+QT = core gui network
+
+include(./qtermwidget-core.pri)
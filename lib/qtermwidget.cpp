@@ -16,12 +16,16 @@
  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
  Boston, MA 02110-1301, USA.
 */
+#include <QApplication>
 #include <QLayout>
 #include <QBoxLayout>
 #include <QtDebug>
 #include <QDir>
+#include <QFile>
 #include <QMessageBox>
+#include <QMetaMethod>
 #include <QRegularExpression>
+#include <QScreen>
 
 #include "CharacterColor.h"
 #include "Screen.h"
@@ -31,11 +35,44 @@
 #include "Vt102Emulation.h"
 #include "KeyboardTranslator.h"
 #include "ColorScheme.h"
+#include "HistoryExport.h"
+#include "HistorySearch.h"
 #include "SearchBar.h"
+#include "TerminalClipboard.h"
+#include "TraceRecorder.h"
 #include "qtermwidget.h"
 
 #define QTERMW_HLIGHT "qtermw_hlight"
 
+namespace {
+
+// gives the emulation access to the system clipboard, see Emulation::setClipboard()
+class SystemClipboard : public TerminalClipboard
+{
+public:
+    static QClipboard::Mode toMode(Mode mode)
+    {
+        return mode == Selection ? QClipboard::Selection : QClipboard::Clipboard;
+    }
+
+    void setText(const QString &text, Mode mode) override
+    {
+        QApplication::clipboard()->setText(text, toMode(mode));
+    }
+
+    void clear(Mode mode) override
+    {
+        QApplication::clipboard()->clear(toMode(mode));
+    }
+
+    bool supportsSelection() const override
+    {
+        return QApplication::clipboard()->supportsSelection();
+    }
+};
+
+}
+
 
 QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
     : QWidget(parent) {
@@ -45,6 +82,15 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
 
     m_terminalDisplay = new TerminalDisplay(this);
     m_emulation = new Vt102Emulation();
+    static SystemClipboard systemClipboard;
+    m_emulation->setClipboard(&systemClipboard);
+#ifdef QTERMWIDGET_STATISTICS
+    static int terminalCount = 0;
+    const QString traceName = QStringLiteral("terminal %1").arg(++terminalCount);
+    TraceRecorder::instance()->setTrackName(this, traceName);
+    TraceRecorder::instance()->setTrackName(m_emulation, traceName + QLatin1String(" emulation"));
+    TraceRecorder::instance()->setTrackName(m_terminalDisplay, traceName + QLatin1String(" display"));
+#endif
     m_terminalDisplay->setBellMode(TerminalDisplay::SystemBeepBell);
     m_terminalDisplay->setTerminalSizeHint(true);
     m_terminalDisplay->setTripleClickMode(TerminalDisplay::SelectWholeLine);
@@ -74,6 +120,13 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
     connect(m_terminalDisplay, &TerminalDisplay::changedContentSizeSignal, this, [this](int /*height*/, int /*width*/){
         updateTerminalSize();
     });
+    // pace updates to the screen the display is on and stop them while it is hidden
+    connect(m_terminalDisplay, &TerminalDisplay::visibilityChanged, this, [this](bool visible){
+        QScreen *screen = m_terminalDisplay->screen();
+        if (visible && screen && screen->refreshRate() > 0)
+            m_emulation->setFrameInterval(qRound(1000.0 / screen->refreshRate()));
+        m_emulation->setUpdatesSuspended(!visible);
+    });
 
     setFlowControlEnabled(true);
     m_emulation->setCodec(QStringEncoder{QStringConverter::Encoding::Utf8});
@@ -88,6 +141,8 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
     connect(m_terminalDisplay, &TerminalDisplay::handleCtrlC, this, &QTermWidget::handleCtrlC);
     connect(m_terminalDisplay, &TerminalDisplay::changedContentCountSignal, this, &QTermWidget::termSizeChange);
     connect(m_terminalDisplay, &TerminalDisplay::mousePressEventForwarded, this, &QTermWidget::mousePressEventForwarded);
+    connect(m_terminalDisplay, &TerminalDisplay::pasteProgress, this, &QTermWidget::pasteProgress);
+    connect(m_terminalDisplay, &TerminalDisplay::pasteFinished, this, &QTermWidget::pasteFinished);
     connect(m_emulation, &Emulation::profileChangeCommandReceived, this, &QTermWidget::profileChanged);
     connect(m_emulation, &Emulation::zmodemRecvDetected, this, &QTermWidget::zmodemRecvDetected);
     connect(m_emulation, &Emulation::zmodemSendDetected, this, &QTermWidget::zmodemSendDetected);
@@ -100,6 +155,7 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
         emit sendData(buff, len);
     });
     connect( m_emulation, &Emulation::dupDisplayOutput, this, &QTermWidget::dupDisplayOutput);
+    connect(m_emulation, &Emulation::receiveQueueFull, this, &QTermWidget::receiveQueueFull);
     connect( m_emulation, &Emulation::changeTabTextColorRequest, this, &QTermWidget::changeTabTextColorRequest);
     connect( m_emulation, &Emulation::cursorChanged, this, &QTermWidget::cursorChanged);
 
@@ -109,6 +165,9 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
     m_terminalDisplay->filterChain()->addFilter(m_urlFilter);
     m_UrlFilterEnable = true;
 
+    // added to the filter chain while there are highlighted texts
+    m_highLightFilter = new MultiRegExpFilter();
+
     m_searchBar = new SearchBar(this);
     m_searchBar->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Maximum);
     connect(m_searchBar, &SearchBar::searchCriteriaChanged, this, [this](){
@@ -128,6 +187,10 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
             m_terminalDisplay->filterChain()->removeFilter(regexFilter);
             delete regexFilter;
         }
+        // the output may change until the bar is shown again
+        if (m_countingSearch)
+            m_countingSearch->cancel();
+        m_countedRegExp = QRegularExpression();
     });
 
     QString style_sheet = qApp->styleSheet();
@@ -160,28 +223,45 @@ QTermWidget::QTermWidget(QWidget *messageParentWidget, QWidget *parent)
 }
 
 QTermWidget::~QTermWidget() {
+    // searches running on worker threads read from the emulation
+    qDeleteAll(findChildren<HistorySearch*>(Qt::FindDirectChildrenOnly));
+    qDeleteAll(findChildren<HistoryExport*>(Qt::FindDirectChildrenOnly));
     setUrlFilterEnabled(false);
     clearHighLightTexts();
+    delete m_highLightFilter;
     delete m_urlFilter;
     delete m_searchBar;
     emit destroyed();
     delete m_emulation;
+    TERMINAL_TRACE_REMOVE(this);
 }
 
 void QTermWidget::selectionChanged(bool textSelected) {
     emit copyAvailable(textSelected);
 }
 
+void QTermWidget::searchFinished() {
+#ifdef QTERMWIDGET_STATISTICS
+    m_statistics.searches++;
+    m_statistics.searchTime += m_searchTimer.nsecsElapsed();
+    if (TraceRecorder::instance()->isRecording())
+        TraceRecorder::instance()->addEvent("search", this, m_searchTraceStart);
+#endif
+}
+
 void QTermWidget::search(bool forwards, bool next) {
     int startColumn, startLine;
 
-    if (next) {
-        // search from just after current selection
-        m_terminalDisplay->screenWindow()->screen()->getSelectionEnd(startColumn, startLine);
-        startColumn++;
-    } else {
-        // search from start of current selection
-        m_terminalDisplay->screenWindow()->screen()->getSelectionStart(startColumn, startLine);
+    {
+        QMutexLocker locker(m_emulation->stateLock());
+        if (next) {
+            // search from just after current selection
+            m_terminalDisplay->screenWindow()->screen()->getSelectionEnd(startColumn, startLine);
+            startColumn++;
+        } else {
+            // search from start of current selection
+            m_terminalDisplay->screenWindow()->screen()->getSelectionStart(startColumn, startLine);
+        }
     }
 
     //qDebug() << "current selection starts at: " << startColumn << startLine;
@@ -195,9 +275,29 @@ void QTermWidget::search(bool forwards, bool next) {
     }
     regExp.setPatternOptions(m_searchBar->matchCase() ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
 
+    // A new search replaces the one still running, if any, and the signals
+    // of the old one which are already queued are ignored.  Matches are only
+    // counted again when the pattern changes
+    const bool countMatches = regExp != m_countedRegExp;
+    m_countedRegExp = regExp;
+
+    if (m_historySearch && m_historySearch != m_countingSearch)
+        m_historySearch->cancel();
+    if (m_countingSearch && countMatches)
+        m_countingSearch->cancel();
+
+    TERMINAL_STATISTIC(m_searchTimer.start());
+    TERMINAL_STATISTIC(m_searchTraceStart = TraceRecorder::instance()->now());
+
     HistorySearch *historySearch =
             new HistorySearch(m_emulation, regExp, forwards, startColumn, startLine, this);
-    connect(historySearch, &HistorySearch::matchFound, this, [this](int startColumn, int startLine, int endColumn, int endLine){
+    m_historySearch = historySearch;
+    if (countMatches)
+        m_countingSearch = historySearch;
+    connect(historySearch, &HistorySearch::matchFound, this, [this, historySearch](int startColumn, int startLine, int endColumn, int endLine){
+        if (historySearch != m_historySearch)
+            return;
+        searchFinished();
         ScreenWindow* sw = m_terminalDisplay->screenWindow();
         //qDebug() << "Scroll to" << startLine;
         sw->scrollTo(startLine);
@@ -206,11 +306,40 @@ void QTermWidget::search(bool forwards, bool next) {
         sw->setSelectionStart(startColumn, startLine - sw->currentLine(), false);
         sw->setSelectionEnd(endColumn, endLine - sw->currentLine());
     });
-    connect(historySearch, &HistorySearch::noMatchFound, this, [this](){
+    connect(historySearch, &HistorySearch::noMatchFound, this, [this, historySearch](){
+        if (historySearch != m_historySearch)
+            return;
+        searchFinished();
         m_terminalDisplay->screenWindow()->clearSelection();
+        m_searchBar->noMatchFound();
     });
-    connect(historySearch, &HistorySearch::noMatchFound, m_searchBar, &SearchBar::noMatchFound);
-    historySearch->search();
+    connect(historySearch, &HistorySearch::interrupted, this, [this, historySearch, forwards](){
+        // the screen was switched, which renumbers the lines; search the
+        // new screen, counting its matches if they were being counted
+        if (historySearch != m_historySearch && historySearch != m_countingSearch)
+            return;
+        if (m_searchBar->isHidden())
+            return;
+        if (historySearch == m_countingSearch)
+            m_countedRegExp = QRegularExpression();
+        search(forwards, false);
+    });
+    if (countMatches) {
+        m_searchBar->setMatchCount(regExp.pattern().isEmpty() ? -1 : 0, 0);
+        connect(historySearch, &HistorySearch::matchesFound, this, [this, historySearch](const QVector<HistorySearch::Match> &matches){
+            if (historySearch == m_countingSearch)
+                m_searchBar->setMatchCount(m_searchBar->matchCount() + matches.size(), m_searchBar->searchProgress());
+        });
+        connect(historySearch, &HistorySearch::progress, this, [this, historySearch](int percent){
+            if (historySearch == m_countingSearch)
+                m_searchBar->setMatchCount(m_searchBar->matchCount(), percent);
+        });
+        connect(historySearch, &HistorySearch::finished, this, [this, historySearch](int matchCount){
+            if (historySearch == m_countingSearch)
+                m_searchBar->setMatchCount(matchCount, 100);
+        });
+    }
+    historySearch->start(countMatches);
 
     // Highlighting all matches.
     auto regexFilter = m_terminalDisplay->filterChain()->getRegExpFilter(QLatin1String(QTERMW_HLIGHT));
@@ -315,11 +444,7 @@ QStringList QTermWidget::getAvailableColorSchemes() {
 }
 
 QStringList QTermWidget::availableColorSchemes() {
-    QStringList ret;
-    const auto allColorSchemes = ColorSchemeManager::instance()->allColorSchemes();
-    for (const ColorScheme* cs : allColorSchemes)
-        ret.append(cs->name());
-    return ret;
+    return ColorSchemeManager::instance()->colorSchemeNames();
 }
 
 void QTermWidget::setBackgroundColor(const QColor &color) {
@@ -343,12 +468,28 @@ void QTermWidget::setSize(const QSize &size) {
 }
 
 void QTermWidget::setHistorySize(int lines) {
-    if (lines <= 0)
+    if (lines < 0)
+        m_emulation->setHistory(HistoryTypeFile());
+    else if (lines == 0)
         m_emulation->setHistory(HistoryTypeNone());
+    else if (m_compactHistory)
+        m_emulation->setHistory(HistoryTypeCompact(lines));
     else
         m_emulation->setHistory(HistoryTypeBuffer(lines));
 }
 
+void QTermWidget::setCompactHistoryEnabled(bool enabled) {
+    if (m_compactHistory == enabled)
+        return;
+
+    m_compactHistory = enabled;
+    setHistorySize(historySize());
+}
+
+bool QTermWidget::compactHistoryEnabled() const {
+    return m_compactHistory;
+}
+
 int QTermWidget::historySize() const {
     const HistoryType& currentHistory = m_emulation->history();
 
@@ -379,6 +520,18 @@ void QTermWidget::sendKeyEvent(QKeyEvent *e) {
     m_emulation->sendKeyEvent(e, false);
 }
 
+void QTermWidget::connectNotify(const QMetaMethod &signal) {
+    // only pay for the output tap while someone is listening
+    if (m_emulation && signal == QMetaMethod::fromSignal(&QTermWidget::dupDisplayOutput))
+        m_emulation->setOutputTapEnabled(true);
+}
+
+void QTermWidget::disconnectNotify(const QMetaMethod &signal) {
+    const QMetaMethod dupDisplayOutputSignal = QMetaMethod::fromSignal(&QTermWidget::dupDisplayOutput);
+    if (m_emulation && (!signal.isValid() || signal == dupDisplayOutputSignal))
+        m_emulation->setOutputTapEnabled(isSignalConnected(dupDisplayOutputSignal));
+}
+
 void QTermWidget::resizeEvent(QResizeEvent*) {
     //qDebug("global window resizing...with %d %d", this->size().width(), this->size().height());
     m_terminalDisplay->resize(this->size());
@@ -515,6 +668,18 @@ void QTermWidget::pasteSelection() {
     m_terminalDisplay->pasteSelection();
 }
 
+void QTermWidget::cancelPaste() {
+    m_terminalDisplay->cancelPaste();
+}
+
+void QTermWidget::setInputBacklog(const std::function<qint64()> &backlog) {
+    m_terminalDisplay->setInputBacklog(backlog);
+}
+
+bool QTermWidget::isPasting() const {
+    return m_terminalDisplay->isPasting();
+}
+
 void QTermWidget::selectAll() {
     m_terminalDisplay->selectAll();
 }
@@ -601,34 +766,42 @@ void QTermWidget::setMotionAfterPasting(int action) {
 }
 
 int QTermWidget::historyLinesCount() {
+    QMutexLocker locker(m_emulation->stateLock());
     return m_terminalDisplay->screenWindow()->screen()->getHistLines();
 }
 
 int QTermWidget::screenColumnsCount() {
+    QMutexLocker locker(m_emulation->stateLock());
     return m_terminalDisplay->screenWindow()->screen()->getColumns();
 }
 
 int QTermWidget::screenLinesCount() {
+    QMutexLocker locker(m_emulation->stateLock());
     return m_terminalDisplay->screenWindow()->screen()->getLines();
 }
 
 void QTermWidget::setSelectionStart(int row, int column) {
+    QMutexLocker locker(m_emulation->stateLock());
     m_terminalDisplay->screenWindow()->screen()->setSelectionStart(column, row, true);
 }
 
 void QTermWidget::setSelectionEnd(int row, int column) {
+    QMutexLocker locker(m_emulation->stateLock());
     m_terminalDisplay->screenWindow()->screen()->setSelectionEnd(column, row);
 }
 
 void QTermWidget::getSelectionStart(int& row, int& column) {
+    QMutexLocker locker(m_emulation->stateLock());
     m_terminalDisplay->screenWindow()->screen()->getSelectionStart(column, row);
 }
 
 void QTermWidget::getSelectionEnd(int& row, int& column) {
+    QMutexLocker locker(m_emulation->stateLock());
     m_terminalDisplay->screenWindow()->screen()->getSelectionEnd(column, row);
 }
 
 QString QTermWidget::selectedText(bool preserveLineBreaks) {
+    QMutexLocker locker(m_emulation->stateLock());
     return m_terminalDisplay->screenWindow()->screen()->selectedText(preserveLineBreaks);
 }
 
@@ -671,6 +844,60 @@ bool QTermWidget::isBidiEnabled() {
     return m_terminalDisplay->isBidiEnabled();
 }
 
+void QTermWidget::setGlyphCacheEnabled(bool enabled) {
+    m_terminalDisplay->setGlyphCacheEnabled(enabled);
+}
+
+bool QTermWidget::isGlyphCacheEnabled() const {
+    return m_terminalDisplay->isGlyphCacheEnabled();
+}
+
+void QTermWidget::setThreadedEmulationEnabled(bool enabled) {
+    m_emulation->setThreadedEnabled(enabled);
+}
+
+bool QTermWidget::isThreadedEmulationEnabled() const {
+    return m_emulation->isThreadedEnabled();
+}
+
+void QTermWidget::setFramePacing(Emulation::FramePacing pacing) {
+    m_emulation->setFramePacing(pacing);
+}
+
+Emulation::FramePacing QTermWidget::framePacing() const {
+    return m_emulation->framePacing();
+}
+
+Emulation::FrameStatistics QTermWidget::frameStatistics() const {
+    return m_emulation->frameStatistics();
+}
+
+TerminalStatistics QTermWidget::statistics() const {
+    TerminalStatistics statistics = m_emulation->statistics();
+    statistics += m_terminalDisplay->statistics();
+    statistics += m_statistics;
+    return statistics;
+}
+
+void QTermWidget::resetStatistics() {
+    m_emulation->resetStatistics();
+    m_terminalDisplay->resetStatistics();
+    m_statistics = TerminalStatistics();
+}
+
+void QTermWidget::startTrace() {
+    TraceRecorder::instance()->start();
+}
+
+bool QTermWidget::stopTrace(const QString &fileName) {
+    TraceRecorder::instance()->stop();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return TraceRecorder::instance()->write(&file);
+}
+
 void QTermWidget::cursorChanged(Emulation::KeyboardCursorShape cursorShape, bool blinkingCursorEnabled) {
     // TODO: A switch to enable/disable DECSCUSR?
     setKeyboardCursorShape(cursorShape);
@@ -689,6 +916,8 @@ void QTermWidget::saveHistory(QTextStream *stream, int format, int start, int en
     TerminalCharacterDecoder *decoder;
     if(format == 0) {
         decoder = new PlainTextDecoder;
+    } else if(format == 2) {
+        decoder = new AnsiDecoder;
     } else {
         decoder = new HTMLDecoder;
     }
@@ -708,6 +937,36 @@ void QTermWidget::saveHistory(QIODevice *device, int format, int start, int end)
     saveHistory(&stream, format, start, end);
 }
 
+HistoryExport *QTermWidget::exportHistory(QIODevice *device, int format, int start, int end) {
+    HistoryExport::Format exportFormat = HistoryExport::Html;
+    if (format == 0)
+        exportFormat = HistoryExport::PlainText;
+    else if (format == 2)
+        exportFormat = HistoryExport::Ansi;
+
+    // the history is on the primary screen, also while the alternate screen
+    // is shown
+    int lineCount;
+    {
+        QMutexLocker locker(m_emulation->stateLock());
+        const Screen *screen = m_emulation->primaryScreen();
+        lineCount = screen->getHistLines() + screen->getLines();
+    }
+    if (start < 0)
+        start = 0;
+    if (end < 0 || end >= lineCount)
+        end = lineCount - 1;
+
+    HistoryExport *historyExport = new HistoryExport(m_emulation, device, exportFormat, start, end, this);
+    historyExport->setColorTable(m_terminalDisplay->colorTable());
+    historyExport->start();
+    return historyExport;
+}
+
+void QTermWidget::setSessionRecorder(SessionRecorder *recorder) {
+    m_emulation->setRecorder(recorder);
+}
+
 void QTermWidget::screenShot(QPixmap *pixmap) {
     QPixmap currPixmap(m_terminalDisplay->size());
     m_terminalDisplay->render(&currPixmap);
@@ -764,7 +1023,8 @@ void QTermWidget::addHighLightText(const QString &text, const QColor &color) {
     }
     HighLightText *highLightText = new HighLightText(text,color);
     m_highLightTexts.append(highLightText);
-    m_terminalDisplay->filterChain()->addFilter(highLightText->regExpFilter);
+    m_highLightFilter->addPattern(text, color);
+    m_terminalDisplay->filterChain()->addFilter(m_highLightFilter);
     m_terminalDisplay->updateFilters();
     m_terminalDisplay->repaint();
 }
@@ -789,7 +1049,9 @@ bool QTermWidget::isContainHighLightText(const QString &text) {
 void QTermWidget::removeHighLightText(const QString &text) {
     for (int i = 0; i < m_highLightTexts.size(); i++) {
         if (m_highLightTexts.at(i)->text == text) {
-            m_terminalDisplay->filterChain()->removeFilter(m_highLightTexts.at(i)->regExpFilter);
+            m_highLightFilter->removePattern(text);
+            if (m_highLightFilter->isEmpty())
+                m_terminalDisplay->filterChain()->removeFilter(m_highLightFilter);
             delete m_highLightTexts.at(i);
             m_highLightTexts.removeAt(i);
             m_terminalDisplay->updateFilters();
@@ -801,9 +1063,10 @@ void QTermWidget::removeHighLightText(const QString &text) {
 
 void QTermWidget::clearHighLightTexts(void) {
     for (int i = 0; i < m_highLightTexts.size(); i++) {
-        m_terminalDisplay->filterChain()->removeFilter(m_highLightTexts.at(i)->regExpFilter);
         delete m_highLightTexts.at(i);
     }
+    m_highLightFilter->clearPatterns();
+    m_terminalDisplay->filterChain()->removeFilter(m_highLightFilter);
     m_terminalDisplay->updateFilters();
     m_highLightTexts.clear();
     m_terminalDisplay->repaint();
@@ -24,11 +24,20 @@
 #include <QWidget>
 #include <QClipboard>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QRegularExpression>
+
+#include <functional>
+
 #include "Emulation.h"
 #include "Filter.h"
 
 class QVBoxLayout;
+class HistoryExport;
+class HistorySearch;
 class SearchBar;
+class SessionRecorder;
 class Session;
 class TerminalDisplay;
 class Emulation;
@@ -112,13 +121,26 @@ public:
      *
      * @param lines history size
      *  lines = 0, no history
-     *  lies < 0, infinite history
+     *  lines < 0, infinite history, kept in temporary files
      */
     void setHistorySize(int lines);
 
     // Returns the history size (in lines)
     int historySize() const;
 
+    /**
+     * Selects the compact history store for limited scrollback.
+     *
+     * The compact store packs lines into large shared blocks and keeps
+     * attributes run-length encoded, which needs considerably less memory
+     * for long scrollback than the default buffer.  The current history
+     * contents are carried over.
+     */
+    void setCompactHistoryEnabled(bool enabled);
+
+    // Returns true if the compact history store is used for limited scrollback
+    bool compactHistoryEnabled() const;
+
     // Presence of scrollbar
     void setScrollBarPosition(ScrollBarPosition);
 
@@ -209,6 +231,58 @@ public:
     void setBidiEnabled(bool enabled);
     bool isBidiEnabled();
 
+    /**
+     * Enables or disables drawing text from a cache of pre-rendered glyphs,
+     * which makes redrawing large areas much cheaper.  Text which needs
+     * shaping or bidi is always drawn directly.  Defaults to disabled.
+     */
+    void setGlyphCacheEnabled(bool enabled);
+    bool isGlyphCacheEnabled() const;
+
+    /**
+     * Enables or disables processing terminal output on a separate thread.
+     * recvData() then only queues the data, so that large bursts of output
+     * no longer block input handling and painting.  Defaults to disabled.
+     */
+    void setThreadedEmulationEnabled(bool enabled);
+    bool isThreadedEmulationEnabled() const;
+
+    /**
+     * Sets when the display is updated after new output, see
+     * Emulation::FramePacing.  With AdaptiveFramePacing the echo of a key
+     * press is shown at once and floods are drawn at most once per refresh
+     * of the screen.  Updates are suspended while the terminal is hidden
+     * with either policy.  Defaults to FixedFramePacing.
+     */
+    void setFramePacing(Emulation::FramePacing pacing);
+    Emulation::FramePacing framePacing() const;
+
+    // Returns counters describing how display updates were scheduled
+    Emulation::FrameStatistics frameStatistics() const;
+
+    /**
+     * Returns counters of the work done by this terminal since the last
+     * resetStatistics(): the output processed, the lines added to the
+     * history, display updates, painting, filters and searches.  They are
+     * only collected when the library is built with
+     * CONFIG += qtermwidget_statistics, otherwise all counters are zero.
+     */
+    TerminalStatistics statistics() const;
+    void resetStatistics();
+
+    /**
+     * Starts recording a trace of the output processing, display updates,
+     * painting and searches of all terminals.  Requires a library built with
+     * CONFIG += qtermwidget_statistics.
+     */
+    static void startTrace();
+    /**
+     * Stops recording and writes the trace to @p fileName in the Chrome trace
+     * event format, which chrome://tracing and Perfetto can open.  Returns
+     * false if the file cannot be written.
+     */
+    static bool stopTrace(const QString &fileName);
+
     /** change and wrap text corresponding to paste mode **/
     void bracketText(QString& text);
 
@@ -228,6 +302,15 @@ public:
 
     void setConfirmMultilinePaste(bool confirmMultilinePaste);
     void setTrimPastedTrailingNewlines(bool trimPastedTrailingNewlines);
+    /**
+     * Sets a function returning the number of bytes emitted with sendData()
+     * which the receiver has not written to the terminal process yet, such
+     * as IPtyProcess::bytesToWrite().  Large pastes wait while it is high
+     * rather than flooding the process.
+     */
+    void setInputBacklog(const std::function<qint64()>& backlog);
+    /** Returns true while a paste is being sent, see pasteProgress() */
+    bool isPasting() const;
     void setEcho(bool echo);
     void setKeyboardCursorColor(bool useForegroundColor, const QColor& color);
     void proxySendData(QByteArray data) {
@@ -268,6 +351,26 @@ public:
     void reTranslateUi(void);
     void set_fix_quardCRT_issue33(bool fix);
 
+    /**
+     * Writes lines @p start to @p end of the primary screen, history
+     * included, to @p device on a worker thread.  @p format is 0 for plain text, 1 for
+     * HTML and 2 for text with ANSI colors, as in saveHistory().  Negative
+     * @p start and @p end stand for the first and the last line.
+     *
+     * Returns the export, which reports its progress and end with
+     * HistoryExport::progress() and HistoryExport::finished(), can be
+     * cancelled, and deletes itself when done.  @p device must be open and
+     * left alone until then.
+     */
+    HistoryExport *exportHistory(QIODevice *device, int format = 0, int start = -1, int end = -1);
+
+    /**
+     * Records the session with @p recorder from now on, or stops recording
+     * if it is nullptr.  The widget does not take ownership of @p recorder.
+     * Recordings are played back with SessionPlayer.
+     */
+    void setSessionRecorder(SessionRecorder *recorder);
+
 signals:
     void finished();
     void copyAvailable(bool);
@@ -297,7 +400,19 @@ signals:
      * control and display the remote terminal.
      */
     void sendData(const char *,int);
+    /**
+     * Emitted with complete lines of the text displayed by the terminal,
+     * encoded as UTF-8. The text is only collected while something is
+     * connected to this signal.
+     */
     void dupDisplayOutput(const char* data,int len);
+    /**
+     * Emitted with true when output passed to recvData() queues up faster
+     * than the threaded emulation processes it, and with false once it has
+     * caught up.  Connect it to IPtyProcess::setReadingPaused() to hold up
+     * the terminal process meanwhile.  See setThreadedEmulationEnabled()
+     */
+    void receiveQueueFull(bool full);
     void profileChanged(const QString & profile);
     void titleChanged(int title,const QString& newTitle);
     void changeTabTextColorRequest(int);
@@ -306,6 +421,13 @@ signals:
     void zmodemSendDetected();
     void zmodemRecvDetected();
     void handleCtrlC(void);
+    /**
+     * Emitted as a paste is sent to the terminal, with the number of
+     * characters sent and to send.  Large pastes are sent in chunks.
+     */
+    void pasteProgress(qint64 sent, qint64 total);
+    /** Emitted when a paste has been sent, or was cancelled. */
+    void pasteFinished(bool cancelled);
 
 public slots:
     // Copy terminal to clipboard
@@ -316,6 +438,8 @@ public slots:
     void pasteClipboard();
     // Paste selection to terminal
     void pasteSelection();
+    // Stop sending the paste in progress
+    void cancelPaste();
     // Select all text
     void selectAll();
     // Set zoom
@@ -332,6 +456,7 @@ public slots:
     void clearScreen();
     void clear();
     void toggleShowSearchBar();
+    // format: 0 plain text, 1 HTML, 2 text with ANSI colors; see also exportHistory()
     void saveHistory(QIODevice *device, int format = 0, int start = -1, int end = -1);
     void saveHistory(QTextStream *stream, int format = 0, int start = -1, int end = -1);
     void screenShot(QPixmap *pixmap);
@@ -340,6 +465,8 @@ public slots:
 
 protected:
     void resizeEvent(QResizeEvent *) override;
+    void connectNotify(const QMetaMethod &signal) override;
+    void disconnectNotify(const QMetaMethod &signal) override;
 
 protected slots:
     void sessionFinished();
@@ -359,25 +486,26 @@ private:
     class HighLightText {
     public:
         HighLightText(const QString& text, const QColor& color) : text(text), color(color) {
-            regExpFilter = new RegExpFilter();
-            regExpFilter->setRegExp(QRegularExpression(text));
-            regExpFilter->setColor(color);
-        }
-        ~HighLightText() {
-            delete regExpFilter;
         }
         QString text;
         QColor color;
-        RegExpFilter *regExpFilter;
     };
     void search(bool forwards, bool next);
+    void searchFinished();
     int setZoom(int step);
     QWidget *messageParentWidget = nullptr;
     TerminalDisplay *m_terminalDisplay = nullptr;
     Emulation  *m_emulation = nullptr;
     SearchBar* m_searchBar = nullptr;
+    QPointer<HistorySearch> m_historySearch;
+    QPointer<HistorySearch> m_countingSearch;
+    QRegularExpression m_countedRegExp;     // the pattern whose matches the search bar shows
+    TerminalStatistics m_statistics;        // the search counters, see statistics()
+    QElapsedTimer m_searchTimer;
+    qint64 m_searchTraceStart = 0;
     QVBoxLayout *m_layout = nullptr;
     QList<HighLightText*> m_highLightTexts;
+    MultiRegExpFilter *m_highLightFilter = nullptr;     // matches all of m_highLightTexts
     bool m_echo = false;
     UrlFilter *m_urlFilter = nullptr;
     bool m_UrlFilterEnable = true;
@@ -389,6 +517,7 @@ private:
     bool m_notifiedActivity = false;
     QTimer* m_monitorTimer = nullptr;
     int m_silenceSeconds = 10;
+    bool m_compactHistory = false;
 
     const static int STEP_ZOOM = 3;
 };
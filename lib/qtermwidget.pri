@@ -1,44 +1,20 @@
-include(./ptyqt/ptyqt.pri)
-
-INCLUDEPATH += \
-        -I $$PWD/utf8proc \
-        -I $$PWD/util/ \
-        -I $$PWD 
+include(./qtermwidget-core.pri)
 
 SOURCES += \
-    $$PWD/utf8proc/utf8proc.c \
-    $$PWD/utf8proc/utf8proc_data.c \
-    $$PWD/util/CharWidth.cpp \
     $$PWD/util/ColorScheme.cpp \
     $$PWD/util/Filter.cpp \
-    $$PWD/util/History.cpp \
-    $$PWD/util/HistorySearch.cpp \
-    $$PWD/util/KeyboardTranslator.cpp \
+    $$PWD/util/GlyphCache.cpp \
+    $$PWD/util/LiteralMatcher.cpp \
     $$PWD/util/SearchBar.cpp \
-    $$PWD/util/TerminalCharacterDecoder.cpp \
-    $$PWD/Emulation.cpp \
-    $$PWD/Vt102Emulation.cpp \
-    $$PWD/Screen.cpp \
-    $$PWD/ScreenWindow.cpp \
     $$PWD/TerminalDisplay.cpp \
     $$PWD/qtermwidget.cpp
 
 HEADERS += \
-    $$PWD/utf8proc/utf8proc.h \
-    $$PWD/util/CharWidth.h \
-    $$PWD/util/CharacterColor.h \
-    $$PWD/util/Character.h \
     $$PWD/util/ColorScheme.h \
     $$PWD/util/Filter.h \
-    $$PWD/util/History.h \
-    $$PWD/util/HistorySearch.h \
-    $$PWD/util/KeyboardTranslator.h \
+    $$PWD/util/GlyphCache.h \
+    $$PWD/util/LiteralMatcher.h \
     $$PWD/util/SearchBar.h \
-    $$PWD/util/TerminalCharacterDecoder.h \
-    $$PWD/Emulation.h \
-    $$PWD/Vt102Emulation.h \
-    $$PWD/Screen.h \
-    $$PWD/ScreenWindow.h \
     $$PWD/TerminalDisplay.h \
     $$PWD/qtermwidget.h \
     $$PWD/qtermwidget_version.h
@@ -48,3 +24,18 @@ FORMS += \
     
 RESOURCES += \
     $$PWD/res.qrc
+
+# The index of the bundled color schemes is regenerated when a scheme is
+# changed, so that it does not go stale; "make check_colorschemes" only checks
+# it.  Set PYTHON3 where python3 is not on the path.
+isEmpty(PYTHON3): PYTHON3 = python3
+COLOR_SCHEMES = $$files($$PWD/color-schemes/*.colorscheme)
+colorscheme_index.input = COLOR_SCHEMES
+colorscheme_index.output = $$PWD/color-schemes/index.bin
+colorscheme_index.commands = $$PYTHON3 $$shell_quote($$PWD/../tools/colorscheme_index.py) --output ${QMAKE_FILE_OUT}
+colorscheme_index.depends = $$PWD/../tools/colorscheme_index.py
+colorscheme_index.CONFIG += combine no_link target_predeps
+QMAKE_EXTRA_COMPILERS += colorscheme_index
+
+check_colorschemes.commands = $$PYTHON3 $$shell_quote($$PWD/../tools/colorscheme_index.py) --check
+QMAKE_EXTRA_TARGETS += check_colorschemes
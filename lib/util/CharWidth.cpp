@@ -2,6 +2,7 @@
 
 CharWidth::CharWidth(QFont font) {
     fm = new QFontMetrics(font);
+    clear_cache();
 }
 
 CharWidth::~CharWidth() {
@@ -11,18 +12,48 @@ CharWidth::~CharWidth() {
 void CharWidth::setFont(QFont font) {
     delete fm;
     fm = new QFontMetrics(font);
+    clear_cache();
+}
+
+void CharWidth::clear_cache() {
+    zero_advance = qMax(1, fm->horizontalAdvance(QLatin1Char('0')));
+    bmp_advance.clear();
+    astral_advance.clear();
+}
+
+int CharWidth::font_advance(uint ucs) {
+    if(ucs <= 0xffff) {
+        if(bmp_advance.isEmpty())
+            bmp_advance.fill(-1, 0x10000);
+        qint16 & advance = bmp_advance[ucs];
+        if(advance < 0)
+            advance = fm->horizontalAdvance(QChar(static_cast<char16_t>(ucs)));
+        return advance;
+    }
+
+    auto it = astral_advance.constFind(ucs);
+    if(it != astral_advance.constEnd())
+        return it.value();
+
+    // extended character hashes end up here as well, keep the hash bounded
+    if(astral_advance.size() >= 4096)
+        astral_advance.clear();
+    char32_t c = ucs;
+    int advance = fm->horizontalAdvance(QString::fromUcs4(&c, 1));
+    astral_advance.insert(ucs, advance);
+    return advance;
 }
 
 int CharWidth::font_width(wchar_t ucs) {
     uint64_t ucode = ucs;
     if(ucode <= 0xffff)
-        return fm->horizontalAdvance(QString(QChar(ucs)),1)/fm->horizontalAdvance("0",1);
+        return font_advance(ucode)/zero_advance;
     else
         return unicode_width(ucs);
 }
 
 int CharWidth::font_width(const QChar & c) {
-    return fm->horizontalAdvance(c,1)/fm->horizontalAdvance("0",1);
+    return font_advance(c.unicode())/zero_advance;
 }
 
 int CharWidth::string_font_width( const std::wstring & wstr ) {
@@ -3,14 +3,14 @@
 
 #include <QString>
 #include <QDebug>
+#include <QHash>
+#include <QVector>
 
 #include "utf8proc.h"
 #include "CharWidth.h"
 
 #include <QFont>
 #include <QFontMetrics>
-#include <QFontDatabase>
-#include <QApplication>
 
 class CharWidth
 {
@@ -24,13 +24,23 @@ public:
     int string_font_width( const std::wstring & wstr );
     int string_font_width( const QString & str );
 
+    // horizontal advance of a single character in pixels, cached per font
+    int font_advance(uint ucs);
+
     static int unicode_width(wchar_t ucs, bool fix_width = true);
     static int unicode_width(const QChar & c, bool fix_width = true);
     static int string_unicode_width(const std::wstring & wstr, bool fix_width = true);
     static int string_unicode_width(const QString & str, bool fix_width = true);
 
 private:
+    void clear_cache();
+
     QFontMetrics *fm;
+    int zero_advance;
+    // advances measured so far: a flat array for the BMP (-1 if not measured
+    // yet, allocated on first use) and a hash for everything above
+    QVector<qint16> bmp_advance;
+    QHash<uint, int> astral_advance;
 };
 
 #endif // CHARWIDTH_H
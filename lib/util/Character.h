@@ -23,6 +23,7 @@
 #define CHARACTER_H
 
 #include <QHash>
+#include <QMutex>
 #include <QSet>
 
 #include "CharacterColor.h"
@@ -202,15 +203,28 @@ public:
      */
     uint* lookupExtendedChar(uint hash , ushort& length) const;
 
+    /** Returns the number of sequences in the table. */
+    int size() const;
     /**
-     * Keeps track of all screens.
-     * Used in createExtendedChar for checking all screens.
+     * Returns the number of times createExtendedChar() found the hash of a
+     * new sequence taken by another one.  Only counted when the library is
+     * built with QTERMWIDGET_STATISTICS.
      */
-    QSet<ScreenWindow*> windows;
+    quint64 collisions() const;
+
+    /**
+     * Adds @p window to the windows whose screens createExtendedChar()
+     * checks for sequences still in use when the table is full.
+     */
+    void addWindow(ScreenWindow* window);
+    /** Removes a window added with addWindow(). */
+    void removeWindow(ScreenWindow* window);
 
     /** The global ExtendedCharTable instance. */
     static ExtendedCharTable instance;
 private:
+    // the windows of all emulations, see addWindow()
+    QSet<ScreenWindow*> windows;
     // calculates the hash key of a sequence of unicode points of size 'length'
     uint extendedCharHash(uint* unicodePoints , ushort length) const;
     // tests whether the entry in the table specified by 'hash' matches the
@@ -220,6 +234,9 @@ private:
     // in each value is the length of the buffer, followed by the ushorts in the buffer
     // themselves.
     QHash<uint,uint*> extendedCharTable;
+    quint64 collisionCount = 0;
+    // the table is shared by emulations which may parse on their own threads
+    mutable QMutex lock;
 };
 
 Q_DECLARE_TYPEINFO(Character, Q_MOVABLE_TYPE);
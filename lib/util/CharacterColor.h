@@ -125,6 +125,7 @@ extern const ColorEntry base_color_table[TABLE_COLORS];
 class CharacterColor
 {
     friend class Character;
+    friend class AnsiDecoder;
 
 public:
     /** Constructs a new CharacterColor whose color and color space are undefined. */
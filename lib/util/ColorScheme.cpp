@@ -21,17 +21,38 @@
 #include "ColorScheme.h"
 
 #include <QBrush>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QRandomGenerator>
 #include <QRegularExpression>
+#include <QResource>
 #include <QSettings>
 #include <QStringView>
 #include <QtDebug>
+#include <QtEndian>
+
+#include <cstring>
 
 using namespace Qt::Literals::StringLiterals;
 
+// the layout of the precompiled index of the bundled color schemes, see
+// tools/colorscheme_index.py
+namespace {
+const char IndexMagic[4] = { 'Q', 'T', 'C', 'S' };
+const quint16 IndexVersion = 2;
+const int IndexHeaderSize = 16;
+const int IndexSchemeHeaderSize = 24;
+const int IndexSourceHashOffset = 16;
+const int IndexSourceHashSize = 8;
+const int IndexColorSize = 8;
+const int IndexSchemeSize = IndexSchemeHeaderSize + TABLE_COLORS * IndexColorSize;
+const uchar IndexTransparent = 1;
+const uchar IndexHasBold = 2;
+const uchar IndexBold = 4;
+}
+
 // The following are almost IBM standard color codes, with some slight
 // gamma correction for the dim colors to compensate for bright X screens.
 // It contains the 8 ansiterm/xterm colors in 2 intensities.
@@ -274,6 +295,31 @@ void ColorScheme::read(const QString &fileName) {
     }
 }
 
+void ColorScheme::read(const QByteArray &index, int offset) {
+    const uchar *scheme = reinterpret_cast<const uchar *>(index.constData()) + offset;
+
+    const quint16 descriptionLength = qFromLittleEndian<quint16>(scheme + 6);
+    const quint32 descriptionOffset = qFromLittleEndian<quint32>(scheme + 8);
+    _description = QString::fromUtf8(index.constData() + descriptionOffset, descriptionLength);
+    _opacity = qFromLittleEndian<quint16>(scheme + 12) / 10000.0;
+
+    const uchar *color = scheme + IndexSchemeHeaderSize;
+    for (int i = 0; i < TABLE_COLORS; i++, color += IndexColorSize) {
+        ColorEntry entry;
+        entry.color = QColor(color[0], color[1], color[2]);
+        entry.transparent = color[3] & IndexTransparent;
+        if (color[3] & IndexHasBold)
+            entry.fontWeight = (color[3] & IndexBold) ? ColorEntry::Bold : ColorEntry::UseCurrentFormat;
+        setColorTableEntry(i, entry);
+
+        quint16 hue = qFromLittleEndian<quint16>(color + 4);
+        if (hue > MAX_HUE)
+            hue = MAX_HUE;
+        if (hue != 0 || color[6] != 0 || color[7] != 0)
+            setRandomizationRange(i, hue, color[6], color[7]);
+    }
+}
+
 #if 0
 // implemented upstream - user apps
 void ColorScheme::read(KConfig& config) {
@@ -467,7 +513,8 @@ AccessibleColorScheme::AccessibleColorScheme() : ColorScheme() {
 }
 
 ColorSchemeManager::ColorSchemeManager() 
-    : _haveLoadedAll(false) {
+    : _haveLoadedIndex(false)
+    , _haveLoadedAll(false) {
 }
 
 ColorSchemeManager::~ColorSchemeManager() {
@@ -478,16 +525,100 @@ ColorSchemeManager::~ColorSchemeManager() {
     }
 }
 
+void ColorSchemeManager::loadIndex() {
+    _haveLoadedIndex = true;
+
+    const QByteArray index =
+            QResource(QStringLiteral(":/lib/qtermwidget/color-schemes/index.bin")).uncompressedData();
+    const uchar *data = reinterpret_cast<const uchar *>(index.constData());
+    const qsizetype size = index.size();
+
+    const bool valid = size >= IndexHeaderSize &&
+                       memcmp(data, IndexMagic, sizeof(IndexMagic)) == 0 &&
+                       qFromLittleEndian<quint16>(data + 4) == IndexVersion &&
+                       qFromLittleEndian<quint16>(data + 8) == TABLE_COLORS;
+    const int count = valid ? qFromLittleEndian<quint16>(data + 6) : 0;
+
+    if (valid && IndexHeaderSize + qsizetype(count) * IndexSchemeSize <= size) {
+        for (int i = 0; i < count; i++) {
+            const int offset = IndexHeaderSize + i * IndexSchemeSize;
+            const uchar *scheme = data + offset;
+            const quint32 nameOffset = qFromLittleEndian<quint32>(scheme);
+            const quint16 nameLength = qFromLittleEndian<quint16>(scheme + 4);
+            const quint16 descriptionLength = qFromLittleEndian<quint16>(scheme + 6);
+            const quint32 descriptionOffset = qFromLittleEndian<quint32>(scheme + 8);
+            if (nameOffset + nameLength > size || descriptionOffset + descriptionLength > size) {
+                qWarning() << "The index of the bundled color schemes is damaged";
+                _indexedSchemes.clear();
+                break;
+            }
+            _indexedSchemes.insert(QString::fromUtf8(index.constData() + nameOffset, nameLength), offset);
+        }
+    }
+    if (!_indexedSchemes.isEmpty())
+        _index = index;
+
+    // files added after the index was generated are read as before, and
+    // schemes whose file is gone are not listed
+    const QList<QString> paths = listColorSchemes();
+    for (const QString &path : paths) {
+        const QString name = QFileInfo(path).baseName();
+        if (!_indexedSchemes.contains(name))
+            _unindexedSchemePaths << path;
+        else if (!_indexedSchemePaths.contains(name))
+            _indexedSchemePaths.insert(name, path);
+    }
+    for (auto it = _indexedSchemes.begin(); it != _indexedSchemes.end();) {
+        if (_indexedSchemePaths.contains(it.key()))
+            ++it;
+        else
+            it = _indexedSchemes.erase(it);
+    }
+}
+
+bool ColorSchemeManager::indexMatchesFile(int offset, const QString &path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray hash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1);
+    return memcmp(_index.constData() + offset + IndexSourceHashOffset, hash.constData(),
+                  IndexSourceHashSize) == 0;
+}
+
 void ColorSchemeManager::loadAllColorSchemes() {
-    QList<QString> nativeColorSchemes = listColorSchemes();
-    QListIterator<QString> nativeIter(nativeColorSchemes);
-    while (nativeIter.hasNext()) {
-        loadColorScheme(nativeIter.next());
+    if (!_haveLoadedIndex)
+        loadIndex();
+
+    // schemes whose entry is out of date leave the index while it is walked
+    const QStringList indexedNames = _indexedSchemes.keys();
+    for (const QString &name : indexedNames)
+        findColorScheme(name);
+
+    for (const QString &path : std::as_const(_unindexedSchemePaths)) {
+        if (!_colorSchemes.contains(QFileInfo(path).baseName()))
+            loadColorScheme(path);
     }
 
     _haveLoadedAll = true;
 }
 
+QStringList ColorSchemeManager::colorSchemeNames() {
+    if (!_haveLoadedIndex)
+        loadIndex();
+
+    QStringList names = _indexedSchemes.keys();
+    for (const QString &path : std::as_const(_unindexedSchemePaths))
+        names << QFileInfo(path).baseName();
+    // custom color schemes
+    for (auto it = _colorSchemes.constBegin(); it != _colorSchemes.constEnd(); ++it)
+        names << it.key();
+
+    names.sort();
+    names.removeDuplicates();
+    return names;
+}
+
 QList<const ColorScheme *> ColorSchemeManager::allColorSchemes() {
     if (!_haveLoadedAll) {
         loadAllColorSchemes();
@@ -590,6 +721,28 @@ const ColorScheme *ColorSchemeManager::findColorScheme(const QString &name) {
 
     if (_colorSchemes.contains(name)) {
         return _colorSchemes[name];
+    }
+
+    if (!_haveLoadedIndex)
+        loadIndex();
+
+    const auto indexed = _indexedSchemes.constFind(name);
+    if (indexed != _indexedSchemes.constEnd() &&
+        !indexMatchesFile(indexed.value(), _indexedSchemePaths.value(name))) {
+        // the file was changed after the index was generated
+        qWarning() << "The index of the bundled color schemes is out of date for" << name;
+        const QString path = _indexedSchemePaths.take(name);
+        _indexedSchemes.remove(name);
+        _unindexedSchemePaths << path;
+        return loadColorScheme(path) ? _colorSchemes.value(name) : nullptr;
+    }
+
+    if (indexed != _indexedSchemes.constEnd()) {
+        ColorScheme *scheme = new ColorScheme();
+        scheme->setName(name);
+        scheme->read(_index, indexed.value());
+        _colorSchemes.insert(name, scheme);
+        return scheme;
     } else {
         // look for this color scheme
         QString path = findColorSchemePath(name);
@@ -67,6 +67,12 @@ public:
     void write(KConfig& config) const;
 #endif
     void read(const QString & filename);
+    /**
+     * Reads the color scheme from the record at @p offset in the
+     * precompiled index of the bundled color schemes, see ColorSchemeManager.
+     * The record must have been checked to be complete.
+     */
+    void read(const QByteArray& index, int offset);
 
     /** Sets a single entry within the color palette. */
     void setColorTableEntry(int index , const ColorEntry& entry);
@@ -257,6 +263,12 @@ public:
      */
     QList<const ColorScheme*> allColorSchemes();
 
+    /**
+     * Returns the sorted names of the available color schemes, without
+     * loading them.
+     */
+    QStringList colorSchemeNames();
+
     /** Returns the global color scheme manager instance. */
     static ColorSchemeManager* instance();
 
@@ -284,10 +296,24 @@ private:
     void loadAllColorSchemes();
     // finds the path of a color scheme
     QString findColorSchemePath(const QString& name) const;
+    // reads the names in the precompiled index of the bundled color schemes
+    void loadIndex();
+    // whether the index entry at @p offset was generated from the file at @p path
+    bool indexMatchesFile(int offset, const QString& path) const;
 
     QHash<QString,const ColorScheme*> _colorSchemes;
     QSet<ColorScheme*> _modifiedSchemes;
 
+    // The bundled color schemes are precompiled by tools/colorscheme_index.py
+    // into an index, so that they are listed and loaded without parsing their
+    // files; the build regenerates it when they change.  Bundled files which
+    // are missing from the index, or changed since, are still read.
+    QByteArray _index;
+    QHash<QString,int> _indexedSchemes;     // offset of each scheme in _index
+    QHash<QString,QString> _indexedSchemePaths;
+    QStringList _unindexedSchemePaths;
+    bool _haveLoadedIndex;
+
     bool _haveLoadedAll;
 
     static const ColorScheme _defaultColorScheme;
@@ -18,6 +18,7 @@
 */
 #include "Filter.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <QAction>
@@ -142,17 +143,15 @@ void TerminalImageFilterChain::setImage(
     // the end of a space, that space will not be taken into account in _buffer.
     decoder.setTrailingWhitespace(true);
 
-    // setup new shared buffers for the filters to process on
-    QString *newBuffer = new QString();
-    QList<int> *newLinePositions = new QList<int>();
-    setBuffer(newBuffer, newLinePositions);
-
-    // free the old buffers
-    delete _buffer;
-    delete _linePositions;
-
-    _buffer = newBuffer;
-    _linePositions = newLinePositions;
+    // refill the shared buffers for the filters to process on, keeping their
+    // capacity from the last image
+    if (!_buffer) {
+        _buffer = new QString();
+        _linePositions = new QList<int>();
+    }
+    _buffer->resize(0);
+    _linePositions->clear();
+    setBuffer(_buffer, _linePositions);
 
     QTextStream lineStream(_buffer);
     decoder.begin(&lineStream);
@@ -187,13 +186,13 @@ Filter::~Filter() {
 
 void Filter::reset() {
     qDeleteAll(_hotspotList);
-    _hotspots.clear();
     _hotspotList.clear();
+    _maxLineSpan = 0;
 }
 
 void Filter::clear() {
-    _hotspots.clear();
     _hotspotList.clear();
+    _maxLineSpan = 0;
 }
 
 void Filter::setBuffer(const QString *buffer, const QList<int> *linePositions) {
@@ -205,21 +204,18 @@ void Filter::getLineColumn(int position, int &startLine, int &startColumn) {
     Q_ASSERT(_linePositions);
     Q_ASSERT(_buffer);
 
-    for (int i = 0; i < _linePositions->count(); i++) {
-        int nextLine = 0;
+    if (position < 0 || position > _buffer->length())
+        return;
 
-        if (i == _linePositions->count() - 1)
-        nextLine = _buffer->length() + 1;
-        else
-        nextLine = _linePositions->value(i + 1);
+    // the line is the last one which starts at or before position
+    auto next = std::upper_bound(_linePositions->constBegin(), _linePositions->constEnd(), position);
+    if (next == _linePositions->constBegin())
+        return;
 
-        if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
-            startColumn = CharWidth::string_unicode_width(buffer()->mid(
-                _linePositions->value(i), position - _linePositions->value(i)));
-            return;
-        }
-    }
+    const int i = static_cast<int>(next - _linePositions->constBegin()) - 1;
+    startLine = i;
+    startColumn = CharWidth::string_unicode_width(buffer()->mid(
+        _linePositions->value(i), position - _linePositions->value(i)));
 }
 
 const QString *Filter::buffer() { 
@@ -229,28 +225,54 @@ const QString *Filter::buffer() {
 Filter::HotSpot::~HotSpot() {
 }
 
+static bool startsBefore(const Filter::HotSpot *a, const Filter::HotSpot *b) {
+    return a->startLine() < b->startLine() ||
+           (a->startLine() == b->startLine() && a->startColumn() < b->startColumn());
+}
+
 void Filter::addHotSpot(HotSpot *spot) {
-    _hotspotList << spot;
+    // filters usually find their hotspots in order, which makes this an append
+    auto position = std::upper_bound(_hotspotList.begin(), _hotspotList.end(), spot, startsBefore);
+    _hotspotList.insert(position, spot);
 
-    for (int line = spot->startLine(); line <= spot->endLine(); line++) {
-        _hotspots.insert(line, spot);
-    }
+    _maxLineSpan = qMax(_maxLineSpan, spot->endLine() - spot->startLine());
 }
 
 QList<Filter::HotSpot *> Filter::hotSpots() const { 
     return _hotspotList; 
 }
 
+QPair<int, int> Filter::hotSpotRange(int line) const {
+    auto startsAbove = [](const HotSpot *spot, int line) { return spot->startLine() < line; };
+
+    auto first = std::lower_bound(_hotspotList.constBegin(), _hotspotList.constEnd(),
+                                  line - _maxLineSpan, startsAbove);
+    auto last = std::lower_bound(first, _hotspotList.constEnd(), line + 1, startsAbove);
+
+    return qMakePair(static_cast<int>(first - _hotspotList.constBegin()),
+                     static_cast<int>(last - _hotspotList.constBegin()));
+}
+
 QList<Filter::HotSpot *> Filter::hotSpotsAtLine(int line) const {
-    return _hotspots.values(line);
+    QList<HotSpot *> list;
+
+    const QPair<int, int> range = hotSpotRange(line);
+    for (int i = range.first; i < range.second; i++) {
+        if (_hotspotList.at(i)->endLine() >= line)
+            list << _hotspotList.at(i);
+    }
+
+    return list;
 }
 
 Filter::HotSpot *Filter::hotSpotAt(int line, int column) const {
-    QListIterator<HotSpot *> spotIter(_hotspots.values(line));
+    const QPair<int, int> range = hotSpotRange(line);
 
-    while (spotIter.hasNext()) {
-        HotSpot *spot = spotIter.next();
+    for (int i = range.first; i < range.second; i++) {
+        HotSpot *spot = _hotspotList.at(i);
 
+        if (spot->endLine() < line)
+            continue;
         if (spot->startLine() == line && spot->startColumn() > column)
             continue;
         if (spot->endLine() == line && spot->endColumn() < column)
@@ -295,6 +317,7 @@ QStringList RegExpFilter::HotSpot::capturedTexts() const {
 }
 void RegExpFilter::setRegExp(const QRegularExpression &regExp) {
   _searchText = regExp;
+  _matchCache.clear();
 }
 QRegularExpression RegExpFilter::regExp() const { return _searchText; }
 
@@ -312,32 +335,63 @@ void RegExpFilter::process() {
     if (match.hasMatch())
         return;
 
-    match = _searchText.match(*text);
+    // The buffer holds one line of text per unwrapped line of the image.
+    // Only the lines which are not in the cache of the last call are searched
+    QHash<QString, QVector<Match>> matchCache;
+    matchCache.reserve(_matchCache.size());
 
-    while (match.hasMatch()) {
-        int startLine = 0;
-        int endLine = 0;
-        int startColumn = 0;
-        int endColumn = 0;
+    int lineStart = 0;
+    while (lineStart < text->size()) {
+        int lineEnd = text->indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0)
+            lineEnd = text->size();
+
+        const QString line = text->mid(lineStart, lineEnd - lineStart);
+        QVector<Match> matches;
+
+        auto cached = _matchCache.constFind(line);
+        if (cached != _matchCache.constEnd()) {
+            matches = cached.value();
+        } else {
+            match = _searchText.match(line);
 
-        QStringList captureList;
-        for (int i = 0; i <= match.lastCapturedIndex(); i++) {
-            QString text = match.captured(i);
-            captureList.append(text);
+            while (match.hasMatch()) {
+                QStringList captureList;
+                for (int i = 0; i <= match.lastCapturedIndex(); i++) {
+                    QString text = match.captured(i);
+                    captureList.append(text);
+                }
+
+                matches.append({static_cast<int>(match.capturedStart()),
+                                static_cast<int>(match.capturedEnd()), captureList});
+
+                // if capturedLength == 0, the program will get stuck in an infinite loop
+                if (match.capturedLength() == 0) {
+                    break;
+                }
+
+                match = _searchText.match(line, match.capturedEnd());
+            }
         }
 
-        getLineColumn(match.capturedStart(), startLine, startColumn);
-        getLineColumn(match.capturedEnd(), endLine, endColumn);
+        for (const Match &lineMatch : std::as_const(matches)) {
+            int startLine = 0;
+            int endLine = 0;
+            int startColumn = 0;
+            int endColumn = 0;
 
-        newHotSpot(startLine, startColumn, endLine, endColumn, captureList);
+            getLineColumn(lineStart + lineMatch.start, startLine, startColumn);
+            getLineColumn(lineStart + lineMatch.end, endLine, endColumn);
 
-        // if capturedLength == 0, the program will get stuck in an infinite loop
-        if (match.capturedLength() == 0) {
-            break;
+            newHotSpot(startLine, startColumn, endLine, endColumn, lineMatch.capturedTexts);
         }
 
-        match = _searchText.match(*text, match.capturedEnd());
+        if (!line.isEmpty())
+            matchCache.insert(line, matches);
+        lineStart = lineEnd + 1;
     }
+
+    _matchCache.swap(matchCache);
 }
 
 void RegExpFilter::newHotSpot(int startLine, int startColumn, int endLine, int endColumn,
@@ -348,6 +402,218 @@ void RegExpFilter::newHotSpot(int startLine, int startColumn, int endLine, int e
     addHotSpot(spot);
 }
 
+MultiRegExpFilter::MultiRegExpFilter() : RegExpFilter() {
+}
+
+MultiRegExpFilter::~MultiRegExpFilter() {
+    qDeleteAll(_ownPassFilters);
+}
+
+void MultiRegExpFilter::addPattern(const QString &pattern, const QColor &color) {
+    for (auto &entry : _patterns) {
+        if (entry.first == pattern) {
+            entry.second = color;
+            compile();
+            return;
+        }
+    }
+
+    _patterns.append(qMakePair(pattern, color));
+    compile();
+}
+
+void MultiRegExpFilter::removePattern(const QString &pattern) {
+    for (int i = 0; i < _patterns.size(); i++) {
+        if (_patterns.at(i).first == pattern) {
+            _patterns.removeAt(i);
+            compile();
+            return;
+        }
+    }
+}
+
+void MultiRegExpFilter::clearPatterns() {
+    _patterns.clear();
+    compile();
+}
+
+bool MultiRegExpFilter::literalText(const QString &pattern, QString *text) {
+    static const QString specialCharacters = QStringLiteral("\\^$.|?*+()[]{}");
+
+    text->clear();
+    for (int i = 0; i < pattern.size(); i++) {
+        QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\')) {
+            // only escaped punctuation stands for itself, \d, \1 and
+            // friends do not
+            if (++i == pattern.size())
+                return false;
+            c = pattern.at(i);
+            if (c.isLetterOrNumber() || c.unicode() >= 128)
+                return false;
+        } else if (specialCharacters.contains(c)) {
+            return false;
+        }
+        *text += c;
+    }
+    return !text->isEmpty();
+}
+
+bool MultiRegExpFilter::refersToGroups(const QString &pattern) {
+    for (int i = 0; i < pattern.size(); i++) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < pattern.size()) {
+            // \1 to \9, \g{...} and \k<...>
+            const QChar next = pattern.at(++i);
+            if ((next >= QLatin1Char('1') && next <= QLatin1Char('9')) || next == QLatin1Char('g') ||
+                next == QLatin1Char('k'))
+                return true;
+        } else if (c == QLatin1Char('(') && QStringView(pattern).mid(i + 1, 2) == QLatin1String("?<") &&
+                   i + 3 < pattern.size() && pattern.at(i + 3) != QLatin1Char('=') &&
+                   pattern.at(i + 3) != QLatin1Char('!')) {
+            // (?<name>...), but not the lookbehinds (?<=...) and (?<!...)
+            return true;
+        } else if (c == QLatin1Char('(') && (QStringView(pattern).mid(i + 1, 2) == QLatin1String("?'") ||
+                                             QStringView(pattern).mid(i + 1, 2) == QLatin1String("?P"))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MultiRegExpFilter::compile() {
+    qDeleteAll(_ownPassFilters);
+    _ownPassFilters.clear();
+    _groupColors.clear();
+    _literals.clear();
+    _literalColors.clear();
+    _literalCache.clear();
+
+    static const QString emptyString;
+
+    QString combined;
+    QStringList groupNames;
+    QVector<QColor> groupColors;
+
+    for (const auto &entry : std::as_const(_patterns)) {
+        const QRegularExpression regExp(entry.first);
+
+        // like RegExpFilter, never highlight expressions which are invalid
+        // or which match the empty string
+        if (!regExp.isValid() ||
+            regExp.match(emptyString, 0, QRegularExpression::NormalMatch,
+                         QRegularExpression::AnchorAtOffsetMatchOption).hasMatch())
+            continue;
+
+        QString text;
+        if (literalText(entry.first, &text)) {
+            _literals.addText(text);
+            _literalColors.append(entry.second);
+        } else if (refersToGroups(entry.first)) {
+            RegExpFilter *filter = new RegExpFilter();
+            filter->setRegExp(regExp);
+            filter->setColor(entry.second);
+            _ownPassFilters.append(filter);
+        } else {
+            const QString name = QStringLiteral("pattern%1").arg(groupNames.size());
+            if (!combined.isEmpty())
+                combined += QLatin1Char('|');
+            combined += QStringLiteral("(?<%1>").arg(name) + entry.first + QLatin1Char(')');
+            groupNames.append(name);
+            groupColors.append(entry.second);
+        }
+    }
+
+    // the expressions may have groups of their own, so the groups around
+    // them are looked up by name
+    const QRegularExpression regExp(combined);
+    const QStringList captureGroups = regExp.namedCaptureGroups();
+    for (int i = 0; i < groupNames.size(); i++)
+        _groupColors.append(qMakePair(static_cast<int>(captureGroups.indexOf(groupNames.at(i))), groupColors.at(i)));
+
+    setRegExp(regExp);
+}
+
+void MultiRegExpFilter::processLiterals() {
+    if (_literals.textCount() == 0) {
+        _literalCache.clear();
+        return;
+    }
+
+    const QString *text = buffer();
+
+    // one line of text per unwrapped line of the image, cached like the
+    // matches of RegExpFilter::process()
+    QHash<QString, QVector<LiteralMatcher::Match>> literalCache;
+    literalCache.reserve(_literalCache.size());
+
+    int lineStart = 0;
+    while (lineStart < text->size()) {
+        int lineEnd = text->indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0)
+            lineEnd = text->size();
+
+        const QString line = text->mid(lineStart, lineEnd - lineStart);
+        auto cached = _literalCache.constFind(line);
+        const QVector<LiteralMatcher::Match> matches =
+            cached != _literalCache.constEnd() ? cached.value() : _literals.matches(line);
+
+        for (const LiteralMatcher::Match &match : matches) {
+            int startLine = 0;
+            int endLine = 0;
+            int startColumn = 0;
+            int endColumn = 0;
+
+            getLineColumn(lineStart + match.start, startLine, startColumn);
+            getLineColumn(lineStart + match.end, endLine, endColumn);
+
+            RegExpFilter::HotSpot *spot = new RegExpFilter::HotSpot(startLine, startColumn, endLine, endColumn);
+            spot->setCapturedTexts(QStringList(line.mid(match.start, match.end - match.start)));
+            spot->setColor(_literalColors.at(match.text));
+            addHotSpot(spot);
+        }
+
+        if (!line.isEmpty())
+            literalCache.insert(line, matches);
+        lineStart = lineEnd + 1;
+    }
+
+    _literalCache.swap(literalCache);
+}
+
+void MultiRegExpFilter::process() {
+    RegExpFilter::process();
+    processLiterals();
+
+    for (RegExpFilter *filter : std::as_const(_ownPassFilters)) {
+        filter->setBuffer(buffer(), linePositions());
+        filter->process();
+
+        // the hotspots are handed over to this filter, which deletes them
+        const QList<HotSpot *> spots = filter->hotSpots();
+        filter->clear();
+        for (HotSpot *spot : spots)
+            addHotSpot(spot);
+    }
+}
+
+void MultiRegExpFilter::newHotSpot(int startLine, int startColumn, int endLine, int endColumn,
+                                   const QStringList& captureList) {
+    // exactly one of the alternatives took part in the match
+    QColor spotColor = color();
+    for (const auto &groupColor : std::as_const(_groupColors)) {
+        if (!captureList.value(groupColor.first).isNull()) {
+            spotColor = groupColor.second;
+            break;
+        }
+    }
+
+    RegExpFilter::HotSpot* spot = new RegExpFilter::HotSpot(startLine, startColumn, endLine, endColumn);
+    spot->setCapturedTexts(captureList);
+    spot->setColor(spotColor);
+    addHotSpot(spot);
+}
+
 void UrlFilter::process()
 {
     RegExpFilter::process();
@@ -25,10 +25,13 @@
 #include <QObject>
 #include <QStringList>
 #include <QHash>
+#include <QPair>
+#include <QVector>
 #include <QRegularExpression>
 #include <QColor>
 
 #include "Character.h"
+#include "LiteralMatcher.h"
 
 /**
  * A filter processes blocks of text looking for certain patterns (such as URLs or keywords from a list)
@@ -168,12 +171,19 @@ protected:
     void addHotSpot(HotSpot*);
     /** Returns the internal buffer */
     const QString* buffer();
+    /** Returns the positions in buffer() at which the lines start */
+    const QList<int>* linePositions() const { return _linePositions; }
     /** Converts a character position within buffer() to a line and column */
     void getLineColumn(int position , int& startLine , int& startColumn);
 
 private:
-    QMultiHash<int,HotSpot*> _hotspots;
+    // returns the range of _hotspotList which holds the hotspots that can cover line
+    QPair<int,int> hotSpotRange(int line) const;
+
+    // sorted by start, so that the hotspots covering a line are found with a
+    // binary search over the lines they can start on
     QList<HotSpot*> _hotspotList;
+    int _maxLineSpan = 0;      // the most lines any hotspot in _hotspotList spans, minus one
 
     const QList<int>* _linePositions = nullptr;
     const QString* _buffer = nullptr;
@@ -230,6 +240,11 @@ public:
     /**
      * Reimplemented to search the filter's text buffer for text matching regExp()
      *
+     * The buffer is searched one line at a time, lines joined by a wrap
+     * counting as one.  The matches are remembered by the text of the line,
+     * so lines whose text did not change since the last call, even if they
+     * moved, are not searched again.
+     *
      * If regexp matches the empty string, then process() will return immediately
      * without finding results.
      */
@@ -244,8 +259,76 @@ protected:
                             const QStringList& captureList);
 
 private:
+    struct Match {
+        int start;      // offsets within the line
+        int end;
+        QStringList capturedTexts;
+    };
+
     QRegularExpression _searchText;
     QColor _color;
+    // the matches in each line of the buffer at the last call of process()
+    QHash<QString, QVector<Match>> _matchCache;
+};
+
+/**
+ * A filter which highlights the matches of a set of regular expressions,
+ * each in its own color.
+ *
+ * Expressions which stand for plain text, escaped punctuation included,
+ * are found with one LiteralMatcher, which reports matches of different
+ * texts which overlap, as separate RegExpFilters would.  The other
+ * expressions are joined into one alternation, with a named group around
+ * each, so the buffer is searched twice however many expressions there
+ * are.  Of two matches of the alternation which overlap only the first is
+ * found.  Expressions with back references or named groups of their own,
+ * which do not survive being joined, are searched for on their own.
+ */
+class MultiRegExpFilter : public RegExpFilter
+{
+    Q_OBJECT
+public:
+    MultiRegExpFilter();
+    ~MultiRegExpFilter() override;
+
+    /**
+     * Adds @p pattern, whose matches are highlighted with @p color.  If the
+     * pattern has been added before its color is replaced.
+     */
+    void addPattern(const QString& pattern, const QColor& color);
+    /** Removes @p pattern from the set of expressions. */
+    void removePattern(const QString& pattern);
+    /** Removes all expressions. */
+    void clearPatterns();
+    /** Returns true if no expressions have been added. */
+    bool isEmpty() const { return _patterns.isEmpty(); }
+
+    void process() override;
+
+protected:
+    void newHotSpot(int startLine, int startColumn, int endLine, int endColumn,
+                    const QStringList& captureList) override;
+
+private:
+    void compile();
+    void processLiterals();
+    // returns true and sets @p text to the text @p pattern matches if it
+    // uses no regular expression syntax apart from escaped punctuation
+    static bool literalText(const QString& pattern, QString* text);
+    // returns true if @p pattern refers to groups by number or name, or
+    // names groups itself, which breaks once it is joined with others
+    static bool refersToGroups(const QString& pattern);
+
+    QList<QPair<QString, QColor>> _patterns;
+    // the plain texts, with the color of each
+    LiteralMatcher _literals;
+    QVector<QColor> _literalColors;
+    // the matches of _literals in each line at the last call of process()
+    QHash<QString, QVector<LiteralMatcher::Match>> _literalCache;
+    // the group around each joined expression in regExp(), with its color
+    QVector<QPair<int, QColor>> _groupColors;
+    // filters for the expressions which are not joined into regExp()
+    QList<RegExpFilter*> _ownPassFilters;
 };
 
 class FilterObject;
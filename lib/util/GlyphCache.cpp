@@ -0,0 +1,141 @@
+#include "GlyphCache.h"
+
+#include <QPaintDevice>
+
+GlyphCache::GlyphCache()
+    : _cellWidth(0), _cellHeight(0), _baseline(0), _devicePixelRatio(1.0),
+      _nextSlot(0) {
+}
+
+void GlyphCache::setFont(const QFont &font, int cellWidth, int cellHeight, int baseline) {
+    _font = font;
+    _cellWidth = cellWidth;
+    _cellHeight = cellHeight;
+    _baseline = baseline;
+    clear();
+}
+
+void GlyphCache::clear() {
+    _glyphs.clear();
+    _pages.clear();
+    _nextSlot = 0;
+}
+
+bool GlyphCache::isSimpleCharacter(uint c) {
+    // Latin, Greek, Cyrillic and Armenian, without combining marks
+    if (c < 0x0590)
+        return c >= 0x20 && (c < 0x0300 || c >= 0x0370) && c != 0x7f && (c < 0x80 || c >= 0xa0);
+    // Latin and Greek extended, punctuation and symbols, without invisible
+    // formatting characters and combining marks for symbols
+    if (c >= 0x1e00 && c < 0x2c00)
+        return !(c >= 0x200b && c <= 0x200f) && !(c >= 0x2028 && c <= 0x202e) &&
+               !(c >= 0x2060 && c <= 0x206f) && !(c >= 0x20d0 && c <= 0x20ff);
+    // CJK, without the combining kana and tone marks
+    if (c >= 0x2e80 && c < 0xa000)
+        return !(c >= 0x302a && c <= 0x302f) && c != 0x3099 && c != 0x309a;
+    // Hangul syllables
+    if (c >= 0xac00 && c < 0xd7a4)
+        return true;
+    // full-width forms
+    return c >= 0xff01 && c < 0xff61;
+}
+
+bool GlyphCache::drawText(QPainter &painter, const QRect &rect, const std::wstring &text,
+                          int styleFlags, const QColor &color) {
+    const int count = static_cast<int>(text.length());
+    if (count == 0 || _cellWidth <= 0 || _cellHeight <= 0)
+        return false;
+
+    // every character must take up the same number of cells
+    const int columns = rect.width() / (_cellWidth * count);
+    if (columns < 1 || columns > 2 || columns * _cellWidth * count != rect.width())
+        return false;
+
+    for (wchar_t c : text) {
+        if (!isSimpleCharacter(static_cast<uint>(c)))
+            return false;
+    }
+
+    const qreal devicePixelRatio = painter.device()->devicePixelRatioF();
+    if (devicePixelRatio != _devicePixelRatio) {
+        clear();
+        _devicePixelRatio = devicePixelRatio;
+    }
+
+    GlyphKey key;
+    key.color = color.rgba();
+    key.styleFlags = styleFlags;
+    key.columns = columns;
+
+    const int width = columns * _cellWidth;
+    QRect target(rect.x(), rect.y(), width, _cellHeight);
+    for (wchar_t c : text) {
+        key.character = static_cast<uint>(c);
+        const Glyph &cached = glyph(key);
+        painter.drawImage(target, _pages.at(cached.page), cached.source);
+        target.translate(width, 0);
+    }
+    return true;
+}
+
+const GlyphCache::Glyph &GlyphCache::glyph(const GlyphKey &key) {
+    auto it = _glyphs.find(key);
+    if (it != _glyphs.end())
+        return it.value();
+
+    const int slotWidth = 2 * _cellWidth;
+    const int slotsPerRow = qMax(1, PAGE_SIZE / slotWidth);
+    const int slotsPerPage = slotsPerRow * qMax(1, PAGE_SIZE / _cellHeight);
+
+    if (_pages.isEmpty() || _nextSlot == slotsPerPage) {
+        // start over once the atlas is full; the glyphs in use will
+        // simply be rendered again
+        if (_pages.size() == MAX_PAGES)
+            clear();
+
+        QImage page(QSize(slotsPerRow * slotWidth, (slotsPerPage / slotsPerRow) * _cellHeight) *
+                        _devicePixelRatio,
+                    QImage::Format_ARGB32_Premultiplied);
+        page.setDevicePixelRatio(_devicePixelRatio);
+        _pages.append(page);
+        _nextSlot = 0;
+    }
+
+    Glyph &entry = _glyphs[key];
+    entry.page = _pages.size() - 1;
+    const QPoint position((_nextSlot % slotsPerRow) * slotWidth,
+                          (_nextSlot / slotsPerRow) * _cellHeight);
+    entry.source = QRect(position * _devicePixelRatio,
+                         QSize(key.columns * _cellWidth, _cellHeight) * _devicePixelRatio);
+    _nextSlot++;
+
+    renderGlyph(key, entry);
+    return entry;
+}
+
+void GlyphCache::renderGlyph(const GlyphKey &key, Glyph &glyph) {
+    QImage &page = _pages[glyph.page];
+    const QRect cell(glyph.source.topLeft() / _devicePixelRatio,
+                     QSize(key.columns * _cellWidth, _cellHeight));
+
+    QFont font = _font;
+#if !defined(Q_OS_WIN)
+    font.setBold(key.styleFlags & Bold);
+#endif
+    font.setItalic(key.styleFlags & Italic);
+    font.setUnderline(key.styleFlags & Underline);
+    font.setStrikeOut(key.styleFlags & StrikeOut);
+    font.setOverline(key.styleFlags & Overline);
+
+    QPainter painter(&page);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(cell, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setClipRect(cell);
+    painter.setLayoutDirection(Qt::LeftToRight);
+    painter.setFont(font);
+    painter.setPen(QColor::fromRgba(key.color));
+
+    char32_t c = key.character;
+    painter.drawText(cell.x(), cell.y() + _baseline, QString::fromUcs4(&c, 1));
+}
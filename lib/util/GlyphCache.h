@@ -0,0 +1,102 @@
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QVector>
+
+#include <string>
+
+/**
+ * A cache of rendered glyphs for TerminalDisplay.
+ *
+ * Every glyph is rasterized once per (code point, style, color, width in
+ * cells) into a cell of a glyph atlas, a set of QImage pages.  Text
+ * fragments which consist of simple, left-to-right characters laid out one
+ * per cell are then drawn by blitting atlas cells instead of shaping and
+ * rasterizing them with QPainter::drawText() on every paint.  Fragments
+ * which need shaping, bidi or combining characters are left to drawText().
+ */
+class GlyphCache
+{
+public:
+    enum StyleFlag {
+        Bold      = 1,
+        Italic    = 2,
+        Underline = 4,
+        StrikeOut = 8,
+        Overline  = 16
+    };
+
+    GlyphCache();
+
+    /**
+     * Sets the font and the cell geometry used to render glyphs.
+     * @p baseline is the offset of the base line from the top of a cell.
+     * This discards all cached glyphs.
+     */
+    void setFont(const QFont &font, int cellWidth, int cellHeight, int baseline);
+
+    /** Discards all cached glyphs. */
+    void clear();
+
+    /**
+     * Draws @p text into @p rect, one character per cell (or per two cells
+     * for double width characters), rendering glyphs which are not cached
+     * yet.  Returns false without drawing anything if the text cannot be
+     * drawn from the cache, in which case the caller has to draw it itself.
+     */
+    bool drawText(QPainter &painter, const QRect &rect, const std::wstring &text,
+                  int styleFlags, const QColor &color);
+
+    /**
+     * Returns true if @p c is drawn the same way on its own as within a
+     * run of text, that is, it needs no shaping and is not a combining or
+     * right-to-left character.
+     */
+    static bool isSimpleCharacter(uint c);
+
+private:
+    struct GlyphKey {
+        uint character;
+        QRgb color;
+        quint8 styleFlags;
+        quint8 columns;
+
+        bool operator==(const GlyphKey &other) const {
+            return character == other.character && color == other.color &&
+                   styleFlags == other.styleFlags && columns == other.columns;
+        }
+    };
+    friend size_t qHash(const GlyphKey &key, size_t seed = 0) {
+        return qHashMulti(seed, key.character, key.color, key.styleFlags, key.columns);
+    }
+
+    struct Glyph {
+        int page;
+        QRect source; // in device pixels of the page
+    };
+
+    const Glyph &glyph(const GlyphKey &key);
+    void renderGlyph(const GlyphKey &key, Glyph &glyph);
+
+    QFont _font;
+    int _cellWidth;
+    int _cellHeight;
+    int _baseline;
+    qreal _devicePixelRatio;
+
+    QVector<QImage> _pages;
+    int _nextSlot; // next free slot of the last page
+    QHash<GlyphKey, Glyph> _glyphs;
+
+    // each page is a grid of slots of two cells' width
+    static const int PAGE_SIZE = 1024;
+    static const int MAX_PAGES = 8;
+};
+
+#endif // GLYPHCACHE_H
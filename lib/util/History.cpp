@@ -23,9 +23,12 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <cerrno>
+#include <new>
 
+#include <QDir>
 #include <QtDebug>
 
 // Reasonable line size
@@ -64,6 +67,31 @@
         scheme with wrap around would be it's complexity.
 */
 
+// copies the last 'maxLines' lines (or all of them, if there are fewer)
+// of the history 'from' into the history 'to'
+static void copyHistoryLines(HistoryScroll *from, HistoryScroll *to, int maxLines) {
+    int lines = from->getLines();
+    int startLine = 0;
+    if (lines > maxLines)
+        startLine = lines - maxLines;
+
+    Character line[LINE_SIZE];
+    for (int i = startLine; i < lines; i++) {
+        int size = from->getLineLen(i);
+        if (size > LINE_SIZE) {
+            Character *tmp_line = new Character[size];
+            from->getCells(i, 0, size, tmp_line);
+            to->addCells(tmp_line, size);
+            to->addLine(from->isWrappedLine(i));
+            delete[] tmp_line;
+        } else {
+            from->getCells(i, 0, size, line);
+            to->addCells(line, size);
+            to->addLine(from->isWrappedLine(i));
+        }
+    }
+}
+
 /*
   A Row(X) data type which allows adding elements to the end.
 */
@@ -186,6 +214,411 @@ int HistoryScrollBuffer::bufferIndex(int lineNumber) const {
     }
 }
 
+/*
+  Compact history.
+
+  Instead of one heap allocated QVector<Character> per line, the text and
+  attributes of each line are packed into large blocks shared by many lines.
+  Text takes two (or, if needed, four) bytes per cell and the attributes are
+  stored once per run of identically formatted cells, which for ordinary
+  output is a small fraction of the 16 bytes a Character needs.
+
+  Lines enter at the end and leave from the front, so blocks empty out in
+  the order they were filled and are freed as soon as their last line has
+  been dropped.
+*/
+
+// rounds 'size' up so that every allocation within a block stays
+// suitably aligned for the line objects and arrays stored in it
+static inline size_t alignedSize(size_t size) {
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+CompactHistoryBlock::CompactHistoryBlock(size_t length)
+    : _blockLength(length), _blockStart(new quint8[length]),
+      _tail(_blockStart), _allocCount(0) {
+}
+
+CompactHistoryBlock::~CompactHistoryBlock() {
+    delete[] _blockStart;
+}
+
+void *CompactHistoryBlock::allocate(size_t size) {
+    size = alignedSize(size);
+    if (remaining() < size)
+        return nullptr;
+
+    void *block = _tail;
+    _tail += size;
+    _allocCount++;
+    return block;
+}
+
+void CompactHistoryBlock::deallocate() {
+    Q_ASSERT(_allocCount > 0);
+    _allocCount--;
+}
+
+CompactHistoryBlockList::~CompactHistoryBlockList() {
+    qDeleteAll(_list);
+    _list.clear();
+}
+
+void *CompactHistoryBlockList::allocate(size_t size) {
+    size = alignedSize(size);
+    if (_list.isEmpty() || _list.last()->remaining() < size) {
+        // very long lines get a block of their own
+        _list.append(new CompactHistoryBlock(qMax(size, CompactHistoryBlock::DEFAULT_BLOCK_LENGTH)));
+    }
+    return _list.last()->allocate(size);
+}
+
+void CompactHistoryBlockList::deallocate(void *ptr) {
+    Q_ASSERT(!_list.isEmpty());
+
+    // lines are dropped oldest first, so the owning block is
+    // nearly always found at the front of the list
+    int i = 0;
+    while (i < _list.size() && !_list.at(i)->contains(ptr))
+        i++;
+
+    Q_ASSERT(i < _list.size());
+    if (i == _list.size())
+        return;
+
+    CompactHistoryBlock *block = _list.at(i);
+    block->deallocate();
+    if (!block->isInUse()) {
+        _list.removeAt(i);
+        delete block;
+    }
+}
+
+CompactHistoryLine::CompactHistoryLine(const Character cells[], int count,
+                                       CompactHistoryBlockList &blockList)
+    : _blockList(blockList), _formatArray(nullptr), _text(nullptr),
+      _length(0), _formatLength(0), _wideText(false), _wrapped(false) {
+    if (count <= 0)
+        return;
+
+    // count the attribute runs and check whether the text fits into 16 bits.
+    // note that wchar_t may be signed, and extended character hashes use
+    // the full 32 bits
+    int formatLength = 1;
+    bool wideText = static_cast<quint32>(cells[0].character) > 0xffff;
+    for (int k = 1; k < count; k++) {
+        if (!cells[k].equalsFormat(cells[k - 1]))
+            formatLength++;
+        if (static_cast<quint32>(cells[k].character) > 0xffff)
+            wideText = true;
+    }
+
+    _length = count;
+    _formatLength = formatLength;
+    _wideText = wideText;
+
+    _formatArray = static_cast<CharacterFormat *>(
+        _blockList.allocate(sizeof(CharacterFormat) * formatLength));
+    CharacterFormat *format = new (_formatArray) CharacterFormat;
+    format->setFormat(cells[0]);
+    format->startPos = 0;
+    for (int k = 1; k < count; k++) {
+        if (!cells[k].equalsFormat(cells[k - 1])) {
+            format = new (format + 1) CharacterFormat;
+            format->setFormat(cells[k]);
+            format->startPos = k;
+        }
+    }
+
+    if (_wideText) {
+        quint32 *text = static_cast<quint32 *>(_blockList.allocate(sizeof(quint32) * count));
+        for (int k = 0; k < count; k++)
+            text[k] = static_cast<quint32>(cells[k].character);
+        _text = text;
+    } else {
+        quint16 *text = static_cast<quint16 *>(_blockList.allocate(sizeof(quint16) * count));
+        for (int k = 0; k < count; k++)
+            text[k] = static_cast<quint16>(cells[k].character);
+        _text = text;
+    }
+}
+
+CompactHistoryLine::~CompactHistoryLine() {
+    if (_length > 0) {
+        _blockList.deallocate(_text);
+        _blockList.deallocate(_formatArray);
+    }
+}
+
+void CompactHistoryLine::getCharacters(Character *array, int count,
+                                       int startColumn) const {
+    Q_ASSERT(startColumn >= 0 && count >= 0);
+    Q_ASSERT(startColumn + count <= _length);
+
+    if (count <= 0)
+        return;
+
+    // find the attribute run containing the first requested cell
+    const CharacterFormat *formatEnd = _formatArray + _formatLength;
+    const CharacterFormat *format =
+        std::upper_bound(_formatArray, formatEnd, startColumn,
+                         [](int column, const CharacterFormat &f) {
+                             return column < f.startPos;
+                         }) - 1;
+    int nextStart = (format + 1 < formatEnd) ? (format + 1)->startPos : _length;
+
+    const quint16 *narrowText = static_cast<const quint16 *>(_text);
+    const quint32 *wideText = static_cast<const quint32 *>(_text);
+
+    for (int i = startColumn; i < startColumn + count; i++) {
+        if (i >= nextStart) {
+            ++format;
+            nextStart = (format + 1 < formatEnd) ? (format + 1)->startPos : _length;
+        }
+
+        Character &c = array[i - startColumn];
+        c.character = _wideText ? static_cast<wchar_t>(wideText[i]) : narrowText[i];
+        c.rendition = format->rendition;
+        c.foregroundColor = format->fgColor;
+        c.backgroundColor = format->bgColor;
+    }
+}
+
+HistoryScrollCompact::HistoryScrollCompact(unsigned int maxLineCount)
+    : HistoryScroll(new HistoryTypeCompact(maxLineCount)), _maxLineCount(0) {
+    setMaxNbLines(maxLineCount);
+}
+
+HistoryScrollCompact::~HistoryScrollCompact() {
+    // the lines only hold memory inside the blocks, which are
+    // released all at once by the block list
+    _lines.clear();
+}
+
+void HistoryScrollCompact::removeFirstLine() {
+    CompactHistoryLine *line = _lines.takeFirst();
+    line->~CompactHistoryLine();
+    _blockList.deallocate(line);
+}
+
+void HistoryScrollCompact::addCells(const Character a[], int count) {
+    void *mem = _blockList.allocate(sizeof(CompactHistoryLine));
+    _lines.append(new (mem) CompactHistoryLine(a, count, _blockList));
+
+    if (_lines.size() > static_cast<int>(_maxLineCount))
+        removeFirstLine();
+}
+
+void HistoryScrollCompact::addLine(bool previousWrapped) {
+    if (!_lines.isEmpty())
+        _lines.last()->setWrapped(previousWrapped);
+}
+
+int HistoryScrollCompact::getLines() {
+    return static_cast<int>(_lines.size());
+}
+
+int HistoryScrollCompact::getLineLen(int lineNumber) {
+    if (lineNumber < 0 || lineNumber >= _lines.size())
+        return 0;
+
+    return _lines.at(lineNumber)->getLength();
+}
+
+bool HistoryScrollCompact::isWrappedLine(int lineNumber) {
+    if (lineNumber < 0 || lineNumber >= _lines.size())
+        return false;
+
+    return _lines.at(lineNumber)->isWrapped();
+}
+
+void HistoryScrollCompact::getCells(int lineNumber, int startColumn, int count,
+                                    Character buffer[]) {
+    if (count == 0)
+        return;
+
+    Q_ASSERT(lineNumber < _lines.size());
+
+    if (lineNumber >= _lines.size()) {
+        memset(static_cast<void *>(buffer), 0, count * sizeof(Character));
+        return;
+    }
+
+    _lines.at(lineNumber)->getCharacters(buffer, count, startColumn);
+}
+
+void HistoryScrollCompact::setMaxNbLines(unsigned int lineCount) {
+    _maxLineCount = lineCount;
+
+    while (_lines.size() > static_cast<int>(lineCount))
+        removeFirstLine();
+
+    dynamic_cast<HistoryTypeCompact *>(m_histType)->m_nbLines = lineCount;
+}
+
+// History File ///////////////////////////////////////////
+
+HistoryFile::HistoryFile()
+    : _fileLength(0), _window(nullptr), _windowStart(0), _windowLength(0) {
+    _tmpFile.setFileTemplate(QDir::tempPath() + QLatin1String("/qtermwidget_XXXXXX.history"));
+    if (!_tmpFile.open())
+        qWarning() << "HistoryFile: unable to create temporary file, keeping history in memory:"
+                   << _tmpFile.errorString();
+    _tail.reserve(TAIL_SIZE);
+}
+
+HistoryFile::~HistoryFile() {
+    unmap();
+}
+
+void HistoryFile::add(const char *bytes, qint64 len) {
+    _tail.append(bytes, len);
+    if (_tail.size() >= TAIL_SIZE)
+        flush();
+}
+
+void HistoryFile::flush() {
+    // without a file the tail simply keeps growing
+    if (_tail.isEmpty() || !_tmpFile.isOpen())
+        return;
+
+    if (!_tmpFile.seek(_fileLength) || _tmpFile.write(_tail) != _tail.size() ||
+        !_tmpFile.flush()) {
+        qWarning() << "HistoryFile::flush:" << _tmpFile.errorString();
+        return;
+    }
+
+    _fileLength += _tail.size();
+    _tail.resize(0);
+}
+
+void HistoryFile::get(char *bytes, qint64 len, qint64 loc) {
+    Q_ASSERT(loc >= 0 && len >= 0);
+    if (loc < 0 || len < 0 || loc + len > this->len()) {
+        qWarning() << "HistoryFile::get: invalid range" << loc << len;
+        return;
+    }
+
+    if (loc < _fileLength) {
+        qint64 fromFile = qMin(len, _fileLength - loc);
+        readFile(bytes, fromFile, loc);
+        bytes += fromFile;
+        len -= fromFile;
+        loc += fromFile;
+    }
+
+    if (len > 0)
+        memcpy(bytes, _tail.constData() + (loc - _fileLength), len);
+}
+
+void HistoryFile::readFile(char *bytes, qint64 len, qint64 loc) {
+    bool inWindow = _window && loc >= _windowStart &&
+                    loc + len <= _windowStart + _windowLength;
+    if (!inWindow)
+        inWindow = mapWindow(loc, len);
+
+    if (inWindow) {
+        memcpy(bytes, _window + (loc - _windowStart), len);
+        return;
+    }
+
+    // fall back to plain reads for ranges the window cannot hold
+    if (!_tmpFile.seek(loc) || _tmpFile.read(bytes, len) != len)
+        qWarning() << "HistoryFile::readFile:" << _tmpFile.errorString();
+}
+
+bool HistoryFile::mapWindow(qint64 loc, qint64 len) {
+    unmap();
+
+    qint64 start = loc - loc % WINDOW_ALIGNMENT;
+    qint64 length = qMin(WINDOW_SIZE, _fileLength - start);
+    if (loc + len > start + length)
+        return false;
+
+    _window = _tmpFile.map(start, length);
+    if (!_window)
+        return false;
+
+    _windowStart = start;
+    _windowLength = length;
+    return true;
+}
+
+void HistoryFile::unmap() {
+    if (_window) {
+        _tmpFile.unmap(_window);
+        _window = nullptr;
+        _windowStart = 0;
+        _windowLength = 0;
+    }
+}
+
+// File Scroll ////////////////////////////////////////////////////////////////
+
+/*
+   The history scroll makes a Row(Row(Cell)) from
+   two history buffers. The index buffer contains
+   end of line positions which refer to the cells
+   buffer.
+
+   Note that index[0] addresses the second line
+   (line #1), while the first line (line #0) starts
+   at 0 in cells.
+*/
+
+HistoryScrollFile::HistoryScrollFile()
+    : HistoryScroll(new HistoryTypeFile()) {
+}
+
+HistoryScrollFile::~HistoryScrollFile() {
+}
+
+int HistoryScrollFile::getLines() {
+    return static_cast<int>(_index.len() / sizeof(qint64));
+}
+
+int HistoryScrollFile::getLineLen(int lineno) {
+    return static_cast<int>((startOfLine(lineno + 1) - startOfLine(lineno)) / sizeof(Character));
+}
+
+bool HistoryScrollFile::isWrappedLine(int lineno) {
+    if (lineno >= 0 && lineno < getLines()) {
+        unsigned char flag = 0;
+        _lineflags.get(reinterpret_cast<char *>(&flag), sizeof(unsigned char),
+                       lineno * sizeof(unsigned char));
+        return flag;
+    }
+    return false;
+}
+
+qint64 HistoryScrollFile::startOfLine(int lineno) {
+    if (lineno <= 0)
+        return 0;
+    if (lineno <= getLines()) {
+        qint64 res = 0;
+        _index.get(reinterpret_cast<char *>(&res), sizeof(qint64),
+                   (lineno - 1) * static_cast<qint64>(sizeof(qint64)));
+        return res;
+    }
+    return _cells.len();
+}
+
+void HistoryScrollFile::getCells(int lineno, int colno, int count, Character res[]) {
+    _cells.get(reinterpret_cast<char *>(res), count * static_cast<qint64>(sizeof(Character)),
+               startOfLine(lineno) + colno * static_cast<qint64>(sizeof(Character)));
+}
+
+void HistoryScrollFile::addCells(const Character text[], int count) {
+    _cells.add(reinterpret_cast<const char *>(text), count * static_cast<qint64>(sizeof(Character)));
+}
+
+void HistoryScrollFile::addLine(bool previousWrapped) {
+    qint64 locn = _cells.len();
+    _index.add(reinterpret_cast<const char *>(&locn), sizeof(qint64));
+    unsigned char flags = previousWrapped ? 0x01 : 0x00;
+    _lineflags.add(reinterpret_cast<const char *>(&flags), sizeof(unsigned char));
+}
+
 HistoryScrollNone::HistoryScrollNone() : HistoryScroll(new HistoryTypeNone()) {}
 HistoryScrollNone::~HistoryScrollNone() {}
 bool HistoryScrollNone::hasScroll() { return false; }
@@ -219,28 +652,44 @@ HistoryScroll *HistoryTypeBuffer::scroll(HistoryScroll *old) const {
         }
 
         HistoryScroll *newScroll = new HistoryScrollBuffer(m_nbLines);
-        int lines = old->getLines();
-        int startLine = 0;
-        if (lines > (int)m_nbLines)
-            startLine = lines - m_nbLines;
-
-        Character line[LINE_SIZE];
-        for (int i = startLine; i < lines; i++) {
-            int size = old->getLineLen(i);
-            if (size > LINE_SIZE) {
-                Character *tmp_line = new Character[size];
-                old->getCells(i, 0, size, tmp_line);
-                newScroll->addCells(tmp_line, size);
-                newScroll->addLine(old->isWrappedLine(i));
-                delete[] tmp_line;
-            } else {
-                old->getCells(i, 0, size, line);
-                newScroll->addCells(line, size);
-                newScroll->addLine(old->isWrappedLine(i));
-            }
-        }
+        copyHistoryLines(old, newScroll, m_nbLines);
         delete old;
         return newScroll;
     }
     return new HistoryScrollBuffer(m_nbLines);
 }
+
+HistoryTypeFile::HistoryTypeFile() {}
+bool HistoryTypeFile::isEnabled() const { return true; }
+int HistoryTypeFile::maximumLineCount() const { return 0; }
+HistoryScroll *HistoryTypeFile::scroll(HistoryScroll *old) const {
+    if (dynamic_cast<HistoryScrollFile *>(old))
+        return old; // Unchanged.
+
+    HistoryScroll *newScroll = new HistoryScrollFile();
+    if (old) {
+        copyHistoryLines(old, newScroll, old->getLines());
+        delete old;
+    }
+    return newScroll;
+}
+
+HistoryTypeCompact::HistoryTypeCompact(unsigned int nbLines)
+    : m_nbLines(nbLines) {}
+bool HistoryTypeCompact::isEnabled() const { return true; }
+int HistoryTypeCompact::maximumLineCount() const { return m_nbLines; }
+HistoryScroll *HistoryTypeCompact::scroll(HistoryScroll *old) const {
+    if (old) {
+        HistoryScrollCompact *oldCompact = dynamic_cast<HistoryScrollCompact *>(old);
+        if (oldCompact) {
+            oldCompact->setMaxNbLines(m_nbLines);
+            return oldCompact;
+        }
+
+        HistoryScroll *newScroll = new HistoryScrollCompact(m_nbLines);
+        copyHistoryLines(old, newScroll, m_nbLines);
+        delete old;
+        return newScroll;
+    }
+    return new HistoryScrollCompact(m_nbLines);
+}
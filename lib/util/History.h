@@ -22,6 +22,7 @@
 
 #include <QBitRef>
 #include <QHash>
+#include <QList>
 #include <QVector>
 #include <QTemporaryFile>
 
@@ -69,6 +70,79 @@ protected:
     HistoryType* m_histType;
 };
 
+//////////////////////////////////////////////////////////////////////
+// File-based history (e.g. file log, no limitation in length)
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * An append-only byte store kept in a temporary file.
+ *
+ * The most recently added bytes are held in a small in-memory tail and
+ * written out in large chunks.  Reads of data which has reached the file
+ * go through a memory-mapped window, so only the part of the history
+ * which is actually looked at occupies memory.
+ */
+class HistoryFile
+{
+public:
+    HistoryFile();
+    ~HistoryFile();
+
+    void add(const char* bytes, qint64 len);
+    void get(char* bytes, qint64 len, qint64 loc);
+    qint64 len() const { return _fileLength + _tail.size(); }
+
+private:
+    HistoryFile(const HistoryFile &) = delete;
+    HistoryFile &operator=(const HistoryFile &) = delete;
+
+    void flush();
+    void readFile(char* bytes, qint64 len, qint64 loc);
+    bool mapWindow(qint64 loc, qint64 len);
+    void unmap();
+
+    QTemporaryFile _tmpFile;
+    qint64 _fileLength;
+    QByteArray _tail;
+
+    uchar* _window;
+    qint64 _windowStart;
+    qint64 _windowLength;
+
+    // size of the in-memory tail before it is written to the file
+    static constexpr int TAIL_SIZE = 64 * 1024;
+    // size and alignment of the mapped read window
+    static constexpr qint64 WINDOW_SIZE = 4 * 1024 * 1024;
+    static constexpr qint64 WINDOW_ALIGNMENT = 64 * 1024;
+};
+
+/**
+ * A history scroll without any limit in length, stored in three
+ * temporary files: the cells of all lines, the offset at which each
+ * line ends and one flag byte per line.
+ */
+class HistoryScrollFile : public HistoryScroll
+{
+public:
+    HistoryScrollFile();
+    ~HistoryScrollFile() override;
+
+    int  getLines() override;
+    int  getLineLen(int lineno) override;
+    void getCells(int lineno, int colno, int count, Character res[]) override;
+    bool isWrappedLine(int lineno) override;
+
+    void addCells(const Character a[], int count) override;
+    void addLine(bool previousWrapped=false) override;
+
+private:
+    qint64 startOfLine(int lineno);
+
+    HistoryFile _index;     // lines Row(qint64)
+    HistoryFile _cells;     // text  Row(Character)
+    HistoryFile _lineflags; // flags Row(unsigned char)
+};
+
 class HistoryScrollBuffer : public HistoryScroll
 {
 public:
@@ -137,10 +211,119 @@ public:
     }
 
     CharacterColor fgColor, bgColor;
-    quint16 startPos;
+    qint32 startPos;
     quint8 rendition;
 };
 
+//////////////////////////////////////////////////////////////////////
+// Compact history: lines are packed into large, fixed-size blocks
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * A chunk of memory from which the storage of many history lines is
+ * carved out.  Allocation just bumps the tail pointer; the block keeps
+ * a count of live allocations and is released as a whole once the last
+ * line stored in it has been dropped from the history.
+ */
+class CompactHistoryBlock
+{
+public:
+    static constexpr size_t DEFAULT_BLOCK_LENGTH = 256 * 1024;
+
+    explicit CompactHistoryBlock(size_t length = DEFAULT_BLOCK_LENGTH);
+    ~CompactHistoryBlock();
+
+    size_t remaining() const { return _blockStart + _blockLength - _tail; }
+    size_t length() const { return _blockLength; }
+    void* allocate(size_t size);
+    void deallocate();
+    bool contains(const void* addr) const {
+        return addr >= _blockStart && addr < _blockStart + _blockLength;
+    }
+    bool isInUse() const { return _allocCount != 0; }
+
+private:
+    CompactHistoryBlock(const CompactHistoryBlock &) = delete;
+    CompactHistoryBlock &operator=(const CompactHistoryBlock &) = delete;
+
+    size_t _blockLength;
+    quint8* _blockStart;
+    quint8* _tail;
+    int _allocCount;
+};
+
+class CompactHistoryBlockList
+{
+public:
+    CompactHistoryBlockList() {}
+    ~CompactHistoryBlockList();
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+    int length() const { return _list.size(); }
+
+private:
+    QList<CompactHistoryBlock*> _list;
+};
+
+/**
+ * A single line of history.  The text is stored as one code unit per cell
+ * (16 bits wide unless the line contains characters outside the BMP or
+ * extended character hashes, in which case 32 bits are used) and the
+ * attributes as a run-length encoded array of CharacterFormat spans.
+ *
+ * Instances, and the arrays they point to, live inside the blocks of a
+ * CompactHistoryBlockList.
+ */
+class CompactHistoryLine
+{
+public:
+    CompactHistoryLine(const Character cells[], int count, CompactHistoryBlockList& blockList);
+    ~CompactHistoryLine();
+
+    void getCharacters(Character* array, int count, int startColumn) const;
+    bool isWrapped() const { return _wrapped; }
+    void setWrapped(bool isWrapped) { _wrapped = isWrapped; }
+    int getLength() const { return _length; }
+
+private:
+    CompactHistoryLine(const CompactHistoryLine &) = delete;
+    CompactHistoryLine &operator=(const CompactHistoryLine &) = delete;
+
+    CompactHistoryBlockList& _blockList;
+    CharacterFormat* _formatArray;
+    void* _text;
+    qint32 _length;
+    qint32 _formatLength;
+    bool _wideText;
+    bool _wrapped;
+};
+
+class HistoryScrollCompact : public HistoryScroll
+{
+public:
+    HistoryScrollCompact(unsigned int maxNbLines = 1000);
+    ~HistoryScrollCompact() override;
+
+    int  getLines() override;
+    int  getLineLen(int lineno) override;
+    void getCells(int lineno, int colno, int count, Character res[]) override;
+    bool isWrappedLine(int lineno) override;
+
+    void addCells(const Character a[], int count) override;
+    void addLine(bool previousWrapped=false) override;
+
+    void setMaxNbLines(unsigned int nbLines);
+    unsigned int maxNbLines() const { return _maxLineCount; }
+
+private:
+    void removeFirstLine();
+
+    QList<CompactHistoryLine*> _lines;
+    CompactHistoryBlockList _blockList;
+    unsigned int _maxLineCount;
+};
+
 class HistoryType
 {
 public:
@@ -192,4 +375,31 @@ protected:
   unsigned int m_nbLines;
 };
 
+class HistoryTypeFile : public HistoryType
+{
+public:
+    HistoryTypeFile();
+
+    bool isEnabled() const override;
+    int maximumLineCount() const override;
+
+    HistoryScroll* scroll(HistoryScroll *) const override;
+};
+
+class HistoryTypeCompact : public HistoryType
+{
+    friend class HistoryScrollCompact;
+
+public:
+    HistoryTypeCompact(unsigned int nbLines);
+
+    bool isEnabled() const override;
+    int maximumLineCount() const override;
+
+    HistoryScroll* scroll(HistoryScroll *) const override;
+
+protected:
+  unsigned int m_nbLines;
+};
+
 #endif // HISTORY_H
@@ -0,0 +1,116 @@
+#include "HistoryExport.h"
+
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <memory>
+
+#include "Screen.h"
+#include "TerminalCharacterDecoder.h"
+
+HistoryExport::HistoryExport(QPointer<Emulation> emulation, QIODevice *device, Format format,
+                             int startLine, int endLine, QObject *parent)
+    : QObject(parent)
+    , m_emulation(emulation)
+    , m_device(device)
+    , m_format(format)
+    , m_startLine(startLine)
+    , m_endLine(endLine)
+{
+    QMutexLocker locker(m_emulation->stateLock());
+    m_droppedLines = m_emulation->droppedLineCount();
+}
+
+HistoryExport::~HistoryExport()
+{
+    if (m_thread) {
+        cancel();
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+void HistoryExport::start()
+{
+    Q_ASSERT(!m_thread);
+
+    m_thread = QThread::create([this]() { run(); });
+    connect(m_thread, &QThread::finished, this, &QObject::deleteLater);
+    m_thread->start();
+}
+
+void HistoryExport::cancel()
+{
+    m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+int HistoryExport::lineShift() const
+{
+    return static_cast<int>(m_emulation->droppedLineCount() - m_droppedLines);
+}
+
+void HistoryExport::run()
+{
+    std::unique_ptr<TerminalCharacterDecoder> decoder;
+    switch (m_format) {
+    case Html: {
+        auto html = new HTMLDecoder;
+        if (m_colorTable)
+            html->setColorTable(m_colorTable);
+        decoder.reset(html);
+        break;
+    }
+    case Ansi:
+        decoder.reset(new AnsiDecoder);
+        break;
+    case PlainText:
+        decoder.reset(new PlainTextDecoder);
+        break;
+    }
+
+    // QTextStream keeps a small buffer of its own, which is flushed to the
+    // device after every batch
+    QTextStream stream(m_device);
+    decoder->begin(&stream);
+
+    const qint64 total = qint64(m_endLine) - m_startLine + 1;
+    bool ok = true;
+    for (int line = m_startLine; line <= m_endLine && !m_cancelled; line += BatchLines) {
+        {
+            // lines are looked up by the number they had when the export was
+            // created, see HistorySearch::readLines().  Output is processed
+            // under the same lock, with or without the parser thread.  The
+            // history belongs to the primary screen, which is read even while
+            // a program has switched to the alternate screen
+            QMutexLocker locker(m_emulation->stateLock());
+            const Screen *screen = m_emulation->primaryScreen();
+            const int shift = lineShift();
+            const int first = qMax(line - shift, 0);
+            const int last = qMin(qMin(line + BatchLines - 1, m_endLine) - shift,
+                                  screen->getHistLines() + screen->getLines() - 1);
+            if (first <= last)
+                screen->writeWholeLinesToStream(decoder.get(), first, last);
+        }
+
+        stream.flush();
+        if (stream.status() != QTextStream::Ok) {
+            ok = false;
+            break;
+        }
+
+        const int percent = static_cast<int>(qMin(qint64(line) - m_startLine + BatchLines, total) * 100 / total);
+        if (percent != m_lastProgress && !m_cancelled) {
+            m_lastProgress = percent;
+            emit progress(percent);
+        }
+    }
+
+    decoder->end();
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+        ok = false;
+
+    if (!m_cancelled)
+        emit finished(ok);
+}
@@ -0,0 +1,88 @@
+#ifndef HISTORYEXPORT_H
+#define HISTORYEXPORT_H
+
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+
+#include <atomic>
+
+#include "Emulation.h"
+
+class QIODevice;
+class ColorEntry;
+
+/**
+ * Writes the primary screen of an emulation, history included, to a device
+ * on a worker thread, as plain text, HTML or text with ANSI escape
+ * sequences.
+ *
+ * The lines are read in batches of BatchLines under the state lock of the
+ * emulation and written out before the next batch is read, so memory use
+ * does not grow with the length of the history and the emulation is never
+ * held up for long.  Lines dropped from the front of the history while the
+ * export runs are skipped.  Programs which switch to the alternate screen
+ * while the export runs do not affect it.
+ *
+ * The device must be open for writing and must not be used by anything
+ * else until finished() is emitted.  The object deletes itself once the
+ * export is done.
+ */
+class HistoryExport : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        PlainText,
+        Html,
+        Ansi
+    };
+
+    /** The number of lines read from the emulation at a time. */
+    static constexpr int BatchLines = 1000;
+
+    /**
+     * Prepares the export of lines @p startLine to @p endLine of the primary
+     * screen of @p emulation, history included, to @p device.
+     */
+    HistoryExport(QPointer<Emulation> emulation, QIODevice *device, Format format, int startLine,
+                  int endLine, QObject *parent);
+    /** Cancels the export and waits for its thread to end. */
+    ~HistoryExport() override;
+
+    /** Sets the colors of HTML exports, see HTMLDecoder::setColorTable(). */
+    void setColorTable(const ColorEntry *table) { m_colorTable = table; }
+
+    /** Runs the export on a worker thread. */
+    void start();
+    /** Stops the export.  finished() is not emitted.  This may be called from any thread. */
+    void cancel();
+
+signals:
+    /** Emitted with the percentage of lines written. */
+    void progress(int percent);
+    /**
+     * Emitted when the export is done and has not been cancelled.  @p ok is
+     * false if writing to the device failed.
+     */
+    void finished(bool ok);
+
+private:
+    void run();
+    int lineShift() const;
+
+    QPointer<Emulation> m_emulation;
+    QIODevice *m_device;
+    Format m_format;
+    int m_startLine;
+    int m_endLine;
+    const ColorEntry *m_colorTable = nullptr;
+
+    qint64 m_droppedLines = 0;
+    int m_lastProgress = -1;
+    std::atomic<bool> m_cancelled{false};
+    QThread *m_thread = nullptr;
+};
+
+#endif // HISTORYEXPORT_H
@@ -0,0 +1,191 @@
+#include "HistoryIndex.h"
+
+#include <QChar>
+
+#include <string>
+
+#include "CharWidth.h"
+#include "History.h"
+
+HistoryIndex::HistoryIndex()
+{
+    clear();
+}
+
+void HistoryIndex::clear()
+{
+    _blocks.clear();
+    _firstBlock = 0;
+    _firstLine = 0;
+    _endLine = 0;
+    _previousCount = 0;
+}
+
+void HistoryIndex::enable(HistoryScroll *history)
+{
+    _enabled = true;
+    rebuild(history);
+}
+
+void HistoryIndex::rebuild(HistoryScroll *history)
+{
+    clear();
+    if (!_enabled)
+        return;
+
+    // only the lines which fit into the index are read, starting at a block
+    const int count = history->getLines();
+    const int first = qMax(0, count - MaxBlocks * BlockLines + BlockLines - 1) / BlockLines * BlockLines;
+    _endLine = first;
+    _firstBlock = first / BlockLines;
+
+    QVector<Character> line;
+    for (int i = first; i < count; i++) {
+        const int length = history->getLineLen(i);
+        line.resize(length);
+        history->getCells(i, 0, length, line.data());
+        addLine(line.constData(), length, history->isWrappedLine(i));
+    }
+}
+
+uint HistoryIndex::trigramBit(uint a, uint b, uint c)
+{
+    uint hash = (a * 0x9E3779B1u) ^ (b * 0x85EBCA77u) ^ (c * 0xC2B2AE3Du);
+    hash ^= hash >> 15;
+    return hash & 4095;
+}
+
+void HistoryIndex::addTrigram(uint c)
+{
+    c = QChar::toCaseFolded(static_cast<char32_t>(c));
+
+    if (_previousCount == 2) {
+        const uint bit = trigramBit(_previous[0], _previous[1], c);
+        _blocks.last()[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+        _previous[0] = _previous[1];
+        _previous[1] = c;
+    } else {
+        _previous[_previousCount++] = c;
+    }
+}
+
+void HistoryIndex::addLine(const Character *characters, int count, bool wrapped)
+{
+    if (!_enabled)
+        return;
+
+    if (_endLine / BlockLines - _firstBlock == _blocks.size()) {
+        _blocks.append(TrigramSet());
+        if (_blocks.size() > MaxBlocks) {
+            _blocks.removeFirst();
+            ++_firstBlock;
+        }
+    }
+
+    // walk the line the same way PlainTextDecoder writes it, so that the
+    // index sees the text a search is run on
+    for (int i = 0; i < count;) {
+        if (characters[i].rendition & RE_EXTENDED_CHAR) {
+            ushort extendedCharLength = 0;
+            const uint *chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+            if (chars) {
+                std::wstring str;
+                for (ushort nchar = 0; nchar < extendedCharLength; nchar++) {
+                    str.push_back(chars[nchar]);
+                    addTrigram(chars[nchar]);
+                }
+                i += qMax(1, CharWidth::string_unicode_width(str));
+            } else {
+                ++i;
+            }
+        } else {
+            addTrigram(static_cast<uint>(characters[i].character));
+            i += qMax(1, CharWidth::unicode_width(characters[i].character));
+        }
+    }
+
+    // a line break ends the text a literal can match
+    if (!wrapped)
+        _previousCount = 0;
+
+    ++_endLine;
+}
+
+void HistoryIndex::dropLines(int count)
+{
+    if (!_enabled)
+        return;
+
+    _firstLine = qMin(_firstLine + count, _endLine);
+
+    while (!_blocks.isEmpty() && (_firstBlock + 1) * BlockLines <= _firstLine) {
+        _blocks.removeFirst();
+        ++_firstBlock;
+    }
+}
+
+QVector<HistoryIndex::LineRange> HistoryIndex::candidates(const QString &text, int startLine,
+                                                          int endLine) const
+{
+    QVector<LineRange> ranges;
+
+    startLine = qMax(startLine, 0);
+    endLine = qMin(endLine, lineCount() - 1);
+    if (startLine > endLine)
+        return ranges;
+
+    const QList<uint> chars = text.toUcs4();
+    if (!_enabled || chars.size() < 3) {
+        ranges.append(LineRange(startLine, endLine));
+        return ranges;
+    }
+
+    TrigramSet required;
+    required.fill(0);
+    for (int i = 2; i < chars.size(); i++) {
+        const uint bit = trigramBit(QChar::toCaseFolded(static_cast<char32_t>(chars[i - 2])),
+                                    QChar::toCaseFolded(static_cast<char32_t>(chars[i - 1])),
+                                    QChar::toCaseFolded(static_cast<char32_t>(chars[i])));
+        required[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+    }
+
+    const qint64 first = _firstLine + startLine;
+    const qint64 last = _firstLine + endLine;
+
+    // a match of n characters covers at most n lines, so it may continue
+    // on the wrapped lines of this many following blocks.  Its trigrams
+    // are looked up in all of them
+    const int nextBlocks = (chars.size() + BlockLines - 2) / BlockLines;
+
+    // lines which are no longer indexed are always searched, together with
+    // the lines a match starting there can continue on
+    const qint64 indexedStart = _firstBlock * BlockLines;
+    if (first < indexedStart) {
+        const qint64 rangeEnd = qMin(last, indexedStart + nextBlocks * BlockLines - 1);
+        ranges.append(LineRange(startLine, static_cast<int>(rangeEnd - _firstLine)));
+    }
+
+    for (qint64 block = qMax(first, indexedStart) / BlockLines; block <= last / BlockLines; block++) {
+        const int index = static_cast<int>(block - _firstBlock);
+
+        bool found = true;
+        for (size_t word = 0; word < required.size() && found; word++) {
+            quint64 present = _blocks.at(index)[word];
+            for (int next = index + 1; next <= index + nextBlocks && next < _blocks.size(); next++)
+                present |= _blocks.at(next)[word];
+            found = (present & required[word]) == required[word];
+        }
+        if (!found)
+            continue;
+
+        const int rangeStart = static_cast<int>(qMax(first, block * BlockLines) - _firstLine);
+        const int rangeEnd = static_cast<int>(qMin(last, (block + 1 + nextBlocks) * BlockLines - 1) - _firstLine);
+
+        if (!ranges.isEmpty() && rangeStart <= ranges.last().second + 1)
+            ranges.last().second = qMax(ranges.last().second, rangeEnd);
+        else
+            ranges.append(LineRange(rangeStart, rangeEnd));
+    }
+
+    return ranges;
+}
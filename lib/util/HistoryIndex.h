@@ -0,0 +1,112 @@
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <array>
+
+#include "Character.h"
+
+class HistoryScroll;
+
+/**
+ * A search index over the lines of a history scroll.
+ *
+ * The index is off until the first search enables it, see enable(), so
+ * that terminals which are never searched do not pay for it.  From then
+ * on lines are added to the index as they enter the history, see
+ * Screen::addHistLine().  The index groups them into blocks of BlockLines
+ * lines and records, for every block, a bit set of the (case folded)
+ * trigrams which occur in its text.  Before decoding and matching lines
+ * of the history, a search asks candidates() for the blocks which can
+ * contain a given literal, which lets it skip most of a large history.
+ *
+ * Only the newest MaxBlocks blocks are kept, which bounds the size of the
+ * index for unlimited histories; older lines are always candidates.
+ *
+ * The bit sets are lossy: a block reported as a candidate does not
+ * necessarily contain the literal, but a block which is not reported
+ * certainly does not.
+ */
+class HistoryIndex
+{
+public:
+    /** A range of lines, from first to last inclusive. */
+    typedef QPair<int, int> LineRange;
+
+    /**
+     * The number of lines which share one trigram bit set.  Lines of 80
+     * columns set about a quarter of the bits of a block.
+     */
+    static constexpr int BlockLines = 16;
+    /** The most blocks kept, 8 MiB of bit sets. */
+    static constexpr int MaxBlocks = 16 * 1024;
+
+    HistoryIndex();
+
+    /** Removes all lines from the index. */
+    void clear();
+
+    /** Returns true once enable() has been called. */
+    bool isEnabled() const { return _enabled; }
+    /** Turns the index on and indexes the lines of @p history. */
+    void enable(HistoryScroll *history);
+
+    /**
+     * Discards the index and, if it is enabled, indexes the newest lines
+     * of @p history, for example after the history has been replaced.
+     */
+    void rebuild(HistoryScroll *history);
+
+    /**
+     * Adds a line with @p count @p characters to the end of the index, if
+     * it is enabled.  @p wrapped tells whether the line continues on the
+     * next line.
+     */
+    void addLine(const Character *characters, int count, bool wrapped);
+
+    /** Removes the @p count oldest lines from the index. */
+    void dropLines(int count);
+
+    /**
+     * Returns the number of lines removed with dropLines() since the index
+     * was last cleared.  Adding it to a line number gives a number which
+     * stays the same while the oldest lines are dropped.
+     */
+    qint64 droppedLines() const { return _firstLine; }
+
+    /** Returns the number of lines in the index. */
+    int lineCount() const { return static_cast<int>(_endLine - _firstLine); }
+
+    /**
+     * Returns the ranges of lines between @p startLine and @p endLine
+     * which can contain @p text, in ascending order.  Line 0 is the
+     * oldest line in the index.  A match which starts in a range and
+     * continues on the following, wrapped lines ends within the range as
+     * well.  Texts shorter than a trigram match everywhere, as do lines
+     * which are not indexed.
+     */
+    QVector<LineRange> candidates(const QString &text, int startLine, int endLine) const;
+
+private:
+    typedef std::array<quint64, 64> TrigramSet;     // 4096 bits
+
+    static uint trigramBit(uint a, uint b, uint c);
+    void addTrigram(uint c);
+
+    bool _enabled = false;
+    QList<TrigramSet> _blocks;
+    qint64 _firstBlock;     // absolute number of _blocks[0]; older lines are not indexed
+    qint64 _firstLine;      // absolute number of the oldest line
+    qint64 _endLine;        // absolute number of the next line to be added
+
+    // the last two characters, carried over into the next line when a
+    // line is wrapped so that trigrams across the wrap are recorded
+    uint _previous[2];
+    int _previousCount;
+};
+
+#endif // HISTORYINDEX_H
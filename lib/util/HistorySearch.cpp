@@ -16,9 +16,12 @@
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
  02110-1301  USA.
 */
-#include <QApplication>
+#include <algorithm>
+
 #include <QDebug>
+#include <QMutexLocker>
 #include <QRegularExpressionMatch>
+#include <QRegularExpressionMatchIterator>
 #include <QTextStream>
 
 #include "Emulation.h"
@@ -30,37 +33,102 @@ HistorySearch::HistorySearch(EmulationPtr emulation,
                              int startColumn, int startLine, QObject *parent)
     : QObject(parent), m_emulation(emulation), m_regExp(regExp),
       m_forwards(forwards), m_startColumn(startColumn), m_startLine(startLine) {
+    QMutexLocker locker(m_emulation->stateLock());
+    m_droppedLines = m_emulation->droppedLineCount();
+    m_screenSwitches = m_emulation->screenSwitchCount();
 }
 
 HistorySearch::~HistorySearch() {
+    if (m_thread) {
+        cancel();
+        m_thread->wait();
+        delete m_thread;
+    }
 }
 
 void HistorySearch::search() {
+    run();
+    if (m_interrupted)
+        emit interrupted();
+    deleteLater();
+}
+
+void HistorySearch::start(bool countMatches) {
+    Q_ASSERT(!m_thread);
+
+    m_countMatches = countMatches;
+    m_thread = QThread::create([this]() {
+        run();
+        if (m_interrupted)
+            emit interrupted();
+    });
+    connect(m_thread, &QThread::finished, this, &QObject::deleteLater);
+    m_thread->start();
+}
+
+void HistorySearch::cancel() {
+    m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+void HistorySearch::run() {
     bool found = false;
 
     if (!m_regExp.pattern().isEmpty()) {
+        m_literal = requiredLiteral(m_regExp);
+        m_linesTotal = qint64(lineCount()) * (m_countMatches ? 2 : 1);
+
         if (m_forwards) {
         found =
-            search(m_startColumn, m_startLine, -1, m_emulation->lineCount()) ||
+            search(m_startColumn, m_startLine, -1, lineCount()) ||
             search(0, 0, m_startColumn, m_startLine);
         } else {
             found = search(0, 0, m_startColumn, m_startLine) ||
-                search(m_startColumn, m_startLine, -1, m_emulation->lineCount());
+                search(m_startColumn, m_startLine, -1, lineCount());
         }
 
+        if (m_cancelled)
+            return;
+
         if (found) {
-            emit matchFound(m_foundStartColumn, m_foundStartLine, m_foundEndColumn,
-                        m_foundEndLine);
+            const int shift = lineShift();
+            emit matchFound(m_foundStartColumn, m_foundStartLine - shift, m_foundEndColumn,
+                        m_foundEndLine - shift);
         } else {
             emit noMatchFound();
         }
+
+        if (m_countMatches && m_thread) {
+            m_linesSearched = m_linesTotal / 2;
+            countMatches();
+            return;
+        }
     }
 
-    deleteLater();
+    if (m_thread && !m_cancelled)
+        emit finished(-1);
 }
 
 bool HistorySearch::search(int startColumn, int startLine, int endColumn,
                            int endLine) {
+    // Only the lines which the history index cannot rule out are decoded
+    // and matched against m_regExp
+    const QVector<HistoryIndex::LineRange> ranges = candidates(startLine, endLine);
+
+    for (int i = 0; i < ranges.size() && !m_cancelled; i++) {
+        const HistoryIndex::LineRange &range =
+            ranges.at(m_forwards ? i : ranges.size() - 1 - i);
+
+        if (searchLines(range.first == startLine ? startColumn : 0, range.first,
+                        range.second == endLine ? endColumn : -1, range.second))
+            return true;
+    }
+
+    addProgress(endLine - startLine + 1);
+    return false;
+}
+
+bool HistorySearch::searchLines(int startColumn, int startLine, int endColumn,
+                                int endLine) {
     int linesRead = 0;
     int linesToRead = endLine - startLine + 1;
 
@@ -68,7 +136,7 @@ bool HistorySearch::search(int startColumn, int startLine, int endColumn,
     // endLine in blocks of at most 10K lines so that we do not use unhealthy
     // amounts of memory
     int blockSize;
-    while ((blockSize = qMin(10000, linesToRead - linesRead)) > 0) {
+    while ((blockSize = qMin(10000, linesToRead - linesRead)) > 0 && !m_cancelled) {
         QString string;
         QTextStream searchStream(&string);
         PlainTextDecoder decoder;
@@ -79,34 +147,40 @@ bool HistorySearch::search(int startColumn, int startLine, int endColumn,
         int blockStartLine = m_forwards ? startLine + linesRead
                                         : endLine - linesRead - blockSize + 1;
         int chunkEndLine = blockStartLine + blockSize - 1;
-        m_emulation->writeToStream(&decoder, blockStartLine, chunkEndLine);
+        linesRead += blockSize;
+
+        const int firstLineRead = readLines(decoder, blockStartLine, chunkEndLine);
+        if (firstLineRead < 0)
+            continue;
 
-        // We search between startColumn in the first line of the string and
-        // endColumn in the last line of the string. First we calculate the position
-        // (in the string) of endColumn in the last line of the string
+        // We search between startColumn in the first line and endColumn in the
+        // last line, which only limit the blocks which contain those lines.
+        // First we calculate the position (in the string) of endColumn in the
+        // last line of the string
+        int firstPosition = firstLineRead == startLine ? startColumn : 0;
         int endPosition;
 
         // The String that Emulator.writeToStream produces has a newline at the end,
         // and so ends with an empty line - we ignore that.
-        int numberOfLinesInString = decoder.linePositions().size() - 1;
-        if (numberOfLinesInString > 0 && endColumn > -1) {
-            endPosition =
-                decoder.linePositions().at(numberOfLinesInString - 1) + endColumn;
+        const QList<int> linePositions = decoder.linePositions();
+        int numberOfLinesInString = linePositions.size() - 1;
+        if (numberOfLinesInString > 0 && endColumn > -1 && chunkEndLine == endLine) {
+            endPosition = linePositions.at(numberOfLinesInString - 1) + endColumn;
         } else {
             endPosition = string.size();
         }
 
-        // So now we can log for m_regExp in the string between startColumn and
+        // So now we can log for m_regExp in the string between firstPosition and
         // endPosition
         int matchStart;
         QRegularExpressionMatch match;
         if (m_forwards) {
-            matchStart = string.indexOf(m_regExp, startColumn, &match);
+            matchStart = string.indexOf(m_regExp, firstPosition, &match);
         if (matchStart >= endPosition)
             matchStart = -1;
         } else {
             matchStart = string.lastIndexOf(m_regExp, endPosition - 1, &match);
-            if (matchStart < startColumn)
+            if (matchStart < firstPosition)
                 matchStart = -1;
         }
 
@@ -117,32 +191,232 @@ bool HistorySearch::search(int startColumn, int startLine, int endColumn,
             // Translate startPos and endPos to startColum, startLine, endColumn and
             // endLine in history.
             int startLineNumberInString =
-                findLineNumberInString(decoder.linePositions(), matchStart);
+                findLineNumberInString(linePositions, matchStart);
             m_foundStartColumn =
-                matchStart - decoder.linePositions().at(startLineNumberInString);
-            m_foundStartLine = startLineNumberInString + startLine + linesRead;
+                matchStart - linePositions.at(startLineNumberInString);
+            m_foundStartLine = startLineNumberInString + firstLineRead;
 
             int endLineNumberInString =
-                findLineNumberInString(decoder.linePositions(), matchEnd);
+                findLineNumberInString(linePositions, matchEnd);
             m_foundEndColumn =
-                matchEnd - decoder.linePositions().at(endLineNumberInString);
-            m_foundEndLine = endLineNumberInString + startLine + linesRead;
+                matchEnd - linePositions.at(endLineNumberInString);
+            m_foundEndLine = endLineNumberInString + firstLineRead;
 
             return true;
         }
-
-        linesRead += blockSize;
     }
 
     return false;
 }
 
-int HistorySearch::findLineNumberInString(QList<int> linePositions,
+void HistorySearch::countMatches() {
+    int matchCount = 0;
+    const int endLine = lineCount() - 1;
+    const QVector<HistoryIndex::LineRange> ranges = candidates(0, endLine);
+
+    for (const HistoryIndex::LineRange &range : ranges) {
+        for (int blockStartLine = range.first; blockStartLine <= range.second;
+             blockStartLine += 10000) {
+            if (m_cancelled)
+                return;
+
+            QString string;
+            QTextStream searchStream(&string);
+            PlainTextDecoder decoder;
+            decoder.begin(&searchStream);
+            decoder.setRecordLinePositions(true);
+
+            const int firstLineRead = readLines(decoder, blockStartLine,
+                                                qMin(blockStartLine + 9999, range.second));
+            if (firstLineRead < 0)
+                continue;
+
+            const QList<int> linePositions = decoder.linePositions();
+            const int shift = lineShift();
+            QVector<Match> matches;
+
+            QRegularExpressionMatchIterator iterator = m_regExp.globalMatch(string);
+            while (iterator.hasNext()) {
+                const QRegularExpressionMatch match = iterator.next();
+                if (match.capturedLength() == 0)
+                    continue;
+
+                const int matchStart = match.capturedStart();
+                const int matchEnd = match.capturedEnd() - 1;
+                const int startLineNumber = findLineNumberInString(linePositions, matchStart);
+                const int endLineNumber = findLineNumberInString(linePositions, matchEnd);
+
+                matches.append({matchStart - linePositions.at(startLineNumber),
+                                startLineNumber + firstLineRead - shift,
+                                matchEnd - linePositions.at(endLineNumber),
+                                endLineNumber + firstLineRead - shift});
+            }
+
+            if (!matches.isEmpty() && !m_cancelled) {
+                matchCount += matches.size();
+                emit matchesFound(matches);
+            }
+            addProgress(qMin(10000, range.second - blockStartLine + 1));
+        }
+    }
+
+    if (!m_cancelled)
+        emit finished(matchCount);
+}
+
+int HistorySearch::lineShift() const {
+    return static_cast<int>(m_emulation->droppedLineCount() - m_droppedLines);
+}
+
+bool HistorySearch::checkScreen() {
+    // a search which was cancelled already is not wanted any more, and is
+    // not reported as interrupted
+    if (m_cancelled)
+        return false;
+    if (m_emulation->screenSwitchCount() != m_screenSwitches) {
+        m_interrupted = true;
+        cancel();
+    }
+    return !m_interrupted;
+}
+
+int HistorySearch::lineCount() const {
+    QMutexLocker locker(m_emulation->stateLock());
+    return m_emulation->lineCount() + lineShift();
+}
+
+QVector<HistoryIndex::LineRange> HistorySearch::candidates(int startLine, int endLine) {
+    QMutexLocker locker(m_emulation->stateLock());
+    if (!checkScreen())
+        return {};
+
+    const int shift = lineShift();
+
+    QVector<HistoryIndex::LineRange> ranges =
+        m_emulation->searchCandidates(m_literal, startLine - shift, endLine - shift);
+    for (HistoryIndex::LineRange &range : ranges) {
+        range.first += shift;
+        range.second += shift;
+    }
+    return ranges;
+}
+
+int HistorySearch::readLines(PlainTextDecoder &decoder, int startLine, int endLine) {
+    // Output which arrives while the search runs may push lines out of the
+    // history, which renumbers the rest.  The lines are looked up under the
+    // state lock, by the number they had when the search was created
+    QMutexLocker locker(m_emulation->stateLock());
+    if (!checkScreen())
+        return -1;
+
+    const int shift = lineShift();
+
+    const int first = qMax(startLine - shift, 0);
+    const int last = qMin(endLine - shift, m_emulation->lineCount() - 1);
+    if (first > last)
+        return -1;
+
+    m_emulation->writeToStream(&decoder, first, last);
+    return first + shift;
+}
+
+void HistorySearch::addProgress(int lines) {
+    if (!m_thread || m_linesTotal <= 0)
+        return;
+
+    m_linesSearched = qMin(m_linesSearched + lines, m_linesTotal);
+    const int percent = static_cast<int>(m_linesSearched * 100 / m_linesTotal);
+    if (percent != m_lastProgress && !m_cancelled) {
+        m_lastProgress = percent;
+        emit progress(percent);
+    }
+}
+
+int HistorySearch::findLineNumberInString(const QList<int> &linePositions,
                                           int position) {
-    int lineNum = 0;
-    while (lineNum + 1 < linePositions.size() &&
-            linePositions[lineNum + 1] <= position)
-        lineNum++;
+    if (linePositions.size() < 2)
+        return 0;
+
+    // linePositions is sorted, the line is the last one starting at or
+    // before position
+    auto line = std::upper_bound(linePositions.constBegin() + 1,
+                                 linePositions.constEnd(), position);
+    return static_cast<int>(line - linePositions.constBegin()) - 1;
+}
+
+QString HistorySearch::requiredLiteral(const QRegularExpression &regExp) {
+    const QString pattern = regExp.pattern();
+
+    // alternatives, quoting, inline options and extended syntax are rare in
+    // searches; rather than parsing them, such patterns are not prefiltered
+    if ((regExp.patternOptions() & QRegularExpression::ExtendedPatternSyntaxOption) ||
+        pattern.contains(QLatin1Char('|')) ||
+        pattern.contains(QLatin1String("(?")) ||
+        pattern.contains(QLatin1String("\\Q")))
+        return QString();
+
+    // find the longest run of plain characters outside of groups; a run
+    // ends at anything else, and a quantifier which makes its last
+    // character optional removes that character from the run
+    QString longest;
+    QString current;
+    int depth = 0;
+
+    auto endRun = [&]() {
+        if (current.size() > longest.size())
+            longest = current;
+        current.clear();
+    };
+
+    for (int i = 0; i < pattern.size(); i++) {
+        const QChar c = pattern.at(i);
+
+        if (c == QLatin1Char('\\')) {
+            if (++i == pattern.size())
+                break;
+            const QChar escaped = pattern.at(i);
+            // \d, \w, \n and friends are not literal characters, and the
+            // arguments of \x41, \p{L}, \1 and friends are not either
+            if (escaped.isDigit() || QStringLiteral("xcpPNogk").contains(escaped))
+                return QString();
+            if (escaped.unicode() < 128 && escaped.isLetter())
+                endRun();
+            else if (depth == 0)
+                current += escaped;
+        } else if (c == QLatin1Char('(')) {
+            endRun();
+            depth++;
+        } else if (c == QLatin1Char(')')) {
+            endRun();
+            depth = qMax(depth - 1, 0);
+        } else if (c == QLatin1Char('[')) {
+            endRun();
+            // skip the class, a ']' right after '[' or '[^' belongs to it
+            i++;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char('^'))
+                i++;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char(']'))
+                i++;
+            while (i < pattern.size() && pattern.at(i) != QLatin1Char(']')) {
+                if (pattern.at(i) == QLatin1Char('\\'))
+                    i++;
+                i++;
+            }
+        } else if (c == QLatin1Char('?') || c == QLatin1Char('*') || c == QLatin1Char('{')) {
+            current.chop(1);
+            endRun();
+            if (c == QLatin1Char('{')) {
+                while (i < pattern.size() && pattern.at(i) != QLatin1Char('}'))
+                    i++;
+            }
+        } else if (c == QLatin1Char('+') || c == QLatin1Char('.') ||
+                   c == QLatin1Char('^') || c == QLatin1Char('$')) {
+            endRun();
+        } else if (depth == 0) {
+            current += c;
+        }
+    }
+    endRun();
 
-    return lineNum;
+    return longest;
 }
@@ -23,6 +23,10 @@
 #include <QPointer>
 #include <QMap>
 #include <QRegularExpression>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
 
 #include <ScreenWindow.h>
 
@@ -31,26 +35,99 @@
 
 typedef QPointer<Emulation> EmulationPtr;
 
+/**
+ * Searches the output of an emulation, history included, for a regular
+ * expression.
+ *
+ * search() runs on the calling thread.  start() runs the search on a
+ * worker thread and delivers the signals to the thread of the HistorySearch,
+ * so that a search over a large history does not block the user interface.
+ * Either way the object deletes itself once the search is done.
+ *
+ * Line numbers in the signals are those of Emulation::writeToStream() at
+ * the time the signal is emitted.  Lines dropped from the front of the
+ * history while a search runs are skipped.  If the emulation switches
+ * between the primary and the alternate screen, the search stops and
+ * emits interrupted() instead of its other signals.
+ */
 class HistorySearch : public QObject
 {
     Q_OBJECT
 
 public:
+    struct Match {
+        int startColumn;
+        int startLine;
+        int endColumn;
+        int endLine;
+    };
+
     explicit HistorySearch(EmulationPtr emulation, const QRegularExpression& regExp, bool forwards,
                            int startColumn, int startLine, QObject* parent);
+    /** Cancels a search started with start() and waits for its thread to end. */
     ~HistorySearch() override;
     void search();
 
+    /**
+     * Runs the search on a worker thread.  If @p countMatches is true, the
+     * search goes on through all lines after the first match has been
+     * reported and reports every match with matchesFound() and their number
+     * with finished().
+     */
+    void start(bool countMatches);
+
+    /**
+     * Stops a search started with start().  No signals are emitted after
+     * this returns, apart from those already on their way to the thread of
+     * the HistorySearch.  This may be called from any thread.
+     */
+    void cancel();
+
 signals:
     void matchFound(int startColumn, int startLine, int endColumn, int endLine);
     void noMatchFound();
 
+    /** Emitted by counting searches for every batch of matches found. */
+    void matchesFound(const QVector<HistorySearch::Match> &matches);
+    /** Emitted by searches started with start() with the percentage of lines searched. */
+    void progress(int percent);
+    /**
+     * Emitted when a search started with start() is done and has not been
+     * cancelled.  @p matchCount is the number of matches, or -1 if they
+     * were not counted.
+     */
+    void finished(int matchCount);
+    /**
+     * Emitted instead of the other signals when the search stopped because
+     * the emulation switched screens, after which its line numbers mean
+     * nothing.  The search may be started again.
+     */
+    void interrupted();
+
 private:
+    void run();
     bool search(int startColumn, int startLine, int endColumn, int endLine);
-    int findLineNumberInString(QList<int> linePositions, int position);
+    bool searchLines(int startColumn, int startLine, int endColumn, int endLine);
+    void countMatches();
+    int findLineNumberInString(const QList<int> &linePositions, int position);
+
+    // Lines are numbered as when the search was created, see readLines()
+    int lineShift() const;
+    // Stops the search if the emulation has switched screens since it was
+    // created.  Called with the state lock held
+    bool checkScreen();
+    int lineCount() const;
+    QVector<HistoryIndex::LineRange> candidates(int startLine, int endLine);
+    int readLines(PlainTextDecoder &decoder, int startLine, int endLine);
+    void addProgress(int lines);
+
+    // Returns a text which every match of @p regExp contains, or an empty
+    // string if there is none that can be found easily
+    static QString requiredLiteral(const QRegularExpression &regExp);
 
     EmulationPtr m_emulation;
     QRegularExpression m_regExp;
+    QString m_literal;
     bool m_forwards = false;
     int m_startColumn = 0;
     int m_startLine = 0;
@@ -59,6 +136,16 @@ private:
     int m_foundStartLine = 0;
     int m_foundEndColumn = 0;
     int m_foundEndLine = 0;
+
+    qint64 m_droppedLines = 0;
+    quint64 m_screenSwitches = 0;
+    bool m_interrupted = false;
+    bool m_countMatches = false;
+    qint64 m_linesSearched = 0;
+    qint64 m_linesTotal = 0;
+    int m_lastProgress = -1;
+    std::atomic<bool> m_cancelled{false};
+    QThread *m_thread = nullptr;
 };
 
 #endif	/* HISTOTYSEARCH_H */
@@ -804,10 +804,12 @@ void KeyboardTranslator::removeEntry(const Entry &entry) {
 
 KeyboardTranslator::Entry KeyboardTranslator::findEntry(int keyCode, Qt::KeyboardModifiers modifiers,
                               States state) const {
-    for (auto it = _entries.cbegin(), end = _entries.cend(); it != end; ++it) {
-        if (it.key() == keyCode)
-            if (it.value().matches(keyCode, modifiers, state))
-                return *it;
+    // only the entries for keyCode are visited, in the same order as
+    // iterating over the whole table would visit them
+    for (auto it = _entries.constFind(keyCode), end = _entries.cend();
+         it != end && it.key() == keyCode; ++it) {
+        if (it.value().matches(keyCode, modifiers, state))
+            return *it;
     }
     return Entry(); // entry not found
 }
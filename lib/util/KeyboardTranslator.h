@@ -556,18 +556,20 @@ inline int oneOrZero(int value) {
 }
 
 inline QByteArray KeyboardTranslator::Entry::text(bool expandWildCards,Qt::KeyboardModifiers modifiers) const {
+    // share the stored text unless there are wild cards to replace
+    if (!expandWildCards || !_text.contains('*'))
+        return _text;
+
     QByteArray expandedText = _text;
 
-    if (expandWildCards) {
-        int modifierValue = 1;
-        modifierValue += oneOrZero(modifiers & Qt::ShiftModifier);
-        modifierValue += oneOrZero(modifiers & Qt::AltModifier) << 1;
-        modifierValue += oneOrZero(modifiers & KeyboardTranslator::CTRL_MOD) << 2;
+    int modifierValue = 1;
+    modifierValue += oneOrZero(modifiers & Qt::ShiftModifier);
+    modifierValue += oneOrZero(modifiers & Qt::AltModifier) << 1;
+    modifierValue += oneOrZero(modifiers & KeyboardTranslator::CTRL_MOD) << 2;
 
-        for (int i=0;i<_text.length();i++) {
-            if (expandedText[i] == '*')
-                expandedText[i] = '0' + modifierValue;
-        }
+    for (int i=0;i<_text.length();i++) {
+        if (expandedText[i] == '*')
+            expandedText[i] = '0' + modifierValue;
     }
 
     return expandedText;
@@ -0,0 +1,107 @@
+#include "LiteralMatcher.h"
+
+#include <algorithm>
+
+LiteralMatcher::LiteralMatcher()
+{
+    clear();
+}
+
+void LiteralMatcher::clear()
+{
+    _nodes.clear();
+    _nodes.append(Node());
+    _textLengths.clear();
+    _built = true;
+}
+
+void LiteralMatcher::addText(const QString &text)
+{
+    const int number = _textLengths.size();
+    _textLengths.append(text.size());
+    if (text.isEmpty())
+        return;
+
+    int node = 0;
+    for (QChar c : text) {
+        const int next = _nodes.at(node).next.value(c.unicode(), -1);
+        if (next >= 0) {
+            node = next;
+        } else {
+            _nodes.append(Node());
+            _nodes[node].next.insert(c.unicode(), _nodes.size() - 1);
+            node = _nodes.size() - 1;
+        }
+    }
+    _nodes[node].texts.append(number);
+    _built = false;
+}
+
+void LiteralMatcher::build() const
+{
+    // breadth first, so that the failure link of a node is known before
+    // those of its children
+    QVector<int> queue;
+    for (auto it = _nodes.at(0).next.cbegin(); it != _nodes.at(0).next.cend(); ++it) {
+        _nodes[it.value()].failure = 0;
+        queue.append(it.value());
+    }
+
+    for (int i = 0; i < queue.size(); i++) {
+        const int node = queue.at(i);
+        const int failure = _nodes.at(node).failure;
+        _nodes[node].output = _nodes.at(failure).texts.isEmpty() ? _nodes.at(failure).output : failure;
+
+        for (auto it = _nodes.at(node).next.cbegin(); it != _nodes.at(node).next.cend(); ++it) {
+            int state = failure;
+            int target = _nodes.at(state).next.value(it.key(), -1);
+            while (target < 0 && state != 0) {
+                state = _nodes.at(state).failure;
+                target = _nodes.at(state).next.value(it.key(), -1);
+            }
+            _nodes[it.value()].failure = target >= 0 ? target : 0;
+            queue.append(it.value());
+        }
+    }
+    _built = true;
+}
+
+QVector<LiteralMatcher::Match> LiteralMatcher::matches(QStringView line) const
+{
+    QVector<Match> result;
+    if (_textLengths.isEmpty())
+        return result;
+    if (!_built)
+        build();
+
+    // where the last occurrence of each text ended, so that the occurrences
+    // of one text do not overlap
+    QVector<int> lastEnd(_textLengths.size(), 0);
+
+    int state = 0;
+    for (int i = 0; i < line.size(); i++) {
+        const char16_t c = line.at(i).unicode();
+        int next = _nodes.at(state).next.value(c, -1);
+        while (next < 0 && state != 0) {
+            state = _nodes.at(state).failure;
+            next = _nodes.at(state).next.value(c, -1);
+        }
+        state = next >= 0 ? next : 0;
+
+        for (int node = _nodes.at(state).texts.isEmpty() ? _nodes.at(state).output : state; node > 0;
+             node = _nodes.at(node).output) {
+            for (int text : _nodes.at(node).texts) {
+                const int start = i + 1 - _textLengths.at(text);
+                if (start < lastEnd.at(text))
+                    continue;
+                lastEnd[text] = i + 1;
+                result.append({start, i + 1, text});
+            }
+        }
+    }
+
+    // the automaton finds them by their end
+    std::stable_sort(result.begin(), result.end(),
+                     [](const Match &a, const Match &b) { return a.start < b.start; });
+    return result;
+}
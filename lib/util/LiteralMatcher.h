@@ -0,0 +1,61 @@
+#ifndef LITERALMATCHER_H
+#define LITERALMATCHER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+/**
+ * Finds the occurrences of a set of texts in a line in one pass, with an
+ * Aho-Corasick automaton.
+ *
+ * Unlike an alternation of the texts, every text is looked for on its own:
+ * the occurrences of one text may overlap those of another, or lie within
+ * them.  The occurrences of a single text do not overlap each other, as
+ * with a regular expression search which starts after the previous match.
+ */
+class LiteralMatcher
+{
+public:
+    struct Match {
+        int start;      // offsets within the line
+        int end;
+        int text;       // the number of the text, see addText()
+    };
+
+    LiteralMatcher();
+
+    /** Removes all texts. */
+    void clear();
+    /**
+     * Adds @p text, whose occurrences are reported with its number, the
+     * count of texts added before it.  Empty texts are never found.
+     */
+    void addText(const QString &text);
+    /** Returns the number of texts added. */
+    int textCount() const { return _textLengths.size(); }
+
+    /** Returns the occurrences of the texts in @p line, ordered by their start. */
+    QVector<Match> matches(QStringView line) const;
+
+private:
+    struct Node {
+        QHash<char16_t, int> next;
+        int failure = 0;
+        // the nearest node on the failure chain which ends a text, or -1
+        int output = -1;
+        // the texts which end at this node
+        QVector<int> texts;
+    };
+
+    // builds the failure links once texts have been added
+    void build() const;
+
+    // the automaton is built by the first search after texts were added
+    mutable QVector<Node> _nodes;
+    mutable bool _built = true;
+    QVector<int> _textLengths;
+};
+
+#endif // LITERALMATCHER_H
@@ -0,0 +1,135 @@
+#include "PasteStream.h"
+
+namespace {
+
+const QLatin1String BracketStart("\033[200~");
+const QLatin1String BracketEnd("\033[201~");
+const int BracketLength = 6;
+
+bool isLineEnding(QChar c)
+{
+    return c == QLatin1Char('\n') || c == QLatin1Char('\r');
+}
+
+bool isBracketMarker(QStringView text)
+{
+    return text.startsWith(BracketStart) || text.startsWith(BracketEnd);
+}
+
+qsizetype contentEnd(const QString &text, bool trimTrailingNewlines)
+{
+    qsizetype end = text.size();
+    if (trimTrailingNewlines) {
+        while (end > 0 && isLineEnding(text.at(end - 1)))
+            end--;
+    }
+    return end;
+}
+
+}
+
+PasteStream::PasteStream(const QString &text, bool bracketed, bool trimTrailingNewlines, bool appendReturn,
+                         QObject *parent)
+    : QObject(parent)
+    , _text(text)
+    , _end(contentEnd(text, trimTrailingNewlines))
+    , _bracketed(bracketed)
+    , _appendReturn(appendReturn)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &PasteStream::sendNext);
+}
+
+bool PasteStream::isMultiline(const QString &text, bool trimTrailingNewlines)
+{
+    const QStringView content = QStringView(text).first(contentEnd(text, trimTrailingNewlines));
+    return content.contains(QLatin1Char('\n')) || content.contains(QLatin1Char('\r'));
+}
+
+void PasteStream::start()
+{
+    if (!_started && !_finished)
+        sendNext();
+}
+
+void PasteStream::cancel()
+{
+    if (_finished)
+        return;
+
+    _timer.stop();
+    _finished = true;
+    if (_bracketed && _started)
+        emit chunkReady(BracketEnd);
+    emit finished(true);
+}
+
+void PasteStream::sendNext()
+{
+    if (_started && _backlog && _backlog() > MaxBacklog) {
+        _timer.start(BacklogPollInterval);
+        return;
+    }
+
+    _started = true;
+    const QString chunk = nextChunk();
+    const bool last = _position == _end;
+    emit chunkReady(chunk);
+    // a receiver of the chunk may have cancelled the paste
+    if (_finished)
+        return;
+
+    emit progress(_position, _end);
+    if (last) {
+        _finished = true;
+        emit finished(false);
+    } else {
+        _timer.start(0);
+    }
+}
+
+QString PasteStream::nextChunk()
+{
+    qsizetype end = qMin(_end, _position + ChunkSize);
+    if (end < _end) {
+        // split neither a surrogate pair nor a bracket marker
+        if (_text.at(end - 1).isHighSurrogate())
+            end--;
+        if (_bracketed) {
+            const qsizetype escape = _text.lastIndexOf(QLatin1Char('\033'), end - 1);
+            if (escape > _position && escape > end - BracketLength)
+                end = escape;
+        }
+    }
+
+    QString chunk;
+    chunk.reserve(end - _position + 2 * BracketLength + 1);
+    if (_position == 0 && _bracketed)
+        chunk += BracketStart;
+
+    const QChar *data = _text.constData();
+    for (qsizetype i = _position; i < end; i++) {
+        const QChar c = data[i];
+        if (c == QLatin1Char('\n')) {
+            // "\r\n" and "\n" both end a line with a single '\r'
+            if (i == 0 || data[i - 1] != QLatin1Char('\r'))
+                chunk += QLatin1Char('\r');
+        } else if (_bracketed && c == QLatin1Char('\033') &&
+                   isBracketMarker(QStringView(data + i, end - i))) {
+            // the program must not see the paste end early
+            i += BracketLength - 1;
+        } else {
+            chunk += c;
+        }
+    }
+    _position = end;
+
+    if (_position == _end) {
+        if (_bracketed)
+            chunk += BracketEnd;
+        // after the closing marker, so that the pasted command is run
+        if (_appendReturn)
+            chunk += QLatin1Char('\r');
+    }
+    return chunk;
+}
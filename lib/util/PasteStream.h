@@ -0,0 +1,92 @@
+#ifndef PASTESTREAM_H
+#define PASTESTREAM_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <functional>
+
+/**
+ * Sends a pasted text to the terminal in chunks, so that pasting a large
+ * text neither blocks the user interface nor floods the pty.
+ *
+ * Line endings are converted to carriage returns as the chunks are made,
+ * and with bracketed paste the text is enclosed in the bracket markers,
+ * with any markers inside the text removed.  The first chunk is sent by
+ * start(); the next ones follow from the event loop, and wait while the
+ * receiver reports too many bytes it has not written yet, see setBacklog().
+ */
+class PasteStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** The number of characters of the text sent at a time. */
+    static constexpr int ChunkSize = 16 * 1024;
+    /** Sending waits while the backlog is larger than this, in bytes. */
+    static constexpr qint64 MaxBacklog = 256 * 1024;
+    /** How often a waiting paste checks the backlog, in milliseconds. */
+    static constexpr int BacklogPollInterval = 10;
+
+    /**
+     * @param bracketed Whether to enclose the text in bracketed paste markers
+     * @param trimTrailingNewlines Whether to leave out the line endings at the end of @p text
+     * @param appendReturn Whether to send a carriage return after the text,
+     * and after the closing bracket marker
+     */
+    PasteStream(const QString &text, bool bracketed, bool trimTrailingNewlines, bool appendReturn,
+                QObject *parent = nullptr);
+
+    /**
+     * Returns true if @p text contains a line ending, apart from those which
+     * are left out because of @p trimTrailingNewlines.
+     */
+    static bool isMultiline(const QString &text, bool trimTrailingNewlines);
+
+    /**
+     * Sets a function returning the number of bytes the receiver of the
+     * chunks has accepted but not yet written, such as
+     * IPtyProcess::bytesToWrite().  Without it chunks are sent one per
+     * iteration of the event loop.
+     */
+    void setBacklog(const std::function<qint64()> &backlog) { _backlog = backlog; }
+
+    /** Sends the first chunk and schedules the others. */
+    void start();
+    /**
+     * Stops sending.  If the opening bracket marker has been sent, the
+     * closing marker is sent so that the program does not wait for the
+     * rest of the paste.
+     */
+    void cancel();
+
+    bool isFinished() const { return _finished; }
+    /** The number of characters of the text sent so far. */
+    qint64 sent() const { return _position; }
+    /** The number of characters of the text to send. */
+    qint64 total() const { return _end; }
+
+signals:
+    /** Emitted with each chunk of text to send to the terminal. */
+    void chunkReady(const QString &chunk);
+    void progress(qint64 sent, qint64 total);
+    void finished(bool cancelled);
+
+private:
+    void sendNext();
+    QString nextChunk();
+
+    QString _text;
+    qsizetype _position = 0;
+    qsizetype _end;
+    bool _bracketed;
+    bool _appendReturn;
+    bool _started = false;
+    bool _finished = false;
+
+    std::function<qint64()> _backlog;
+    QTimer _timer;
+};
+
+#endif // PASTESTREAM_H
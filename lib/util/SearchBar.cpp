@@ -117,11 +117,24 @@ void SearchBar::setText(const QString &text) {
     return widget.searchTextEdit->setText(text);
 }
 
+void SearchBar::setMatchCount(int count, int percent) {
+    m_matchCount = count;
+    m_searchProgress = percent;
+
+    if (count < 0)
+        widget.matchCountLabel->clear();
+    else if (percent < 100)
+        widget.matchCountLabel->setText(tr("%n match(es), %1%", nullptr, count).arg(percent));
+    else
+        widget.matchCountLabel->setText(tr("%n match(es)", nullptr, count));
+}
+
 void SearchBar::retranslateUi(void) {
     widget.retranslateUi(this);
     m_matchCaseMenuEntry->setText(tr("Match case"));
     m_useRegularExpressionMenuEntry->setText(tr("Regular expression"));
     m_highlightMatchesMenuEntry->setText(tr("Highlight all matches"));
+    setMatchCount(m_matchCount, m_searchProgress);
     //widget.closeButton->setIcon(QFontIcon::icon(QChar(0xf00d)));
     //widget.findPreviousButton->setIcon(QFontIcon::icon(QChar(0xf053)));
     //widget.findNextButton->setIcon(QFontIcon::icon(QChar(0xf054)));
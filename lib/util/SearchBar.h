@@ -38,6 +38,14 @@ public:
     void setText(const QString &text);
     void retranslateUi(void);
 
+    /**
+     * Shows that @p count matches have been found in @p percent of the
+     * output.  A negative count hides the number of matches.
+     */
+    void setMatchCount(int count, int percent);
+    int matchCount() const { return m_matchCount; }
+    int searchProgress() const { return m_searchProgress; }
+
 public slots:
     void noMatchFound();
     void hide();
@@ -60,6 +68,8 @@ private:
     QAction *m_matchCaseMenuEntry;
     QAction *m_useRegularExpressionMenuEntry;
     QAction *m_highlightMatchesMenuEntry;
+    int m_matchCount = -1;
+    int m_searchProgress = 100;
 };
 
 #endif	/* _SEARCHBAR_H */
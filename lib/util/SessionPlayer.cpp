@@ -0,0 +1,414 @@
+#include "SessionPlayer.h"
+
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QtEndian>
+
+#include <algorithm>
+
+#include "Screen.h"
+#include "ScreenWindow.h"
+#include "SessionRecorder.h"
+#include "TerminalCharacterDecoder.h"
+#include "Vt102Emulation.h"
+
+namespace {
+
+const int BinaryHeaderSize = 20;
+const int BinaryEventHeaderSize = 16;
+
+// appends a sequence which draws the lines of @p screen
+void appendScreen(QString &text, const Screen *screen)
+{
+    // each line is placed on its own, so that the lines of the screen do not
+    // depend on where the terminal wraps them
+    AnsiDecoder decoder;
+    const int firstLine = screen->getHistLines();
+    for (int line = 0; line < screen->getLines(); line++) {
+        QString lineText;
+        QTextStream stream(&lineText);
+        decoder.begin(&stream);
+        screen->writeWholeLinesToStream(&decoder, firstLine + line, firstLine + line);
+        decoder.end();
+        stream.flush();
+        if (lineText.endsWith(QLatin1Char('\n')))
+            lineText.chop(1);
+
+        text += QStringLiteral("\033[%1H").arg(line + 1);
+        text += lineText;
+    }
+}
+
+void appendCursor(QString &text, const Screen *screen)
+{
+    text += QStringLiteral("\033[%1;%2H").arg(screen->getCursorY() + 1).arg(screen->getCursorX() + 1);
+}
+
+// returns a sequence which draws the screens of @p emulation, as shown by
+// @p window, on a terminal which has just been reset
+QByteArray screenSequence(Emulation &emulation, ScreenWindow *window)
+{
+    QMutexLocker locker(emulation.stateLock());
+    const Screen *primary = emulation.primaryScreen();
+    const Screen *current = window->screen();
+
+    // the primary screen is drawn even below the alternate screen, so that
+    // it is back when the program leaves the alternate screen.  Switching
+    // saves the cursor, which is restored then as well
+    QString text;
+    appendScreen(text, primary);
+    appendCursor(text, primary);
+    if (current != primary) {
+        text += QLatin1String("\033[?1049h");
+        appendScreen(text, current);
+        appendCursor(text, current);
+    }
+    return text.toUtf8();
+}
+
+bool parseSize(const QByteArray &text, int *columns, int *lines)
+{
+    const int separator = text.indexOf('x');
+    if (separator < 0)
+        return false;
+
+    bool columnsOk = false;
+    bool linesOk = false;
+    *columns = text.left(separator).toInt(&columnsOk);
+    *lines = text.mid(separator + 1).toInt(&linesOk);
+    return columnsOk && linesOk && *columns > 0 && *lines > 0;
+}
+
+}
+
+SessionPlayer::SessionPlayer(QObject *parent)
+    : QObject(parent)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &SessionPlayer::playNext);
+}
+
+SessionPlayer::~SessionPlayer()
+{
+    stopKeyframes();
+}
+
+bool SessionPlayer::load(QIODevice *device)
+{
+    pause();
+    stopKeyframes();
+    _events.clear();
+    _keyframes.clear();
+    _errorString.clear();
+    _nextEvent = 0;
+    _position = 0;
+
+    const bool ok = device->peek(4) == "QTRC" ? loadBinary(device) : loadAsciicast(device);
+    if (!ok) {
+        _events.clear();
+        return false;
+    }
+
+    // the events of asciicast recordings made elsewhere are not always in order
+    std::stable_sort(_events.begin(), _events.end(),
+                     [](const Event &a, const Event &b) { return a.time < b.time; });
+
+    // seeking works from the start of the recording until the keyframes
+    // come in
+    _keyframes.append({0, 0, _columns, _lines, QByteArray()});
+    seek(0);
+
+    _keyframeThread = QThread::create([this]() {
+        buildKeyframes();
+        if (!_stopKeyframes)
+            emit keyframesBuilt();
+    });
+    _keyframeThread->start();
+    return true;
+}
+
+void SessionPlayer::stopKeyframes()
+{
+    if (!_keyframeThread)
+        return;
+
+    _stopKeyframes = true;
+    _keyframeThread->wait();
+    delete _keyframeThread;
+    _keyframeThread = nullptr;
+    _stopKeyframes = false;
+}
+
+bool SessionPlayer::loadBinary(QIODevice *device)
+{
+    const QByteArray data = device->readAll();
+    if (data.size() < BinaryHeaderSize) {
+        _errorString = tr("The recording is truncated.");
+        return false;
+    }
+
+    const char *header = data.constData();
+    if (qFromLittleEndian<quint16>(header + 4) > SessionRecorder::BinaryVersion) {
+        _errorString = tr("The recording was made by a newer version.");
+        return false;
+    }
+    _columns = qFromLittleEndian<quint16>(header + 6);
+    _lines = qFromLittleEndian<quint16>(header + 8);
+
+    qsizetype offset = BinaryHeaderSize;
+    while (offset + BinaryEventHeaderSize <= data.size()) {
+        const char *eventHeader = data.constData() + offset;
+        const quint32 length = qFromLittleEndian<quint32>(eventHeader + 4);
+        if (offset + BinaryEventHeaderSize + qsizetype(length) > data.size())
+            break;
+
+        Event event;
+        event.type = eventHeader[0];
+        event.time = qFromLittleEndian<qint64>(eventHeader + 8);
+        event.data = data.mid(offset + BinaryEventHeaderSize, length);
+        if (event.type == 'o' || event.type == 'i' || (event.type == 'r' && length == 4))
+            _events.append(event);
+        offset += BinaryEventHeaderSize + length;
+    }
+
+    // a recording which was cut short plays up to its last complete event
+    return true;
+}
+
+bool SessionPlayer::loadAsciicast(QIODevice *device)
+{
+    QJsonParseError error;
+    const QJsonObject header = QJsonDocument::fromJson(device->readLine(), &error).object();
+    if (error.error != QJsonParseError::NoError || header.value(QLatin1String("version")).toInt() != 2) {
+        _errorString = tr("The file is not a session recording.");
+        return false;
+    }
+    _columns = header.value(QLatin1String("width")).toInt(80);
+    _lines = header.value(QLatin1String("height")).toInt(24);
+
+    while (!device->atEnd()) {
+        const QByteArray line = device->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        const QJsonArray array = QJsonDocument::fromJson(line).array();
+        if (array.size() < 3)
+            continue;
+
+        const QString type = array.at(1).toString();
+        if (type != QLatin1String("o") && type != QLatin1String("i") && type != QLatin1String("r"))
+            continue;
+
+        Event event;
+        event.type = type.at(0).toLatin1();
+        event.time = qRound64(array.at(0).toDouble() * 1000000);
+        event.data = array.at(2).toString().toUtf8();
+        if (event.type == 'r') {
+            int columns, lines;
+            if (!parseSize(event.data, &columns, &lines))
+                continue;
+            char size[4];
+            qToLittleEndian<quint16>(columns, size);
+            qToLittleEndian<quint16>(lines, size + 2);
+            event.data = QByteArray(size, 4);
+        }
+        _events.append(event);
+    }
+    return true;
+}
+
+void SessionPlayer::buildKeyframes()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QStringEncoder(QStringConverter::Utf8));
+    emulation.setImageSize(_lines, _columns);
+    ScreenWindow *window = emulation.createWindow();
+
+    int columns = _columns;
+    int lines = _lines;
+    qint64 bytes = 0;
+    for (int i = 0; i < _events.size() && !_stopKeyframes; i++) {
+        const Event &event = _events.at(i);
+        if (event.type == 'o') {
+            emulation.receiveData(event.data.constData(), event.data.size());
+            bytes += event.data.size();
+        } else if (event.type == 'r') {
+            columns = qFromLittleEndian<quint16>(event.data.constData());
+            lines = qFromLittleEndian<quint16>(event.data.constData() + 2);
+            emulation.setImageSize(lines, columns);
+        }
+
+        if (bytes >= KeyframeBytes) {
+            const Keyframe keyframe = {i + 1, event.time, columns, lines,
+                                       screenSequence(emulation, window)};
+            QMutexLocker locker(&_keyframeLock);
+            _keyframes.append(keyframe);
+            bytes = 0;
+        }
+    }
+}
+
+qint64 SessionPlayer::duration() const
+{
+    return _events.isEmpty() ? 0 : _events.last().time;
+}
+
+void SessionPlayer::setSpeed(double speed)
+{
+    if (_playing) {
+        // continue from where the old speed has got to
+        _playStart = _speed > 0 ? _playStart + qint64(_clock.nsecsElapsed() / 1000 * _speed) : _position;
+        _clock.restart();
+    }
+    _speed = qMax(0.0, speed);
+    if (_playing)
+        scheduleNext();
+}
+
+void SessionPlayer::play()
+{
+    if (_playing || _nextEvent >= _events.size())
+        return;
+
+    _playing = true;
+    _playStart = _position;
+    _clock.start();
+    scheduleNext();
+}
+
+void SessionPlayer::pause()
+{
+    if (!_playing)
+        return;
+
+    _playing = false;
+    _timer.stop();
+}
+
+void SessionPlayer::seek(qint64 position)
+{
+    position = qBound<qint64>(0, position, duration());
+
+    // the last keyframe built so far before the position; the first is at
+    // the start
+    Keyframe keyframe;
+    {
+        QMutexLocker locker(&_keyframeLock);
+        if (_keyframes.isEmpty())
+            return;
+        keyframe = *(std::upper_bound(_keyframes.cbegin(), _keyframes.cend(), position,
+                                      [](qint64 time, const Keyframe &k) { return time < k.time; }) - 1);
+    }
+
+    emit sizeChanged(keyframe.columns, keyframe.lines);
+    static const char reset[] = "\033c";
+    emit output(reset, sizeof(reset) - 1);
+    if (!keyframe.screen.isEmpty())
+        emit output(keyframe.screen.constData(), keyframe.screen.size());
+
+    _nextEvent = keyframe.event;
+    const auto end = std::upper_bound(_events.cbegin() + _nextEvent, _events.cend(), position,
+                                      [](qint64 time, const Event &e) { return time < e.time; });
+    sendEvents(end - _events.cbegin(), false);
+
+    _position = position;
+    emit positionChanged(_position);
+
+    if (_playing) {
+        _playStart = _position;
+        _clock.restart();
+        scheduleNext();
+    }
+}
+
+void SessionPlayer::playNext()
+{
+    if (!_playing)
+        return;
+
+    int end = _nextEvent;
+    if (_speed == 0) {
+        qint64 bytes = 0;
+        while (end < _events.size() && bytes < MaxBatchBytes)
+            bytes += _events.at(end++).data.size();
+    } else {
+        const qint64 now = _playStart + qint64(_clock.nsecsElapsed() / 1000 * _speed);
+        while (end < _events.size() && _events.at(end).time <= now)
+            end++;
+    }
+
+    if (end > _nextEvent) {
+        _position = _events.at(end - 1).time;
+        sendEvents(end, true);
+        emit positionChanged(_position);
+    }
+    scheduleNext();
+}
+
+void SessionPlayer::sendEvents(int end, bool withInput)
+{
+    QByteArray run;
+    int runStart = -1;
+    const auto sendRun = [&](int runEnd) {
+        if (runStart < 0)
+            return;
+        if (runEnd - runStart == 1) {
+            const QByteArray &data = _events.at(runStart).data;
+            emit output(data.constData(), data.size());
+        } else {
+            emit output(run.constData(), run.size());
+        }
+        run.clear();
+        runStart = -1;
+    };
+
+    for (int i = _nextEvent; i < end; i++) {
+        const Event &event = _events.at(i);
+        if (event.type == 'o') {
+            if (runStart < 0)
+                runStart = i;
+            else if (run.isEmpty())
+                run = _events.at(runStart).data;
+            if (i > runStart)
+                run += event.data;
+            continue;
+        }
+
+        sendRun(i);
+        if (event.type == 'i') {
+            if (withInput)
+                emit input(event.data.constData(), event.data.size());
+        } else {
+            emit sizeChanged(qFromLittleEndian<quint16>(event.data.constData()),
+                             qFromLittleEndian<quint16>(event.data.constData() + 2));
+        }
+    }
+    sendRun(end);
+    _nextEvent = end;
+}
+
+void SessionPlayer::scheduleNext()
+{
+    if (!_playing)
+        return;
+
+    if (_nextEvent >= _events.size()) {
+        _playing = false;
+        emit finished();
+        return;
+    }
+
+    if (_speed == 0) {
+        _timer.start(0);
+        return;
+    }
+
+    const qint64 now = _playStart + qint64(_clock.nsecsElapsed() / 1000 * _speed);
+    const qint64 wait = qint64((_events.at(_nextEvent).time - now) / _speed / 1000);
+    _timer.start(int(qBound<qint64>(0, wait, 60 * 60 * 1000)));
+}
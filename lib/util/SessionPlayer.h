@@ -0,0 +1,138 @@
+#ifndef SESSIONPLAYER_H
+#define SESSIONPLAYER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+
+class QIODevice;
+class QThread;
+
+/**
+ * Plays back a recording made with SessionRecorder, in either of its
+ * formats.  Connect output() to QTermWidget::recvData() and sizeChanged()
+ * to the size of the terminal; input() carries what was typed, which is
+ * not shown by the terminal itself.
+ *
+ * Playback runs in real time, sped up by setSpeed(), or as fast as
+ * possible.  After loading, the output is run through an emulation of its
+ * own on a worker thread, and every KeyframeBytes of output the screens
+ * are kept as a keyframe: a sequence which redraws the primary screen and,
+ * if it is in use, the alternate screen over it.  seek() resets the
+ * terminal, sends the last keyframe before the position and only the
+ * output recorded after it.  Until the keyframes are built, see
+ * keyframesBuilt(), seeking sends more of the output.  The history and
+ * terminal modes other than the alternate screen are not part of
+ * keyframes.
+ */
+class SessionPlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** A keyframe is kept after every this many bytes of output. */
+    static constexpr qint64 KeyframeBytes = 1024 * 1024;
+    /** Playing as fast as possible sends about this many bytes at a time. */
+    static constexpr int MaxBatchBytes = 1024 * 1024;
+
+    explicit SessionPlayer(QObject *parent = nullptr);
+    /** Stops building keyframes and waits for the worker thread to end. */
+    ~SessionPlayer() override;
+
+    /**
+     * Reads a recording from @p device and moves to its start.  Returns
+     * false, see errorString(), if it can not be read.  The whole recording
+     * is read and parsed on the calling thread; keyframes are built on a
+     * worker thread afterwards.
+     */
+    bool load(QIODevice *device);
+    QString errorString() const { return _errorString; }
+
+    /** The length of the recording in microseconds. */
+    qint64 duration() const;
+    /** The playback position in microseconds. */
+    qint64 position() const { return _position; }
+
+    /** The size of the terminal when the recording started. */
+    int columns() const { return _columns; }
+    int lines() const { return _lines; }
+
+    /**
+     * Sets how many times faster than recorded the playback runs.  0 plays
+     * as fast as possible.  Defaults to 1.
+     */
+    void setSpeed(double speed);
+    double speed() const { return _speed; }
+
+    void play();
+    void pause();
+    bool isPlaying() const { return _playing; }
+
+    /** Moves to @p position, in microseconds, and shows the terminal as it was then. */
+    void seek(qint64 position);
+
+signals:
+    void output(const char *data, int length);
+    void input(const char *data, int length);
+    void sizeChanged(int columns, int lines);
+    void positionChanged(qint64 position);
+    /** Emitted when playback reaches the end of the recording. */
+    void finished();
+    /** Emitted when all keyframes of a loaded recording have been built. */
+    void keyframesBuilt();
+
+private:
+    struct Event
+    {
+        qint64 time;
+        char type;          // 'o' output, 'i' input, 'r' resize
+        QByteArray data;    // for resizes u16 columns, u16 lines
+    };
+
+    struct Keyframe
+    {
+        int event;          // the first event after the keyframe
+        qint64 time;
+        int columns;
+        int lines;
+        QByteArray screen;
+    };
+
+    bool loadBinary(QIODevice *device);
+    bool loadAsciicast(QIODevice *device);
+    // runs on the worker thread, reading _events and adding to _keyframes
+    void buildKeyframes();
+    void stopKeyframes();
+
+    void playNext();
+    // sends the events from _nextEvent up to, not including, @p end, with
+    // consecutive output in one piece.  Input is left out unless @p withInput
+    void sendEvents(int end, bool withInput);
+    void scheduleNext();
+
+    QVector<Event> _events;
+    QVector<Keyframe> _keyframes;   // guarded by _keyframeLock
+    mutable QMutex _keyframeLock;
+    QThread *_keyframeThread = nullptr;
+    std::atomic<bool> _stopKeyframes{false};
+    int _columns = 80;
+    int _lines = 24;
+    QString _errorString;
+
+    int _nextEvent = 0;
+    qint64 _position = 0;
+    double _speed = 1;
+    bool _playing = false;
+    // playback time is _playStart plus the elapsed _clock times the speed
+    qint64 _playStart = 0;
+    QElapsedTimer _clock;
+    QTimer _timer;
+};
+
+#endif // SESSIONPLAYER_H
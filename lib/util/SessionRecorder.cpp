@@ -0,0 +1,180 @@
+#include "SessionRecorder.h"
+
+#include <QDateTime>
+#include <QFileDevice>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QString>
+#include <QtEndian>
+
+namespace {
+
+// returns the length of the start of @p data which does not end in the
+// middle of a UTF-8 sequence
+qsizetype completeUtf8Length(const QByteArray &data)
+{
+    const qsizetype size = data.size();
+    for (qsizetype i = size - 1; i >= 0 && i >= size - 3; i--) {
+        const uchar c = data.at(i);
+        if ((c & 0xc0) == 0x80)
+            continue;
+        const int needed = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+        return size - i >= needed ? size : i;
+    }
+    return size;
+}
+
+void appendJsonString(QByteArray &json, const QByteArray &utf8)
+{
+    json += '"';
+    for (char c : utf8) {
+        switch (c) {
+        case '"':
+            json += "\\\"";
+            break;
+        case '\\':
+            json += "\\\\";
+            break;
+        case '\n':
+            json += "\\n";
+            break;
+        case '\r':
+            json += "\\r";
+            break;
+        case '\t':
+            json += "\\t";
+            break;
+        default:
+            if (static_cast<uchar>(c) < 0x20 || c == 0x7f)
+                json += "\\u00" + QByteArray::number(static_cast<uchar>(c), 16).rightJustified(2, '0');
+            else
+                json += c;
+            break;
+        }
+    }
+    json += '"';
+}
+
+template <typename T>
+void appendLittleEndian(QByteArray &data, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, sizeof(T));
+}
+
+}
+
+SessionRecorder::SessionRecorder(QIODevice *device, Format format)
+    : _device(device)
+    , _format(format)
+{
+}
+
+void SessionRecorder::start(int columns, int lines)
+{
+    QMutexLocker locker(&_lock);
+    if (_started)
+        return;
+
+    _started = true;
+    _clock.start();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QByteArray header;
+    if (_format == Asciicast) {
+        header = "{\"version\": 2, \"width\": " + QByteArray::number(columns) + ", \"height\": " +
+                 QByteArray::number(lines) + ", \"timestamp\": " + QByteArray::number(now / 1000) + "}\n";
+    } else {
+        header = "QTRC";
+        appendLittleEndian<quint16>(header, BinaryVersion);
+        appendLittleEndian<quint16>(header, columns);
+        appendLittleEndian<quint16>(header, lines);
+        appendLittleEndian<quint16>(header, 0);
+        appendLittleEndian<qint64>(header, now);
+    }
+    write(header);
+}
+
+void SessionRecorder::recordOutput(const char *data, int length)
+{
+    record('o', Output, data, length);
+}
+
+void SessionRecorder::recordInput(const char *data, int length)
+{
+    record('i', Input, data, length);
+}
+
+void SessionRecorder::recordResize(int columns, int lines)
+{
+    if (_format == Asciicast) {
+        const QByteArray size = QByteArray::number(columns) + 'x' + QByteArray::number(lines);
+        record('r', Output, size.constData(), size.size());
+    } else {
+        QByteArray size;
+        appendLittleEndian<quint16>(size, columns);
+        appendLittleEndian<quint16>(size, lines);
+        record('r', Output, size.constData(), size.size());
+    }
+}
+
+void SessionRecorder::record(char type, Stream stream, const char *data, int length)
+{
+    QMutexLocker locker(&_lock);
+    if (!_started || length <= 0)
+        return;
+
+    const qint64 time = _clock.nsecsElapsed() / 1000;
+    QByteArray event;
+
+    if (_format == Asciicast) {
+        QByteArray text = QByteArray(data, length);
+        if (type != 'r') {
+            text.prepend(_pending[stream]);
+            const qsizetype complete = completeUtf8Length(text);
+            _pending[stream] = text.mid(complete);
+            text.truncate(complete);
+            if (text.isEmpty())
+                return;
+            // replaces what is not valid UTF-8, which JSON can not hold
+            text = QString::fromUtf8(text).toUtf8();
+        }
+
+        event.reserve(text.size() + 32);
+        event += '[';
+        event += QByteArray::number(time / 1000000.0, 'f', 6);
+        event += ", \"";
+        event += type;
+        event += "\", ";
+        appendJsonString(event, text);
+        event += "]\n";
+    } else {
+        event.reserve(length + 16);
+        event += type;
+        event.append(3, '\0');
+        appendLittleEndian<quint32>(event, length);
+        appendLittleEndian<qint64>(event, time);
+        event.append(data, length);
+    }
+    write(event);
+}
+
+void SessionRecorder::write(const QByteArray &data)
+{
+    if (_device->write(data) != data.size())
+        _error = true;
+}
+
+void SessionRecorder::flush()
+{
+    QMutexLocker locker(&_lock);
+    if (auto file = qobject_cast<QFileDevice *>(_device))
+        file->flush();
+}
+
+bool SessionRecorder::hasError() const
+{
+    QMutexLocker locker(&_lock);
+    return _error;
+}
@@ -0,0 +1,82 @@
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+
+class QIODevice;
+
+/**
+ * Records a terminal session: the output the terminal received, the input
+ * it sent and the changes of its size, each with the time since the
+ * recording started.  See Emulation::setRecorder() and SessionPlayer.
+ *
+ * Recordings are appended to a device in one of two formats:
+ *
+ * - Asciicast, version 2 of the asciinema format: a JSON header line, then
+ *   one JSON array per event.  Its text is UTF-8, so bytes which are not
+ *   valid UTF-8 are recorded as U+FFFD.
+ * - Binary, which keeps every byte:
+ *
+ *       header   "QTRC", u16 version, u16 columns, u16 lines, u16 reserved,
+ *                i64 start time in milliseconds since the epoch
+ *       events   u8 type ('o' output, 'i' input, 'r' resize), u8 reserved[3],
+ *                u32 data length, i64 time in microseconds, data
+ *
+ *   All numbers are little endian.  The data of a resize is u16 columns,
+ *   u16 lines.
+ *
+ * The recorder may be used from several threads.  Events are written as
+ * they happen; call flush() to pass them on from buffering devices.
+ */
+class SessionRecorder
+{
+public:
+    enum Format {
+        Asciicast,
+        Binary
+    };
+
+    static constexpr quint16 BinaryVersion = 1;
+
+    /** @p device must be open for writing and outlive the recorder. */
+    SessionRecorder(QIODevice *device, Format format);
+
+    Format format() const { return _format; }
+
+    /**
+     * Writes the header for a terminal of @p columns by @p lines and starts
+     * the clock.  Events recorded before are dropped.  Calling it again
+     * does nothing.
+     */
+    void start(int columns, int lines);
+
+    void recordOutput(const char *data, int length);
+    void recordInput(const char *data, int length);
+    void recordResize(int columns, int lines);
+
+    /** Flushes the device, if it is a file. */
+    void flush();
+
+    /** Returns true if writing to the device has failed. */
+    bool hasError() const;
+
+private:
+    enum Stream { Output, Input };
+
+    void record(char type, Stream stream, const char *data, int length);
+    void write(const QByteArray &data);
+
+    QIODevice *_device;
+    Format _format;
+    mutable QMutex _lock;
+    QElapsedTimer _clock;
+    bool _started = false;
+    bool _error = false;
+    // the start of a UTF-8 sequence split between two chunks, which
+    // asciicast recordings hold back until the rest arrives
+    QByteArray _pending[2];
+};
+
+#endif // SESSIONRECORDER_H
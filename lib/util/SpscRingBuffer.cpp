@@ -0,0 +1,72 @@
+#include "SpscRingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+SpscRingBuffer::SpscRingBuffer(int capacity)
+    : _writePos(0)
+    , _readPos(0)
+{
+    size_t size = 1024;
+    while (size < static_cast<size_t>(capacity))
+        size *= 2;
+
+    _data = new char[size];
+    _mask = size - 1;
+}
+
+SpscRingBuffer::~SpscRingBuffer()
+{
+    delete[] _data;
+}
+
+int SpscRingBuffer::write(const char *data, int length)
+{
+    const size_t writePos = _writePos.load(std::memory_order_relaxed);
+    const size_t readPos = _readPos.load(std::memory_order_acquire);
+
+    const size_t count = std::min(static_cast<size_t>(length),
+                                  _mask + 1 - (writePos - readPos));
+    if (count == 0)
+        return 0;
+
+    // the free space may wrap around the end of the storage
+    const size_t offset = writePos & _mask;
+    const size_t firstPart = std::min(count, _mask + 1 - offset);
+    memcpy(_data + offset, data, firstPart);
+    memcpy(_data, data + firstPart, count - firstPart);
+
+    _writePos.store(writePos + count, std::memory_order_release);
+    return static_cast<int>(count);
+}
+
+int SpscRingBuffer::read(char *data, int maxLength)
+{
+    const size_t readPos = _readPos.load(std::memory_order_relaxed);
+    const size_t writePos = _writePos.load(std::memory_order_acquire);
+
+    const size_t count = std::min(static_cast<size_t>(maxLength),
+                                  writePos - readPos);
+    if (count == 0)
+        return 0;
+
+    const size_t offset = readPos & _mask;
+    const size_t firstPart = std::min(count, _mask + 1 - offset);
+    memcpy(data, _data + offset, firstPart);
+    memcpy(data + firstPart, _data, count - firstPart);
+
+    _readPos.store(readPos + count, std::memory_order_release);
+    return static_cast<int>(count);
+}
+
+bool SpscRingBuffer::isEmpty() const
+{
+    return _readPos.load(std::memory_order_acquire) ==
+           _writePos.load(std::memory_order_acquire);
+}
+
+int SpscRingBuffer::size() const
+{
+    const size_t readPos = _readPos.load(std::memory_order_acquire);
+    return static_cast<int>(_writePos.load(std::memory_order_acquire) - readPos);
+}
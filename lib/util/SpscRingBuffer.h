@@ -0,0 +1,61 @@
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * A lock-free ring buffer of bytes for exactly one producer thread and one
+ * consumer thread.
+ *
+ * write() may only be called by the producer and read() only by the
+ * consumer.  The consumer role may move between threads as long as the
+ * threads serialize their calls to read(), for example with a mutex.
+ */
+class SpscRingBuffer
+{
+public:
+    /**
+     * Constructs a ring buffer which holds at least @p capacity bytes.
+     * The capacity is rounded up to a power of two.
+     */
+    explicit SpscRingBuffer(int capacity);
+    ~SpscRingBuffer();
+
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+    /**
+     * Copies as much of @p data as fits into the buffer and returns the
+     * number of bytes copied, which is less than @p length if the buffer
+     * is full.
+     */
+    int write(const char *data, int length);
+
+    /**
+     * Moves up to @p maxLength bytes out of the buffer into @p data and
+     * returns the number of bytes moved, 0 if the buffer is empty.
+     */
+    int read(char *data, int maxLength);
+
+    /** Returns true if there is nothing to read. */
+    bool isEmpty() const;
+    /**
+     * Returns the number of bytes waiting to be read.  Either side may call
+     * it; the other side may have changed the number by the time it returns.
+     */
+    int size() const;
+
+    int capacity() const { return static_cast<int>(_mask + 1); }
+
+private:
+    char *_data;
+    size_t _mask;
+
+    // the positions only ever grow and are masked on access; each is
+    // written by one side only and kept on its own cache line
+    alignas(64) std::atomic<size_t> _writePos;
+    alignas(64) std::atomic<size_t> _readPos;
+};
+
+#endif // SPSCRINGBUFFER_H
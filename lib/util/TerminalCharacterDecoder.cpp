@@ -23,6 +23,8 @@
 #include "CharWidth.h"
 #include <QTextStream>
 #include <cwctype>
+#include <string>
+#include <utility>
 
 PlainTextDecoder::PlainTextDecoder()
     : _output(nullptr), _includeTrailingWhitespace(true),
@@ -252,3 +254,132 @@ void HTMLDecoder::closeSpan(std::wstring &text) {
 void HTMLDecoder::setColorTable(const ColorEntry *table) {
     _colorTable = table;
 }
+
+namespace {
+
+// whether two characters look the same, apart from the character itself
+bool sameAppearance(const Character &a, const Character &b) {
+    const quint8 ignored = RE_EXTENDED_CHAR | RE_CURSOR;
+    return a.foregroundColor == b.foregroundColor && a.backgroundColor == b.backgroundColor &&
+           (a.rendition & ~ignored) == (b.rendition & ~ignored);
+}
+
+}
+
+AnsiDecoder::AnsiDecoder()
+    : _output(nullptr) {
+}
+
+void AnsiDecoder::begin(QTextStream *output) {
+    _output = output;
+    _lastCharacter = Character();
+}
+
+void AnsiDecoder::end() {
+    Q_ASSERT(_output);
+
+    // leave the terminal the output is printed in as it was
+    if (!sameAppearance(_lastCharacter, Character()))
+        *_output << QLatin1String("\033[0m");
+
+    _output = nullptr;
+}
+
+void AnsiDecoder::decodeLine(const Character *const characters, int count, LineProperty /*properties*/) {
+    Q_ASSERT(_output);
+
+    std::wstring text;
+    text.reserve(count);
+
+    for (int i = 0; i < count;) {
+        const Character &character = characters[i];
+
+        if (character.character == '\n') {
+            // end the appearance with the line, which is printed without it
+            if (!sameAppearance(_lastCharacter, Character())) {
+                text.append(L"\033[0m");
+                _lastCharacter = Character();
+            }
+            text.push_back(L'\n');
+            i++;
+            continue;
+        }
+
+        if (!sameAppearance(character, _lastCharacter)) {
+            appendRendition(text, character);
+            _lastCharacter = character;
+        }
+
+        if (character.rendition & RE_EXTENDED_CHAR) {
+            ushort extendedCharLength = 0;
+            const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(character.character, extendedCharLength);
+            if (chars) {
+                std::wstring str;
+                for (ushort nchar = 0; nchar < extendedCharLength; nchar++) {
+                    str.push_back(chars[nchar]);
+                }
+                text += str;
+                i += qMax(1, CharWidth::string_unicode_width(str));
+            } else {
+                ++i;
+            }
+        } else {
+            text.push_back(character.character);
+            i += qMax(1, CharWidth::unicode_width(character.character));
+        }
+    }
+
+    *_output << QString::fromStdWString(text);
+}
+
+void AnsiDecoder::appendRendition(std::wstring &text, const Character &character) const {
+    // a full reset followed by the whole appearance, so that nothing of the
+    // previous appearance has to be turned off one by one
+    text.append(L"\033[0");
+
+    const quint8 rendition = character.rendition;
+    CharacterColor foreground = character.foregroundColor;
+    CharacterColor background = character.backgroundColor;
+    if (rendition & RE_REVERSE) {
+        // the screen stores reversed characters with their colours swapped
+        std::swap(foreground, background);
+        text.append(L";7");
+    }
+    if (rendition & RE_BOLD)
+        text.append(L";1");
+    if (rendition & RE_FAINT)
+        text.append(L";2");
+    if (rendition & RE_ITALIC)
+        text.append(L";3");
+    if (rendition & RE_UNDERLINE)
+        text.append(L";4");
+    if (rendition & RE_BLINK)
+        text.append(L";5");
+
+    appendColor(text, foreground, false);
+    appendColor(text, background, true);
+    text.push_back(L'm');
+}
+
+void AnsiDecoder::appendColor(std::wstring &text, const CharacterColor &color, bool background) {
+    switch (color._colorSpace) {
+    case COLOR_SPACE_SYSTEM:
+        if (color._v)
+            text.append(L";" + std::to_wstring((background ? 100 : 90) + color._u));
+        else
+            text.append(L";" + std::to_wstring((background ? 40 : 30) + color._u));
+        break;
+    case COLOR_SPACE_256:
+        text.append(background ? L";48;5;" : L";38;5;");
+        text.append(std::to_wstring(color._u));
+        break;
+    case COLOR_SPACE_RGB:
+        text.append(background ? L";48;2;" : L";38;2;");
+        text.append(std::to_wstring(color._u) + L";" + std::to_wstring(color._v) + L";" +
+                    std::to_wstring(color._w));
+        break;
+    default:
+        // the default colours are what the reset selected
+        break;
+    }
+}
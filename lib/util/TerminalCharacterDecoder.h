@@ -141,4 +141,30 @@ private:
     CharacterColor _lastBackColor;
 };
 
+/**
+ * A terminal character decoder which produces text with the colours and
+ * appearance of the characters as ANSI escape sequences (SGR), so that the
+ * output looks as it did when it is printed in a terminal.
+ */
+class AnsiDecoder : public TerminalCharacterDecoder
+{
+public:
+    AnsiDecoder();
+
+    void begin(QTextStream* output) override;
+    void end() override;
+
+    void decodeLine(const Character* const characters,
+                            int count,
+                            LineProperty properties) override;
+
+private:
+    // appends the sequence which selects the appearance of @p character
+    void appendRendition(std::wstring& text, const Character& character) const;
+    static void appendColor(std::wstring& text, const CharacterColor& color, bool background);
+
+    QTextStream* _output;
+    Character _lastCharacter;   // only the appearance is used
+};
+
 #endif
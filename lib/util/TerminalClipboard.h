@@ -0,0 +1,38 @@
+#ifndef TERMINALCLIPBOARD_H
+#define TERMINALCLIPBOARD_H
+
+#include <QString>
+
+/**
+ * The clipboard as seen by a terminal emulation.
+ *
+ * Terminal programs can set the clipboard with the OSC 52 escape
+ * sequence.  Emulation does not talk to the system clipboard itself, so
+ * that it can run without a GUI; instead the application installs an
+ * implementation of this interface with Emulation::setClipboard().  The
+ * methods are always called on the thread which owns the emulation.
+ */
+class TerminalClipboard
+{
+public:
+    /** The clipboards a terminal program can write to. */
+    enum Mode {
+        /** The clipboard used for copy and paste. */
+        Clipboard,
+        /** The selection, pasted with the middle mouse button on X11. */
+        Selection
+    };
+
+    virtual ~TerminalClipboard() = default;
+
+    /** Sets the contents of the clipboard @p mode to @p text. */
+    virtual void setText(const QString &text, Mode mode) = 0;
+
+    /** Clears the clipboard @p mode. */
+    virtual void clear(Mode mode) = 0;
+
+    /** Returns true if the Selection clipboard is available. */
+    virtual bool supportsSelection() const = 0;
+};
+
+#endif // TERMINALCLIPBOARD_H
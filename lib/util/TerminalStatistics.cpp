@@ -0,0 +1,29 @@
+#include "TerminalStatistics.h"
+
+const char *TerminalStatistics::tokenTypeName(int type)
+{
+    static const char *const names[TokenTypeCount] = {
+        "character", "control", "escape", "charset", "dec", "csi-ps", "csi-pn", "csi-pr",
+        "vt52", "csi-pg", "csi-pe", "csi-ps-sp", "csi-pq", "csi-pl", "osc",
+    };
+    return type >= 0 && type < TokenTypeCount ? names[type] : "unknown";
+}
+
+TerminalStatistics &TerminalStatistics::operator+=(const TerminalStatistics &other)
+{
+    bytesReceived += other.bytesReceived;
+    for (int i = 0; i < TokenTypeCount; i++)
+        tokens[i] += other.tokens[i];
+    historyLines += other.historyLines;
+    extendedChars = qMax(extendedChars, other.extendedChars);
+    extendedCharCollisions = qMax(extendedCharCollisions, other.extendedCharCollisions);
+    imageUpdates += other.imageUpdates;
+    dirtyCells += other.dirtyCells;
+    paints += other.paints;
+    paintTime += other.paintTime;
+    filterRuns += other.filterRuns;
+    filterTime += other.filterTime;
+    searches += other.searches;
+    searchTime += other.searchTime;
+    return *this;
+}
@@ -0,0 +1,66 @@
+#ifndef TERMINALSTATISTICS_H
+#define TERMINALSTATISTICS_H
+
+#include <QtGlobal>
+
+/**
+ * Counters are only collected when the library is built with
+ * CONFIG += qtermwidget_statistics, which defines QTERMWIDGET_STATISTICS.
+ * Otherwise the statements passed to TERMINAL_STATISTIC() are removed.
+ */
+#ifdef QTERMWIDGET_STATISTICS
+#define TERMINAL_STATISTIC(statement) statement
+#else
+#define TERMINAL_STATISTIC(statement)
+#endif
+
+/**
+ * Counters describing the work done by one terminal, see
+ * QTermWidget::statistics().  Times are in nanoseconds.
+ */
+struct TerminalStatistics
+{
+    /** The kinds of tokens the emulation interprets. */
+    enum TokenType {
+        CharacterToken,         // a printable character
+        ControlToken,           // C0 control character
+        EscapeToken,            // ESC x
+        CharsetToken,           // ESC ( x and similar
+        DecToken,               // ESC # x
+        CsiPsToken,             // CSI with a numbered parameter, such as SGR
+        CsiPnToken,             // CSI with numeric parameters, such as CUP
+        CsiPrToken,             // CSI ? with private modes
+        Vt52Token,
+        CsiPgToken,             // CSI >
+        CsiPeToken,             // CSI !
+        CsiPsSpToken,           // CSI with a space intermediate
+        CsiPqToken,             // CSI =
+        CsiPlToken,             // CSI <
+        OscToken,               // operating system command
+        TokenTypeCount
+    };
+
+    /** Returns a short name for @p type, as used in traces. */
+    static const char *tokenTypeName(int type);
+
+    quint64 bytesReceived = 0;
+    quint64 tokens[TokenTypeCount] = {};
+    quint64 historyLines = 0;           // lines pushed into the history
+
+    int extendedChars = 0;              // entries of the (shared) extended character table
+    quint64 extendedCharCollisions = 0; // hash collisions while adding entries
+
+    quint64 imageUpdates = 0;           // calls to TerminalDisplay::updateImage()
+    quint64 dirtyCells = 0;             // cells found changed by updateImage()
+    quint64 paints = 0;
+    qint64 paintTime = 0;
+    quint64 filterRuns = 0;
+    qint64 filterTime = 0;
+    quint64 searches = 0;
+    qint64 searchTime = 0;
+
+    /** Adds the counters of @p other to these counters. */
+    TerminalStatistics &operator+=(const TerminalStatistics &other);
+};
+
+#endif // TERMINALSTATISTICS_H
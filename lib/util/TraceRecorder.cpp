@@ -0,0 +1,149 @@
+#include "TraceRecorder.h"
+
+#include <QCoreApplication>
+#include <QIODevice>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+namespace {
+
+QByteArray jsonString(const QString &text)
+{
+    QByteArray result = "\"";
+    const QByteArray utf8 = text.toUtf8();
+    for (char c : utf8) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<uchar>(c) < 0x20) {
+            result += "\\u00" + QByteArray::number(static_cast<uchar>(c), 16).rightJustified(2, '0');
+        } else {
+            result += c;
+        }
+    }
+    return result + '"';
+}
+
+// trace timestamps are in microseconds
+QByteArray microseconds(qint64 nanoseconds)
+{
+    return QByteArray::number(nanoseconds / 1000.0, 'f', 3);
+}
+
+}
+
+TraceRecorder::TraceRecorder()
+{
+    _clock.start();
+}
+
+TraceRecorder *TraceRecorder::instance()
+{
+    static TraceRecorder recorder;
+    return &recorder;
+}
+
+void TraceRecorder::start()
+{
+    QMutexLocker locker(&_lock);
+    _events.clear();
+    _droppedEvents = 0;
+
+    // the names of removed tracks were only kept for their events
+    for (auto it = _trackNames.begin(); it != _trackNames.end();) {
+        if (std::find(_tracks.cbegin(), _tracks.cend(), it.key()) == _tracks.cend())
+            it = _trackNames.erase(it);
+        else
+            ++it;
+    }
+    _recording = true;
+}
+
+void TraceRecorder::stop()
+{
+    _recording = false;
+}
+
+int TraceRecorder::track(const void *owner)
+{
+    auto it = _tracks.constFind(owner);
+    if (it != _tracks.constEnd())
+        return it.value();
+
+    const int id = ++_lastTrack;
+    _tracks.insert(owner, id);
+    return id;
+}
+
+void TraceRecorder::removeTrack(const void *owner)
+{
+    QMutexLocker locker(&_lock);
+    const int id = _tracks.take(owner);
+    // without events the name is not needed
+    if (id && !isRecording() && _events.isEmpty())
+        _trackNames.remove(id);
+}
+
+void TraceRecorder::addEvent(const char *name, const void *owner, qint64 start,
+                             const char *argName, qint64 argValue)
+{
+    const qint64 end = now();
+
+    QMutexLocker locker(&_lock);
+    if (!isRecording())
+        return;
+    if (_events.size() >= MaxEvents) {
+        _droppedEvents++;
+        return;
+    }
+    _events.append({ name, argName, argValue, start, end - start, track(owner) });
+}
+
+void TraceRecorder::setTrackName(const void *owner, const QString &name)
+{
+    QMutexLocker locker(&_lock);
+    _trackNames.insert(track(owner), name);
+}
+
+bool TraceRecorder::write(QIODevice *device) const
+{
+    QMutexLocker locker(&_lock);
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray chunk = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" +
+                       QByteArray::number(_droppedEvents) + "},\"traceEvents\":[";
+    bool first = true;
+
+    for (auto it = _trackNames.constBegin(); it != _trackNames.constEnd(); ++it) {
+        chunk += first ? "\n" : ",\n";
+        first = false;
+        chunk += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" +
+                 QByteArray::number(it.key()) + ",\"args\":{\"name\":" + jsonString(it.value()) + "}}";
+    }
+
+    for (const Event &event : _events) {
+        chunk += first ? "\n" : ",\n";
+        first = false;
+        chunk += "{\"name\":\"";
+        chunk += event.name;
+        chunk += "\",\"cat\":\"qtermwidget\",\"ph\":\"X\",\"ts\":" + microseconds(event.start) +
+                 ",\"dur\":" + microseconds(event.duration) + ",\"pid\":" + pid + ",\"tid\":" +
+                 QByteArray::number(event.track);
+        if (event.argName) {
+            chunk += ",\"args\":{\"";
+            chunk += event.argName;
+            chunk += "\":" + QByteArray::number(event.argValue) + '}';
+        }
+        chunk += '}';
+
+        if (chunk.size() >= 64 * 1024) {
+            if (device->write(chunk) != chunk.size())
+                return false;
+            chunk.resize(0);
+        }
+    }
+
+    chunk += "\n]}\n";
+    return device->write(chunk) == chunk.size();
+}
@@ -0,0 +1,138 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+#include "TerminalStatistics.h"
+
+class QIODevice;
+
+/**
+ * Records timed events of all terminals in the process, to be written as
+ * a Chrome trace which chrome://tracing and Perfetto can display.
+ *
+ * Every terminal component is shown as a track of its own; name them with
+ * setTrackName() and remove them with removeTrack() when the component is
+ * destroyed.  Recording is off until start() is called, and events are
+ * only recorded when the library is built with QTERMWIDGET_STATISTICS, see
+ * TERMINAL_TRACE().
+ */
+class TraceRecorder
+{
+public:
+    /** The most events recorded before further events are dropped. */
+    static constexpr int MaxEvents = 1000000;
+
+    static TraceRecorder *instance();
+
+    /** Discards all recorded events and starts recording. */
+    void start();
+    /** Stops recording.  The events are kept until the next start(). */
+    void stop();
+    bool isRecording() const { return _recording.load(std::memory_order_relaxed); }
+
+    /** Returns a timestamp for addEvent(). */
+    qint64 now() const { return _clock.nsecsElapsed(); }
+
+    /**
+     * Records an event named @p name on the track of @p owner which started
+     * at @p start, as returned by now(), and ended now.  @p argName and
+     * @p argValue, if given, are shown with the event.  @p name and
+     * @p argName must be string literals.
+     */
+    void addEvent(const char *name, const void *owner, qint64 start,
+                  const char *argName = nullptr, qint64 argValue = 0);
+
+    /** Sets the name under which the events of @p owner are shown. */
+    void setTrackName(const void *owner, const QString &name);
+    /**
+     * Ends the track of @p owner, which is about to be destroyed.  Its
+     * events are kept, and a later owner at the same address starts a new
+     * track.
+     */
+    void removeTrack(const void *owner);
+
+    /**
+     * Writes the recorded events to @p device in the Chrome trace event
+     * format.  Returns false if writing fails.
+     */
+    bool write(QIODevice *device) const;
+
+private:
+    TraceRecorder();
+
+    struct Event
+    {
+        const char *name;
+        const char *argName;
+        qint64 argValue;
+        qint64 start;
+        qint64 duration;
+        int track;
+    };
+
+    int track(const void *owner);
+
+    QElapsedTimer _clock;
+    std::atomic<bool> _recording{false};
+    mutable QMutex _lock;
+    QVector<Event> _events;
+    quint64 _droppedEvents = 0;
+    // tracks are numbered by a serial, so that the events of a removed
+    // track are never shown on another one
+    QHash<const void *, int> _tracks;
+    QHash<int, QString> _trackNames;
+    int _lastTrack = 0;
+};
+
+/**
+ * Records the time until the end of the enclosing scope as an event
+ * @p name on the track of @p owner, see TraceRecorder.  Compiled out unless
+ * QTERMWIDGET_STATISTICS is defined.
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const void *owner)
+        : _name(name)
+        , _owner(owner)
+        , _start(TraceRecorder::instance()->isRecording() ? TraceRecorder::instance()->now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (_start >= 0)
+            TraceRecorder::instance()->addEvent(_name, _owner, _start, _argName, _argValue);
+    }
+
+    /** Shows @p value as @p name with the event. */
+    void setArg(const char *name, qint64 value)
+    {
+        _argName = name;
+        _argValue = value;
+    }
+
+private:
+    const char *_name;
+    const void *_owner;
+    qint64 _start;
+    const char *_argName = nullptr;
+    qint64 _argValue = 0;
+};
+
+#ifdef QTERMWIDGET_STATISTICS
+#define TERMINAL_TRACE(variable, name, owner) TraceScope variable(name, owner)
+#define TERMINAL_TRACE_REMOVE(owner) TraceRecorder::instance()->removeTrack(owner)
+#else
+#define TERMINAL_TRACE(variable, name, owner)
+#define TERMINAL_TRACE_REMOVE(owner)
+#endif
+
+#endif // TRACERECORDER_H
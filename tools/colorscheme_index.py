@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Precompiles the bundled color schemes into lib/color-schemes/index.bin.
+
+ColorSchemeManager reads the bundled schemes from this index, so that
+listing and looking up schemes does not parse any .colorscheme file.
+The qmake build runs it whenever a file in lib/color-schemes is added,
+removed or changed; by hand:
+
+    python3 tools/colorscheme_index.py [--output FILE]
+    python3 tools/colorscheme_index.py --check
+
+--check fails if the index does not match the schemes, without writing it.
+
+The schemes are read the way ColorScheme::read() reads them.  The index is
+little endian:
+
+    header    "QTCS", u16 version, u16 scheme count, u16 colors per scheme,
+              u16 reserved, u32 offset of the string pool
+    schemes   sorted by name, each
+                u32 name offset, u16 name length,
+                u16 description length, u32 description offset,
+                u16 opacity in 1/10000, u16 reserved,
+                8 bytes: the start of the SHA-1 of the .colorscheme file,
+                per color: u8 red, u8 green, u8 blue,
+                           u8 flags (1 transparent, 2 has bold, 4 bold),
+                           u16 max random hue, u8 max random saturation,
+                           u8 max random value
+    strings   UTF-8, not terminated
+"""
+
+import argparse
+import configparser
+import hashlib
+import os
+import re
+import struct
+import sys
+
+VERSION = 2
+COLOR_NAMES = [
+    "Foreground", "Background",
+    "Color0", "Color1", "Color2", "Color3", "Color4", "Color5", "Color6", "Color7",
+    "ForegroundIntense", "BackgroundIntense",
+    "Color0Intense", "Color1Intense", "Color2Intense", "Color3Intense",
+    "Color4Intense", "Color5Intense", "Color6Intense", "Color7Intense",
+]
+HEADER = struct.Struct("<4sHHHHI")
+SCHEME = struct.Struct("<IHHIHH8s")
+HASH_SIZE = 8
+COLOR = struct.Struct("<BBBBHBB")
+
+
+def parse_color(value):
+    if value is None:
+        return (0, 0, 0)
+    parts = [part.strip() for part in value.split(",")]
+    if len(parts) == 3:
+        try:
+            rgb = tuple(int(part) for part in parts)
+        except ValueError:
+            return (0, 0, 0)
+        return rgb if all(0 <= c <= 255 for c in rgb) else (0, 0, 0)
+    if re.fullmatch(r"#[0-9a-fA-F]{6}", value):
+        return tuple(int(value[i:i + 2], 16) for i in (1, 3, 5))
+    return (0, 0, 0)
+
+
+def parse_bool(value):
+    return value.strip().lower() in ("true", "1")
+
+
+def read_scheme(path):
+    config = configparser.ConfigParser(interpolation=None, strict=False)
+    config.optionxform = str
+    with open(path, encoding="utf-8") as f:
+        config.read_file(f)
+
+    general = config["General"] if config.has_section("General") else {}
+    description = general.get("Description", "Un-named Color Scheme")
+    opacity = float(general.get("Opacity", "1"))
+
+    colors = []
+    for name in COLOR_NAMES:
+        group = config[name] if config.has_section(name) else {}
+        flags = 0
+        if parse_bool(group.get("Transparent", "false")):
+            flags |= 1
+        if "Bold" in group:
+            flags |= 2
+            if parse_bool(group["Bold"]):
+                flags |= 4
+        colors.append(parse_color(group.get("Color")) + (
+            flags,
+            int(group.get("MaxRandomHue", 0)),
+            int(group.get("MaxRandomSaturation", 0)),
+            int(group.get("MaxRandomValue", 0)),
+        ))
+    with open(path, "rb") as f:
+        source_hash = hashlib.sha1(f.read()).digest()[:HASH_SIZE]
+    return description, opacity, colors, source_hash
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    directory = os.path.join(root, "lib", "color-schemes")
+
+    parser = argparse.ArgumentParser(description="Precompiles the bundled color schemes.")
+    parser.add_argument("--output", default=os.path.join(directory, "index.bin"),
+                        help="where to write the index")
+    parser.add_argument("--check", action="store_true",
+                        help="only check that the index is up to date")
+    args = parser.parse_args()
+
+    # like ColorSchemeManager: the name is the part before the first dot, and
+    # the first file in case insensitive order wins
+    schemes = {}
+    files = sorted((f for f in os.listdir(directory) if f.endswith(".colorscheme")), key=str.lower)
+    for file_name in files:
+        name = file_name.split(".")[0]
+        if name and name not in schemes:
+            schemes[name] = read_scheme(os.path.join(directory, file_name))
+
+    strings = bytearray()
+    records = bytearray()
+    names = sorted(schemes)
+    pool_offset = HEADER.size + len(names) * (SCHEME.size + len(COLOR_NAMES) * COLOR.size)
+    for name in names:
+        description, opacity, colors, source_hash = schemes[name]
+        name_bytes = name.encode("utf-8")
+        description_bytes = description.encode("utf-8")
+        name_offset = pool_offset + len(strings)
+        strings += name_bytes
+        description_offset = pool_offset + len(strings)
+        strings += description_bytes
+        records += SCHEME.pack(name_offset, len(name_bytes), len(description_bytes),
+                               description_offset, round(opacity * 10000), 0, source_hash)
+        for color in colors:
+            records += COLOR.pack(*color)
+
+    data = HEADER.pack(b"QTCS", VERSION, len(names), len(COLOR_NAMES), 0, pool_offset)
+    data += records + strings
+
+    if args.check:
+        try:
+            with open(args.output, "rb") as f:
+                current = f.read()
+        except OSError:
+            current = None
+        if current != data:
+            print("%s is out of date, run %s" % (args.output, os.path.relpath(__file__, root)),
+                  file=sys.stderr)
+            return 1
+        return 0
+
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("indexed %d color schemes, %d bytes" % (len(names), len(data)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())